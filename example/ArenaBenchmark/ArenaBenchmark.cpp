@@ -0,0 +1,122 @@
+#include "pocket_fsm_arena.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+// Startup cost of a fleet of sensors : N individual constructions, each allocating its
+// state, its pimpl and their control blocks, against a single MachineArena.
+// Usage : ArenaBenchmark [machines]
+
+struct Sample { int value; };
+
+class SensorImpl : public pocket_fsm::PimplBase
+{
+public:
+	explicit SensorImpl(size_t id)
+		: id(id)
+	{}
+
+	size_t id;
+	int last = 0;
+	unsigned samples = 0;
+};
+
+class SensorStateIF : public pocket_fsm::StatePimplIF<SensorImpl>
+{
+	BASE_STATE(SensorStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Sample) = 0;
+};
+
+class Idle : public SensorStateIF
+{
+	CONCRETE_STATE(Idle)
+	INITIAL_STATE(Idle)
+
+	REACT(Sample) override;
+};
+
+class Sampling : public SensorStateIF
+{
+	CONCRETE_STATE(Sampling)
+
+	REACT(Sample) override
+	{
+		pimpl()->last = e.value;
+		++pimpl()->samples;
+	}
+};
+
+void Idle::react(Sample &sample)
+{
+	pimpl()->last = sample.value;
+	++pimpl()->samples;
+	changeState<Sampling>();
+}
+
+class Sensor : public pocket_fsm::FiniteStateMachine<SensorStateIF>
+{
+public:
+	// The arena initializes the machines itself
+	Sensor() = default;
+
+	explicit Sensor(size_t id)
+	{
+		initialize(new Idle(new SensorImpl(id)));
+	}
+
+	const SensorImpl &impl() const
+	{
+		using Access = pocket_fsm::internal::FrameworkAccess;
+		return *static_cast<const SensorImpl *>(Access::pimpl(*Access::currentState(*this)).get());
+	}
+};
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+	const size_t count = argc > 1 ? size_t(std::strtoull(argv[1], nullptr, 10)) : 200000;
+
+	Clock::time_point start = Clock::now();
+	std::vector<std::unique_ptr<Sensor>> individual;
+	individual.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		individual.emplace_back(new Sensor(i));
+	}
+	const double individualMs = elapsedMs(start);
+
+	start = Clock::now();
+	pocket_fsm::MachineArena<Sensor, Idle> arena(count, [](size_t i) { return SensorImpl(i); });
+	const double arenaMs = elapsedMs(start);
+
+	// Both fleets need to behave the same
+	bool same = true;
+	for (size_t i = 0; i < count; ++i)
+	{
+		Sample sample{ int(i) };
+		individual[i]->sendEvent(sample);
+		arena[i].sendEvent(sample);
+		same = same && individual[i]->getCurrentStateId() == arena[i].getCurrentStateId() &&
+			individual[i]->impl().id == arena[i].impl().id && arena[i].impl().last == int(i);
+	}
+
+	printf("%zu machines : individual %.1f ms, arena %.1f ms (%.1fx)\n", count, individualMs, arenaMs, individualMs / arenaMs);
+	if (!same)
+	{
+		printf("The arena machines differ from the individual ones!\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,165 @@
+#include "pocket_fsm_async.h"
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+// A document saved in the background. Editing during a save cancels it and starts
+// another one, so that the disk is not kept busy with versions already outdated.
+
+struct Edit { int version; };
+struct Save {};
+struct SaveResult { int version; };
+
+// What the slow disk went through, shared with the pool threads
+std::atomic<int> writtenVersion(0);
+std::atomic<int> cancelledSaves(0);
+
+class DocumentImpl : public pocket_fsm::PimplBase
+{
+public:
+	int version = 0;
+	int savedVersion = 0;
+};
+
+class DocumentStateIF : public pocket_fsm::AsyncState<DocumentStateIF, pocket_fsm::StatePimplIF<DocumentImpl>>
+{
+	BASE_STATE(DocumentStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Edit);
+	REACT(Save) {};
+	REACT(pocket_fsm::Completion<SaveResult>) {};
+};
+
+class Dirty : public DocumentStateIF
+{
+	CONCRETE_STATE(Dirty)
+	INITIAL_STATE(Dirty)
+
+	REACT(Save) override;
+};
+
+class Saving : public DocumentStateIF
+{
+	CONCRETE_STATE(Saving)
+
+	REACT(OnEntry) override
+	{
+		const int version = pimpl()->version;
+		startAsync([version](const pocket_fsm::CancelToken &token)
+		{
+			// Writes a block at a time, giving up as soon as the document moved on
+			for (int block = 0; block < 20; ++block)
+			{
+				if (token.isCancelled())
+				{
+					++cancelledSaves;
+					return SaveResult{ 0 };
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			writtenVersion = version;
+			return SaveResult{ version };
+		});
+	}
+
+	// Restarting the save exits this state, which cancels the save in progress
+	REACT(Edit) override
+	{
+		DocumentStateIF::react(e);
+		changeState<Saving>();
+	}
+
+	REACT(pocket_fsm::Completion<SaveResult>) override;
+};
+
+class Saved : public DocumentStateIF
+{
+	CONCRETE_STATE(Saved)
+};
+
+void DocumentStateIF::react(Edit &edit)
+{
+	pimpl()->version = edit.version;
+	if (getStateId() == Saved::stateId())
+	{
+		changeState<Dirty>();
+	}
+}
+
+void Dirty::react(Save &)
+{
+	changeState<Saving>();
+}
+
+void Saving::react(pocket_fsm::Completion<SaveResult> &completion)
+{
+	pimpl()->savedVersion = completion.get().version;
+	changeState<Saved>();
+}
+
+class Document : public pocket_fsm::AsyncStateMachine<DocumentStateIF>
+{
+public:
+	explicit Document(pocket_fsm::AsyncThreadPool &pool)
+		: AsyncStateMachine(pool.executor())
+	{
+		initialize(new Dirty(new DocumentImpl()));
+	}
+
+	// Completions are delivered under the lock, which needs to outlive them
+	~Document()
+	{
+		stopAsync();
+	}
+
+	int savedVersion()
+	{
+		lock();
+		using Access = pocket_fsm::internal::FrameworkAccess;
+		const int version = static_cast<const DocumentImpl *>(Access::pimpl(*Access::currentState(*this)).get())->savedVersion;
+		unlock();
+		return version;
+	}
+
+protected:
+	// Completions come from the pool threads
+	std::mutex _mutex;
+
+	void lock() override
+	{
+		_mutex.lock();
+	}
+
+	void unlock() override
+	{
+		_mutex.unlock();
+	}
+};
+
+int main(void)
+{
+	pocket_fsm::AsyncThreadPool pool(2);
+	Document document(pool);
+
+	// The user saves after every edit, and keeps typing while the saves are in progress
+	for (int version = 1; version <= 4; ++version)
+	{
+		Edit edit{ version };
+		document.sendEvent(edit);
+		Save save;
+		document.sendEvent(save);
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+
+	for (int i = 0; i < 1000 && document.savedVersion() != 4; ++i)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+
+	printf("Saved version %d, %d saves cancelled, the document is %s\n",
+		document.savedVersion(), cancelledSaves.load(), document.getCurrentStateName());
+	return document.savedVersion() == 4 && writtenVersion == 4 ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+#include "pocket_fsm.h"
+#include <cstdio>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// A bank of tally counters kept in growing and shrinking arrays. Moving a counter to
+// new storage carries its state along without leaving or entering it, so only the
+// counters actually removed from the bank run their exit.
+
+struct Click {};
+
+// Every entry and exit run by the program
+static int entries = 0;
+static int exits = 0;
+
+class CounterImpl : public pocket_fsm::PimplBase
+{
+public:
+	unsigned clicks = 0;
+};
+
+class CounterStateIF : public pocket_fsm::StatePimplIF<CounterImpl>
+{
+	BASE_STATE(CounterStateIF)
+
+	REACT(OnEntry) override
+	{
+		++entries;
+	}
+
+	REACT(OnExit) override
+	{
+		++exits;
+	}
+
+	REACT(Click) = 0;
+};
+
+class Zero : public CounterStateIF
+{
+	CONCRETE_STATE(Zero)
+	INITIAL_STATE(Zero)
+
+	REACT(Click) override;
+};
+
+class Counting : public CounterStateIF
+{
+	CONCRETE_STATE(Counting)
+
+	REACT(Click) override
+	{
+		++pimpl()->clicks;
+	}
+};
+
+void Zero::react(Click &)
+{
+	++pimpl()->clicks;
+	changeState<Counting>();
+}
+
+class Counter : public pocket_fsm::FiniteStateMachine<CounterStateIF>
+{
+public:
+	Counter()
+	{
+		_impl = new CounterImpl();
+		initialize(new Zero(_impl));
+	}
+
+	unsigned clicks() const
+	{
+		return _impl->clicks;
+	}
+
+private:
+	CounterImpl *_impl; // Owned by the states
+};
+
+// A counter clicked from several threads. Its mutex cannot be moved with a memmove.
+class LockedCounter : public Counter
+{
+public:
+	LockedCounter() = default;
+
+	LockedCounter(LockedCounter &&other) noexcept
+		: Counter(std::move(other)) // The mutex is not moved
+	{
+	}
+
+protected:
+	void lock() override
+	{
+		_mutex.lock();
+	}
+
+	void unlock() override
+	{
+		_mutex.unlock();
+	}
+
+	std::mutex _mutex;
+};
+
+namespace pocket_fsm
+{
+template<>
+struct IsTriviallyRelocatable<Counter> : std::true_type { };
+}
+
+// Clicks counter i of the bank i + 1 times, then checks every count
+template<class BANK>
+bool clickAll(BANK &bank, size_t count)
+{
+	Click click;
+	bool counted = true;
+	for (size_t i = 0; i < count; ++i)
+	{
+		for (size_t c = 0; c <= i; ++c)
+		{
+			bank[i].sendEvent(click);
+		}
+		counted = counted && bank[i].clicks() == unsigned(i) + 1 && bank[i].getCurrentStateId() == Counting::stateId();
+	}
+	return counted;
+}
+
+// A vector moves its counters when it grows, and erasing one exits only that one
+bool vectorBank()
+{
+	int entered = entries;
+	int exited = exits;
+	std::vector<Counter> bank;
+	for (int i = 0; i < 100; ++i)
+	{
+		bank.emplace_back();
+	}
+	bool grown = entries == entered + 100 && exits == exited;
+	grown = grown && clickAll(bank, bank.size());
+	entered = entries;
+	exited = exits;
+
+	bank.erase(bank.begin() + 10);
+	const bool erased = exits == exited + 1 && bank.size() == 99 && bank[10].clicks() == 12;
+
+	// A move assignment exits the state it replaces
+	bank[0] = std::move(bank[1]);
+	const bool assigned = exits == exited + 2 && bank[0].clicks() == 2;
+	bank.clear();
+	return grown && erased && assigned && exits == exited + 2 + 98 && entries == entered;
+}
+
+// Removes the counter at index from an array of count counters, relocating the following ones
+template<class COUNTER>
+void removeAt(COUNTER *bank, size_t index, size_t count)
+{
+	bank[index].~COUNTER();
+	pocket_fsm::relocateMachines(bank + index + 1, bank + index, count - index - 1);
+}
+
+// A raw array of counters compacted in place, with a memmove or with the move constructor
+template<class COUNTER>
+bool arrayBank()
+{
+	constexpr size_t COUNT = 8;
+	alignas(COUNTER) unsigned char storage[(COUNT + 1) * sizeof(COUNTER)];
+	COUNTER *bank = reinterpret_cast<COUNTER *>(storage);
+	for (size_t i = 0; i < COUNT; ++i)
+	{
+		new (bank + i) COUNTER();
+	}
+	bool ok = clickAll(bank, COUNT);
+
+	const int exited = exits;
+	removeAt(bank, 3, COUNT);
+	ok = ok && exits == exited + 1 && bank[3].clicks() == 5;
+
+	// Make room at the front, overlapping the counters being moved
+	pocket_fsm::relocateMachines(bank, bank + 1, COUNT - 1);
+	new (bank) COUNTER();
+	ok = ok && exits == exited + 1 && bank[4].clicks() == 5;
+
+	// The relocated counters still dispatch, from where they were
+	Click click;
+	bank[4].sendEvent(click);
+	ok = ok && bank[4].clicks() == 6 && bank[0].clicks() == 0 && bank[0].getCurrentStateId() == Zero::stateId();
+	for (size_t i = 0; i < COUNT; ++i)
+	{
+		bank[i].~COUNTER();
+	}
+	return ok && exits == exited + 1 + int(COUNT);
+}
+
+int main(void)
+{
+	const bool vector = vectorBank();
+	const bool relocated = arrayBank<Counter>();
+	const bool moved = arrayBank<LockedCounter>();
+
+	printf("%d entries and %d exits. Vector : %s, relocated with a memmove : %s, with the move constructor : %s\n",
+		entries, exits, vector ? "ok" : "wrong", relocated ? "ok" : "wrong", moved ? "ok" : "wrong");
+	return vector && relocated && moved && entries == exits ? 0 : 1;
+}
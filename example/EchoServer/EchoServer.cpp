@@ -0,0 +1,211 @@
+#include "pocket_fsm_epoll.h"
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+
+// A connection of a line based echo server, driven by an EventLoop. The client thread
+// sends lines and checks that they come back in upper case, then tells the server it
+// is done through a Waker. A timer guards against a client gone silent.
+
+using pocket_fsm::Readable;
+using pocket_fsm::Writable;
+using pocket_fsm::Timeout;
+using pocket_fsm::Wakeup;
+
+constexpr int LINES = 1000;
+constexpr uint32_t IDLE_TIMER = 1;
+
+class ConnectionImpl : public pocket_fsm::PimplBase
+{
+public:
+	ConnectionImpl(pocket_fsm::EventLoop &loop, int socket)
+		: loop(loop)
+		, socket(socket)
+	{}
+
+	// Echoes the complete lines received so far in upper case
+	void echo()
+	{
+		size_t end;
+		while ((end = pending.find('\n')) != std::string::npos)
+		{
+			std::string line = pending.substr(0, end + 1);
+			pending.erase(0, end + 1);
+			for (char &c : line)
+			{
+				c = char(std::toupper(static_cast<unsigned char>(c)));
+			}
+			// The lines are short and the client reads them back : the socket buffer has room
+			if (::write(socket, line.data(), line.size()) == ssize_t(line.size()))
+			{
+				++echoed;
+			}
+		}
+	}
+
+	pocket_fsm::EventLoop &loop;
+	const int socket;
+	std::string pending;
+	int echoed = 0;
+	bool clientDone = false;
+	int idleTimer = -1;
+	pocket_fsm::Waker done;
+};
+
+class ConnectionStateIF : public pocket_fsm::StatePimplIF<ConnectionImpl>
+{
+	BASE_STATE(ConnectionStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Readable) {};
+	REACT(Writable) {};
+	REACT(Timeout) {};
+	REACT(Wakeup) {};
+};
+
+class Open : public ConnectionStateIF
+{
+	CONCRETE_STATE(Open)
+	INITIAL_STATE(Open)
+
+	REACT(Readable) override;
+
+	REACT(Timeout) override;
+
+	REACT(Wakeup) override;
+};
+
+class Closed : public ConnectionStateIF
+{
+	CONCRETE_STATE(Closed)
+
+	// Nothing more to wait for once the connection is closed
+	REACT(OnEntry) override
+	{
+		pimpl()->loop.remove(pimpl()->socket);
+		pimpl()->loop.remove(pimpl()->idleTimer);
+		pimpl()->loop.remove(pimpl()->done.fd());
+		::shutdown(pimpl()->socket, SHUT_RDWR);
+		pimpl()->loop.stop();
+	}
+};
+
+class TimedOut : public Closed
+{
+	CONCRETE_STATE(TimedOut)
+};
+
+void Open::react(Readable &readable)
+{
+	char buffer[256];
+	const ssize_t n = ::read(readable.fd, buffer, sizeof(buffer));
+	if (n > 0)
+	{
+		pimpl()->pending.append(buffer, size_t(n));
+		pimpl()->echo();
+	}
+	else if (n == 0)
+	{
+		changeState<Closed>();
+	}
+}
+
+void Open::react(Timeout &)
+{
+	changeState<TimedOut>();
+}
+
+void Open::react(Wakeup &)
+{
+	pimpl()->clientDone = true;
+	changeState<Closed>();
+}
+
+class Connection : public pocket_fsm::FiniteStateMachine<ConnectionStateIF>
+{
+public:
+	// Registers the sources of the connection with the loop
+	Connection(pocket_fsm::EventLoop &loop, int socket)
+	{
+		_impl = new ConnectionImpl(loop, socket);
+		initialize(new Open(_impl));
+		loop.watch(*this, socket);
+		_impl->idleTimer = loop.addTimer(*this, IDLE_TIMER, std::chrono::seconds(10));
+		_impl->done = loop.addWakeup(*this, 0);
+	}
+
+	const ConnectionImpl &impl() const
+	{
+		return *_impl;
+	}
+
+	// For the client to tell it is done
+	pocket_fsm::Waker waker() const
+	{
+		return _impl->done;
+	}
+
+private:
+	ConnectionImpl *_impl; // Owned by the states
+};
+
+// Sends the lines, and checks the echoes as they come back
+int client(int socket, pocket_fsm::Waker done)
+{
+	int verified = 0;
+	std::string received;
+	for (int i = 0; i < LINES; ++i)
+	{
+		const std::string line = "line " + std::to_string(i) + "\n";
+		if (::write(socket, line.data(), line.size()) != ssize_t(line.size()))
+		{
+			break;
+		}
+		std::string expected = "LINE " + std::to_string(i) + "\n";
+		while (received.size() < expected.size())
+		{
+			char buffer[64];
+			const ssize_t n = ::read(socket, buffer, sizeof(buffer));
+			if (n <= 0)
+			{
+				return verified;
+			}
+			received.append(buffer, size_t(n));
+		}
+		verified += received.compare(0, expected.size(), expected) == 0 ? 1 : 0;
+		received.erase(0, expected.size());
+	}
+	done.wake();
+	return verified;
+}
+
+int main(void)
+{
+	int sockets[2];
+	if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+	{
+		return 1;
+	}
+
+	pocket_fsm::EventLoop loop;
+	Connection connection(loop, sockets[0]);
+
+	int verified = 0;
+	std::thread clientThread([&verified, &sockets, &connection]()
+	{
+		verified = client(sockets[1], connection.waker());
+	});
+	loop.run();
+	clientThread.join();
+	::close(sockets[0]);
+	::close(sockets[1]);
+
+	printf("%d lines echoed, %d verified by the client. The connection is %s\n",
+		connection.impl().echoed, verified, connection.getCurrentStateName());
+	return connection.getCurrentStateId() == Closed::stateId() && connection.impl().clientDone &&
+		connection.impl().echoed == LINES && verified == LINES ? 0 : 1;
+}
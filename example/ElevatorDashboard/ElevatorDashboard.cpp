@@ -0,0 +1,178 @@
+#include "pocket_fsm_bus.h"
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// A dashboard showing a bank of busy elevators. The controller thread drives them
+// flat out, while the dashboard thread only refreshes now and then : the bus hands it
+// where each elevator went since the last refresh, not every transition in between.
+
+struct Call { int floor; };
+struct Arrive {};
+struct Close {};
+
+class ElevatorImpl : public pocket_fsm::PimplBase
+{
+public:
+	int floor = 0;
+	int target = 0;
+};
+
+class ElevatorStateIF : public pocket_fsm::StatePimplIF<ElevatorImpl>
+{
+	BASE_STATE(ElevatorStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Call) {};
+	REACT(Arrive) {};
+	REACT(Close) {};
+};
+
+class Idle : public ElevatorStateIF
+{
+	CONCRETE_STATE(Idle)
+	INITIAL_STATE(Idle)
+
+	REACT(Call) override;
+};
+
+class Moving : public ElevatorStateIF
+{
+	CONCRETE_STATE(Moving)
+
+	REACT(Arrive) override;
+};
+
+class DoorsOpen : public ElevatorStateIF
+{
+	CONCRETE_STATE(DoorsOpen)
+
+	REACT(Close) override
+	{
+		changeState<Idle>();
+	}
+};
+
+void Idle::react(Call &call)
+{
+	if (call.floor != pimpl()->floor)
+	{
+		pimpl()->target = call.floor;
+		changeState<Moving>();
+	}
+}
+
+void Moving::react(Arrive &)
+{
+	pimpl()->floor = pimpl()->target;
+	changeState<DoorsOpen>();
+}
+
+using Bus = pocket_fsm::StateChangeBus<ElevatorStateIF>;
+using Dashboard = pocket_fsm::Subscriber<ElevatorStateIF>;
+
+class Elevator : public pocket_fsm::FiniteStateMachine<ElevatorStateIF>
+{
+public:
+	explicit Elevator(Bus &bus)
+	{
+		initialize(new Idle(new ElevatorImpl()));
+		setObserver(&bus);
+	}
+};
+
+constexpr size_t ELEVATORS = 64;
+constexpr int ROUNDS = 20000;
+
+int main(void)
+{
+	Bus bus;
+	std::vector<std::unique_ptr<Elevator>> elevators;
+	for (size_t i = 0; i < ELEVATORS; ++i)
+	{
+		elevators.emplace_back(new Elevator(bus));
+	}
+
+	// The dashboard shows every elevator as idle to begin with
+	Dashboard *dashboard = bus.subscribe(ELEVATORS);
+	std::unordered_map<const Dashboard::Machine *, pocket_fsm::StateId> shown;
+	for (const std::unique_ptr<Elevator> &elevator : elevators)
+	{
+		shown[elevator.get()] = Idle::stateId();
+	}
+	size_t refreshes = 0;
+	size_t updates = 0;
+	auto refresh = [&]()
+	{
+		updates += dashboard->drain([&](const Dashboard::Machine *elevator, pocket_fsm::StateId, pocket_fsm::StateId to)
+		{
+			shown[elevator] = to;
+		});
+		++refreshes;
+	};
+
+	std::atomic<bool> running(true);
+	std::thread view([&]()
+	{
+		while (running)
+		{
+			refresh();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	});
+
+	// The controller : calls, arrivals and closing doors all over the bank
+	uint64_t transitions = 0;
+	unsigned seed = 3;
+	for (int round = 0; round < ROUNDS; ++round)
+	{
+		for (std::unique_ptr<Elevator> &elevator : elevators)
+		{
+			seed = seed * 1103515245 + 12345;
+			const pocket_fsm::StateId before = elevator->getCurrentStateId();
+			switch ((seed >> 16) % 3)
+			{
+			case 0:
+			{
+				Call call{ int(seed >> 20) % 10 };
+				elevator->sendEvent(call);
+				break;
+			}
+			case 1:
+			{
+				Arrive arrive;
+				elevator->sendEvent(arrive);
+				break;
+			}
+			default:
+			{
+				Close close;
+				elevator->sendEvent(close);
+				break;
+			}
+			}
+			transitions += elevator->getCurrentStateId() != before ? 1 : 0;
+		}
+	}
+	running = false;
+	view.join();
+	// A last refresh once the bank is quiet
+	refresh();
+
+	bool same = dashboard->dropped() == 0;
+	for (const std::unique_ptr<Elevator> &elevator : elevators)
+	{
+		same = same && shown[elevator.get()] == elevator->getCurrentStateId();
+	}
+	printf("%llu transitions shown with %zu updates over %zu refreshes\n", (unsigned long long)transitions, updates, refreshes);
+	if (!same)
+	{
+		printf("The dashboard differs from the elevators!\n");
+		return 1;
+	}
+	return 0;
+}
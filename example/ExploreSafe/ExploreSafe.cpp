@@ -0,0 +1,168 @@
+#include "pocket_fsm_explore.h"
+#include <cstdio>
+
+// Property testing of a safe going into lockdown after two wrong numbers. The explorer
+// checks that lockdown is always the result of wrong numbers, then finds and shrinks
+// the counterexample of a safe whose reset button locks it down by mistake.
+
+struct Reset {};
+struct Number { int n; };
+struct Configure { int code; };
+
+using SafeEvents = pocket_fsm::EventList<Reset, Number, Configure>;
+
+// The mistake planted in the safe
+bool resetLocksDown = false;
+
+class SafeImpl : public pocket_fsm::PimplBase
+{
+public:
+	int code = 0;
+	int wrongNumbers = 0;
+};
+
+// Clones of the safe explore the branches of the state space
+namespace pocket_fsm
+{
+template<>
+struct IsCopyablePimpl<SafeImpl> : std::true_type {};
+}
+
+class SafeStateIF : public pocket_fsm::StatePimplIF<SafeImpl>
+{
+	BASE_STATE(SafeStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Reset) {};
+	REACT(Number) {};
+	REACT(Configure) {};
+};
+
+class Opened : public SafeStateIF
+{
+	CONCRETE_STATE(Opened)
+	INITIAL_STATE(Opened)
+
+	REACT(Configure) override;
+};
+
+class Closed : public SafeStateIF
+{
+	CONCRETE_STATE(Closed)
+
+	REACT(Number) override;
+	REACT(Reset) override;
+};
+
+class Lockdown : public SafeStateIF
+{
+	CONCRETE_STATE(Lockdown)
+
+	REACT(Reset) override
+	{
+		pimpl()->wrongNumbers = 0;
+		changeState<Opened>();
+	}
+};
+
+void Opened::react(Configure &configure)
+{
+	pimpl()->code = configure.code;
+	changeState<Closed>();
+}
+
+void Closed::react(Number &number)
+{
+	if (number.n == pimpl()->code)
+	{
+		changeState<Opened>();
+	}
+	else if (++pimpl()->wrongNumbers >= 2)
+	{
+		changeState<Lockdown>();
+	}
+}
+
+void Closed::react(Reset &)
+{
+	if (resetLocksDown)
+	{
+		changeState<Lockdown>();
+	}
+}
+
+class Safe : public pocket_fsm::FiniteStateMachine<SafeStateIF>
+{
+public:
+	Safe()
+	{
+		initialize(new Opened(new SafeImpl()));
+	}
+
+	Safe(const Safe &prototype)
+		: FiniteStateMachine()
+	{
+		cloneFrom(prototype);
+	}
+};
+
+using Explorer = pocket_fsm::StateExplorer<Safe, SafeEvents>;
+
+void print(const char *name, const pocket_fsm::ExplorationResult<SafeEvents> &result)
+{
+	printf("%s : %llu sequences, %llu events, ", name, (unsigned long long)result.sequences, (unsigned long long)result.events);
+	if (result.passed)
+	{
+		printf("passed\n");
+		return;
+	}
+	printf("\"%s\" violated by", result.invariant);
+	for (const SafeEvents::Variant &evt : result.counterexample)
+	{
+		const char *names[] = { "Reset", "Number", "Configure" };
+		printf(" %s", names[evt.index()]);
+	}
+	printf("\n");
+}
+
+int main(void)
+{
+	Safe prototype;
+	Explorer explorer(prototype);
+	// Simplest first, so that counterexamples shrink toward the reset
+	explorer.addEvent(Reset());
+	explorer.addEvent(Number{ 1 });
+	explorer.addEvent(Number{ 2 });
+	explorer.addEvent(Configure{ 1 });
+	explorer.addInvariant("Lockdown needs wrong numbers", [](Safe &safe, const Explorer::Sequence &sequence)
+	{
+		if (safe.getCurrentStateId() != Lockdown::stateId())
+		{
+			return true;
+		}
+		for (const SafeEvents::Variant &evt : sequence)
+		{
+			if (std::holds_alternative<Number>(evt))
+			{
+				return true;
+			}
+		}
+		return false;
+	});
+
+	const pocket_fsm::ExplorationResult<SafeEvents> exhaustive = explorer.exhaustive(8);
+	print("Exhaustive", exhaustive);
+	const pocket_fsm::ExplorationResult<SafeEvents> random = explorer.random(20000, 30);
+	print("Random", random);
+
+	resetLocksDown = true;
+	const pocket_fsm::ExplorationResult<SafeEvents> buggy = explorer.random(20000, 30);
+	print("Buggy reset", buggy);
+
+	// The shortest way to the mistake : configure the safe, then reset it
+	const bool shrunk = buggy.counterexample.size() == 2 &&
+		std::holds_alternative<Configure>(buggy.counterexample[0]) && std::holds_alternative<Reset>(buggy.counterexample[1]);
+	return exhaustive.passed && random.passed && !buggy.passed && shrunk ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+#include "pocket_fsm_channel.h"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// A pipeline of three state machines on three threads, linked by channels. The framer
+// cuts a byte stream into frames, the checker validates each frame, and the tally
+// counts the verdicts. A small channel keeps the framer from running ahead, and the
+// stages park while the stream pauses.
+
+struct Frame { uint64_t sequence; unsigned sum; };
+struct Verdict { uint64_t sequence; bool valid; };
+
+using CheckerEvents = pocket_fsm::EventList<Frame>;
+using TallyEvents = pocket_fsm::EventList<Verdict>;
+
+// Frames are bytes between braces, and a frame is valid when its sum is not a multiple of 7
+bool isValid(unsigned sum)
+{
+	return sum % 7 != 0;
+}
+
+// -------------------------------- The framer --------------------------------
+
+class FramerImpl : public pocket_fsm::PimplBase
+{
+public:
+	explicit FramerImpl(pocket_fsm::Channel<CheckerEvents> &checker)
+		: checker(checker)
+	{}
+
+	pocket_fsm::Channel<CheckerEvents> &checker;
+	uint64_t frames = 0;
+	unsigned sum = 0;
+};
+
+class FramerStateIF : public pocket_fsm::StatePimplIF<FramerImpl>
+{
+	BASE_STATE(FramerStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(char) = 0;
+};
+
+class BetweenFrames : public FramerStateIF
+{
+	CONCRETE_STATE(BetweenFrames)
+	INITIAL_STATE(BetweenFrames)
+
+	REACT(char) override;
+};
+
+class InFrame : public FramerStateIF
+{
+	CONCRETE_STATE(InFrame)
+
+	REACT(char) override
+	{
+		if (e == '}')
+		{
+			// Blocks while the checker is behind
+			pimpl()->checker.send(Frame{ pimpl()->frames++, pimpl()->sum });
+			changeState<BetweenFrames>();
+		}
+		else
+		{
+			pimpl()->sum += unsigned(e);
+		}
+	}
+};
+
+void BetweenFrames::react(char &c)
+{
+	if (c == '{')
+	{
+		pimpl()->sum = 0;
+		changeState<InFrame>();
+	}
+}
+
+class Framer : public pocket_fsm::FiniteStateMachine<FramerStateIF>
+{
+public:
+	explicit Framer(pocket_fsm::Channel<CheckerEvents> &checker)
+	{
+		initialize(new BetweenFrames(new FramerImpl(checker)));
+	}
+};
+
+// -------------------------------- The checker --------------------------------
+
+class CheckerImpl : public pocket_fsm::PimplBase
+{
+public:
+	explicit CheckerImpl(pocket_fsm::Channel<TallyEvents> &tally)
+		: tally(tally)
+	{}
+
+	pocket_fsm::Channel<TallyEvents> &tally;
+};
+
+class CheckerStateIF : public pocket_fsm::StatePimplIF<CheckerImpl>
+{
+	BASE_STATE(CheckerStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Frame) = 0;
+};
+
+class Checking : public CheckerStateIF
+{
+	CONCRETE_STATE(Checking)
+	INITIAL_STATE(Checking)
+
+	REACT(Frame) override
+	{
+		pimpl()->tally.send(Verdict{ e.sequence, isValid(e.sum) });
+	}
+};
+
+class Checker : public pocket_fsm::FiniteStateMachine<CheckerStateIF>
+{
+public:
+	explicit Checker(pocket_fsm::Channel<TallyEvents> &tally)
+	{
+		initialize(new Checking(new CheckerImpl(tally)));
+	}
+};
+
+// -------------------------------- The tally --------------------------------
+
+class TallyImpl : public pocket_fsm::PimplBase
+{
+public:
+	uint64_t valid = 0;
+	uint64_t invalid = 0;
+	uint64_t next = 0;      // The sequence number expected next
+	bool inOrder = true;
+};
+
+class TallyStateIF : public pocket_fsm::StatePimplIF<TallyImpl>
+{
+	BASE_STATE(TallyStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Verdict) = 0;
+};
+
+class Counting : public TallyStateIF
+{
+	CONCRETE_STATE(Counting)
+	INITIAL_STATE(Counting)
+
+	REACT(Verdict) override
+	{
+		pimpl()->inOrder = pimpl()->inOrder && e.sequence == pimpl()->next;
+		++pimpl()->next;
+		++(e.valid ? pimpl()->valid : pimpl()->invalid);
+	}
+};
+
+class Tally : public pocket_fsm::FiniteStateMachine<TallyStateIF>
+{
+public:
+	Tally()
+	{
+		initialize(new Counting(new TallyImpl()));
+	}
+
+	const TallyImpl &impl() const
+	{
+		using Access = pocket_fsm::internal::FrameworkAccess;
+		return *static_cast<const TallyImpl *>(Access::pimpl(*Access::currentState(*this)).get());
+	}
+
+	unsigned locks = 0;
+
+protected:
+	void lock() override
+	{
+		++locks;
+	}
+};
+
+// A stage run by hand delivers each batch under a single lock
+bool batchesLockOnce()
+{
+	Tally tally;
+	pocket_fsm::Stage<Tally, TallyEvents> stage(tally, 128, 64);
+	bool sent = true;
+	for (uint64_t sequence = 0; sequence < 100; ++sequence)
+	{
+		sent = sent && stage.input().trySend(Verdict{ sequence, true });
+	}
+	const unsigned locks = tally.locks;
+	bool ok = sent && stage.runOnce() == 64 && tally.locks == locks + 1;
+	ok = ok && stage.runOnce() == 36 && tally.locks == locks + 2;
+	ok = ok && stage.runOnce() == 0 && tally.locks == locks + 2;
+	return ok && tally.impl().valid == 100 && tally.impl().inOrder;
+}
+
+constexpr int FRAMES = 200000;
+
+int main(void)
+{
+	// Pseudo random frames with noise between them, and the verdicts they deserve
+	std::vector<char> stream;
+	uint64_t expectedValid = 0;
+	unsigned seed = 5;
+	for (int f = 0; f < FRAMES; ++f)
+	{
+		stream.push_back('{');
+		unsigned sum = 0;
+		seed = seed * 1103515245 + 12345;
+		for (unsigned b = 0; b < 4 + (seed >> 16) % 8; ++b)
+		{
+			seed = seed * 1103515245 + 12345;
+			const char c = char('a' + (seed >> 16) % 26);
+			stream.push_back(c);
+			sum += unsigned(c);
+		}
+		stream.push_back('}');
+		stream.push_back(' ');
+		expectedValid += isValid(sum) ? 1 : 0;
+	}
+
+	Tally tally;
+	pocket_fsm::Stage<Tally, TallyEvents> tallyStage(tally, 256);
+	Checker checker(tallyStage.input());
+	pocket_fsm::Stage<Checker, CheckerEvents> checkerStage(checker, 64);
+	Framer framer(checkerStage.input());
+
+	tallyStage.start();
+	checkerStage.start();
+	for (size_t i = 0; i < stream.size(); ++i)
+	{
+		if (i == stream.size() / 2)
+		{
+			// Long enough for the idle stages to park, until the next frame wakes them up
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+		framer.sendEvent(stream[i]);
+	}
+	// From upstream to downstream, so that every frame reaches the tally
+	checkerStage.stop();
+	tallyStage.stop();
+
+	const TallyImpl &counted = tally.impl();
+	const bool batched = batchesLockOnce();
+	printf("%llu valid and %llu invalid frames, in order : %s. The framer stalled %llu times. One lock per batch : %s\n",
+		(unsigned long long)counted.valid, (unsigned long long)counted.invalid, counted.inOrder ? "yes" : "no",
+		(unsigned long long)checkerStage.input().stalls(), batched ? "yes" : "no");
+	return counted.inOrder && counted.valid == expectedValid && counted.valid + counted.invalid == FRAMES && batched ? 0 : 1;
+}
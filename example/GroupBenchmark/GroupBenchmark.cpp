@@ -0,0 +1,295 @@
+#include "pocket_fsm_group.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+// A fleet of aircraft in all phases of flight, receiving the same weather reports :
+// sendEvent on every machine in fleet order, against a MachineGroup broadcast serving
+// the machines in the same state together. Serving the buckets gives up the memory
+// order of the fleet, and every transition sorts the group again : the broadcast pays
+// off on fleets that fit in the cache and rarely transition, and loses on the others.
+// Usage : GroupBenchmark [machines] [reports]
+
+struct Weather { unsigned wind; };
+
+class AircraftImpl : public pocket_fsm::PimplBase
+{
+public:
+	unsigned fuel = 0;
+	unsigned distance = 0;
+	unsigned phases = 0;
+};
+
+class AircraftStateIF : public pocket_fsm::StatePimplIF<AircraftImpl>
+{
+	BASE_STATE(AircraftStateIF)
+
+	REACT(OnEntry) override
+	{
+		++pimpl()->phases;
+	};
+	REACT(OnExit) override {};
+
+	REACT(Weather) = 0;
+};
+
+class Parked : public AircraftStateIF
+{
+	CONCRETE_STATE(Parked)
+	INITIAL_STATE(Parked)
+
+	REACT(Weather) override;
+};
+
+class Taxiing : public AircraftStateIF
+{
+	CONCRETE_STATE(Taxiing)
+	INITIAL_STATE(Taxiing)
+
+	REACT(Weather) override;
+};
+
+class Climbing : public AircraftStateIF
+{
+	CONCRETE_STATE(Climbing)
+	INITIAL_STATE(Climbing)
+
+	REACT(Weather) override;
+};
+
+class Cruising : public AircraftStateIF
+{
+	CONCRETE_STATE(Cruising)
+	INITIAL_STATE(Cruising)
+
+	REACT(Weather) override;
+};
+
+class Landing : public AircraftStateIF
+{
+	CONCRETE_STATE(Landing)
+	INITIAL_STATE(Landing)
+
+	REACT(Weather) override;
+};
+
+// Each phase lasts long, so that only a few aircraft transition on each report
+void Parked::react(Weather &weather)
+{
+	pimpl()->fuel += 3 + weather.wind % 5;
+	if (pimpl()->fuel % 65536 < 5)
+	{
+		changeState<Taxiing>();
+	}
+}
+
+void Taxiing::react(Weather &weather)
+{
+	pimpl()->distance += 1 + (weather.wind >> 3) % 3;
+	if (pimpl()->distance % 16384 < 3)
+	{
+		changeState<Climbing>();
+	}
+}
+
+void Climbing::react(Weather &weather)
+{
+	pimpl()->fuel -= 7;
+	pimpl()->distance += 9 + weather.wind % 11;
+	if (pimpl()->distance % 65536 < 20)
+	{
+		changeState<Cruising>();
+	}
+}
+
+void Cruising::react(Weather &weather)
+{
+	pimpl()->fuel -= 2;
+	pimpl()->distance += weather.wind % 2 ? 13 : 17;
+	if (pimpl()->distance % 262144 < 17)
+	{
+		changeState<Landing>();
+	}
+}
+
+void Landing::react(Weather &weather)
+{
+	pimpl()->distance += 5 + weather.wind % 3;
+	if (pimpl()->distance % 8192 < 7)
+	{
+		changeState<Parked>();
+	}
+}
+
+class Aircraft : public pocket_fsm::FiniteStateMachine<AircraftStateIF>
+{
+public:
+	// The aircraft starts in a phase picked from its number
+	explicit Aircraft(unsigned number)
+	{
+		AircraftImpl *impl = new AircraftImpl();
+		impl->fuel = number;
+		impl->distance = number;
+		switch (number % 5)
+		{
+		case 0:
+			initialize(new Parked(impl));
+			break;
+		case 1:
+			initialize(new Taxiing(impl));
+			break;
+		case 2:
+			initialize(new Climbing(impl));
+			break;
+		case 3:
+			initialize(new Cruising(impl));
+			break;
+		default:
+			initialize(new Landing(impl));
+			break;
+		}
+	}
+
+	const AircraftImpl &impl() const
+	{
+		using Access = pocket_fsm::internal::FrameworkAccess;
+		return *static_cast<const AircraftImpl *>(Access::pimpl(*Access::currentState(*this)).get());
+	}
+};
+
+// The gates of the airport go through boarding within a single report, which can
+// allocate the closed state where the open one was
+class GateStateIF : public pocket_fsm::StateIF
+{
+	BASE_STATE(GateStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Weather) {};
+};
+
+class Closed : public GateStateIF
+{
+	CONCRETE_STATE(Closed)
+};
+
+class Maintenance : public GateStateIF
+{
+	CONCRETE_STATE(Maintenance)
+};
+
+class Boarding : public GateStateIF
+{
+	CONCRETE_STATE(Boarding)
+
+	REACT(OnEntry) override
+	{
+		changeState<Closed>();
+	}
+};
+
+class Open : public GateStateIF
+{
+	CONCRETE_STATE(Open)
+
+	REACT(Weather) override
+	{
+		changeState<Boarding>();
+	}
+};
+
+class Gate : public pocket_fsm::FiniteStateMachine<GateStateIF>
+{
+public:
+	explicit Gate(GateStateIF *initial)
+	{
+		initialize(initial);
+	}
+};
+
+// A gate closing is moved to the bucket of its new state, whatever the addresses of its states
+bool gatesRebucketed()
+{
+	Gate open(new Open());
+	Gate maintained(new Maintenance());
+	pocket_fsm::MachineGroup<Gate> gates;
+	gates.add(open);
+	gates.add(maintained);
+	Weather weather{ 0 };
+	gates.broadcast(weather); // Open, then Maintenance : the open gate closes
+	gates.broadcast(weather); // Maintenance, then Closed, which was bucketed last
+	return &gates[0] == &maintained && &gates[1] == &open && open.getCurrentStateId() == Closed::stateId();
+}
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+	const size_t count = argc > 1 ? size_t(std::strtoull(argv[1], nullptr, 10)) : 2000;
+	const size_t reports = argc > 2 ? size_t(std::strtoull(argv[2], nullptr, 10)) : 10000;
+
+	// Two identical fleets, with the phases shuffled along the fleet
+	std::vector<std::unique_ptr<Aircraft>> fleet;
+	std::vector<std::unique_ptr<Aircraft>> grouped;
+	pocket_fsm::MachineGroup<Aircraft> group;
+	unsigned seed = 7;
+	for (size_t i = 0; i < count; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		fleet.emplace_back(new Aircraft(seed >> 16));
+		grouped.emplace_back(new Aircraft(seed >> 16));
+		group.add(*grouped.back());
+	}
+
+	Clock::time_point start = Clock::now();
+	for (size_t r = 0; r < reports; ++r)
+	{
+		Weather weather{ unsigned(r * 2654435761u >> 7) };
+		for (std::unique_ptr<Aircraft> &aircraft : fleet)
+		{
+			aircraft->sendEvent(weather);
+		}
+	}
+	const double fleetMs = elapsedMs(start);
+
+	start = Clock::now();
+	for (size_t r = 0; r < reports; ++r)
+	{
+		Weather weather{ unsigned(r * 2654435761u >> 7) };
+		group.broadcast(weather);
+	}
+	const double groupMs = elapsedMs(start);
+
+	size_t transitions = 0;
+	bool same = true;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const AircraftImpl &expected = fleet[i]->impl();
+		const AircraftImpl &actual = grouped[i]->impl();
+		same = same && fleet[i]->getCurrentStateId() == grouped[i]->getCurrentStateId() &&
+			expected.fuel == actual.fuel && expected.distance == actual.distance && expected.phases == actual.phases;
+		transitions += expected.phases - 1;
+	}
+
+	printf("%zu machines, %zu reports : sendEvent %.1f ms, broadcast %.1f ms (%.1fx), %zu transitions\n",
+		count, reports, fleetMs, groupMs, fleetMs / groupMs, transitions);
+	if (!same)
+	{
+		printf("The grouped fleet differs from the fleet!\n");
+		return 1;
+	}
+	if (!gatesRebucketed())
+	{
+		printf("A gate was left in the bucket of its former state!\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,247 @@
+#include "pocket_fsm_replica.h"
+#include <cstdio>
+#include <sys/wait.h>
+
+// A fleet of turnstiles replicated to a hot standby process over a socket pair.
+// The primary streams snapshots and events, then goes away. The standby is promoted,
+// takes over the turnstiles, and reports their states back for comparison.
+
+struct Coin { int cents; };
+struct Push {};
+
+using TurnstileEvents = pocket_fsm::EventList<Coin, Push>;
+
+class TurnstileImpl : public pocket_fsm::PimplBase
+{
+public:
+	int64_t cents = 0;
+	int64_t passes = 0;
+};
+
+// Snapshots carry the pimpl, so that the standby starts from the takings of the primary
+namespace pocket_fsm
+{
+template<>
+struct PimplSerializer<TurnstileImpl>
+{
+	static void save(const TurnstileImpl &pimpl, SnapshotWriter &out)
+	{
+		out.write(pimpl.cents);
+		out.write(pimpl.passes);
+	}
+
+	static TurnstileImpl *load(SnapshotReader &in)
+	{
+		TurnstileImpl *pimpl = new TurnstileImpl();
+		in.read(pimpl->cents);
+		in.read(pimpl->passes);
+		return pimpl;
+	}
+};
+}
+
+class TurnstileStateIF : public pocket_fsm::StatePimplIF<TurnstileImpl>
+{
+	BASE_STATE(TurnstileStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Coin)
+	{
+		pimpl()->cents += e.cents;
+	}
+	REACT(Push) = 0;
+};
+
+class Locked : public TurnstileStateIF
+{
+	CONCRETE_STATE(Locked)
+	INITIAL_STATE(Locked)
+
+	REACT(Coin) override;
+	REACT(Push) override {};
+};
+
+class Unlocked : public TurnstileStateIF
+{
+	CONCRETE_STATE(Unlocked)
+	INITIAL_STATE(Unlocked)
+
+	REACT(Push) override
+	{
+		++pimpl()->passes;
+		changeState<Locked>();
+	}
+};
+
+void Locked::react(Coin &coin)
+{
+	TurnstileStateIF::react(coin);
+	changeState<Unlocked>();
+}
+
+using TurnstileStates = pocket_fsm::StateList<Locked, Unlocked>;
+
+class Turnstile : public pocket_fsm::JournaledStateMachine<TurnstileStateIF, TurnstileEvents>
+{
+public:
+	// The standby builds its turnstiles without a state : the snapshots provide it
+	explicit Turnstile(bool primary)
+	{
+		if (primary)
+		{
+			initialize(new Locked(new TurnstileImpl()));
+		}
+	}
+
+	const TurnstileImpl &impl() const
+	{
+		using Access = pocket_fsm::internal::FrameworkAccess;
+		return *static_cast<const TurnstileImpl *>(Access::pimpl(*Access::currentState(*this)).get());
+	}
+};
+
+// What each turnstile looks like, as reported by the promoted standby
+struct TurnstileReport
+{
+	pocket_fsm::StateId state;
+	int64_t cents;
+	int64_t passes;
+};
+
+constexpr size_t TURNSTILES = 8;
+constexpr int EVENTS = 100000;
+
+// The traffic of a turnstile at a given step, the same in both processes
+void traffic(Turnstile &turnstile, int step)
+{
+	if (step % 3 == 0)
+	{
+		Push push;
+		turnstile.sendEvent(push);
+	}
+	else
+	{
+		Coin coin{ 25 + step % 4 * 25 };
+		turnstile.sendEvent(coin);
+	}
+}
+
+// Traffic handled by whichever process is in charge after the failover
+void afterFailover(Turnstile *turnstiles[])
+{
+	for (int step = 0; step < 64; ++step)
+	{
+		traffic(*turnstiles[step % TURNSTILES], step);
+	}
+}
+
+int standby(int socket, int report)
+{
+	Turnstile *turnstiles[TURNSTILES];
+	for (Turnstile *&turnstile : turnstiles)
+	{
+		turnstile = new Turnstile(false);
+	}
+
+	// Apply the stream until the primary goes away
+	pocket_fsm::ReplicaApplier<TurnstileEvents, TurnstileStates> applier(socket);
+	const pocket_fsm::ReplicaStats stats = applier.run([&](uint64_t id) { return id < TURNSTILES ? turnstiles[id] : nullptr; });
+	printf("Standby applied %llu events and %llu snapshots, %llu mismatches\n",
+		(unsigned long long)stats.events, (unsigned long long)stats.snapshots, (unsigned long long)stats.mismatches);
+	if (stats.corrupted || stats.mismatches != 0 || stats.snapshots != TURNSTILES)
+	{
+		return 1;
+	}
+
+	// Promotion : the standby turnstiles are up to date and take the traffic right away
+	afterFailover(turnstiles);
+
+	TurnstileReport reports[TURNSTILES];
+	for (size_t i = 0; i < TURNSTILES; ++i)
+	{
+		reports[i] = { turnstiles[i]->getCurrentStateId(), turnstiles[i]->impl().cents, turnstiles[i]->impl().passes };
+		delete turnstiles[i];
+	}
+	return ::write(report, reports, sizeof(reports)) == ssize_t(sizeof(reports)) ? 0 : 1;
+}
+
+int main(void)
+{
+	int sockets[2];
+	int reports[2];
+	if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0 || ::pipe(reports) != 0)
+	{
+		return 1;
+	}
+
+	const pid_t pid = ::fork();
+	if (pid == 0)
+	{
+		::close(sockets[0]);
+		::close(reports[0]);
+		const int code = standby(sockets[1], reports[1]);
+		fflush(stdout);
+		_exit(code);
+	}
+	::close(sockets[1]);
+	::close(reports[1]);
+
+	Turnstile *turnstiles[TURNSTILES];
+	for (Turnstile *&turnstile : turnstiles)
+	{
+		turnstile = new Turnstile(true);
+	}
+	// Traffic before the standby connects is carried by the snapshots
+	Coin coin{ 100 };
+	turnstiles[3]->sendEvent(coin);
+
+	pocket_fsm::ReplicationPrimary *primary = new pocket_fsm::ReplicationPrimary(sockets[0]);
+	for (size_t i = 0; i < TURNSTILES; ++i)
+	{
+		primary->sendSnapshot(*turnstiles[i], i);
+		turnstiles[i]->attachJournal(primary, i);
+	}
+	for (int step = 0; step < EVENTS; ++step)
+	{
+		traffic(*turnstiles[step % TURNSTILES], step);
+	}
+	const bool acknowledged = primary->waitAck();
+
+	// Failover : the primary goes away
+	for (Turnstile *turnstile : turnstiles)
+	{
+		turnstile->attachJournal(nullptr);
+	}
+	delete primary;
+
+	// The standby should now be where the primary would be after the same traffic
+	afterFailover(turnstiles);
+	TurnstileReport received[TURNSTILES];
+	size_t size = 0;
+	ssize_t n = 0;
+	while (size < sizeof(received) && (n = ::read(reports[0], reinterpret_cast<uint8_t *>(received) + size, sizeof(received) - size)) > 0)
+	{
+		size += size_t(n);
+	}
+	int status = 0;
+	::waitpid(pid, &status, 0);
+
+	bool same = acknowledged && size == sizeof(received) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	for (size_t i = 0; same && i < TURNSTILES; ++i)
+	{
+		same = received[i].state == turnstiles[i]->getCurrentStateId() &&
+			received[i].cents == turnstiles[i]->impl().cents &&
+			received[i].passes == turnstiles[i]->impl().passes;
+	}
+	printf(same ? "The promoted standby matches the primary\n" : "The promoted standby differs from the primary!\n");
+
+	for (Turnstile *turnstile : turnstiles)
+	{
+		delete turnstile;
+	}
+	::close(sockets[0]);
+	::close(reports[0]);
+	return same ? 0 : 1;
+}
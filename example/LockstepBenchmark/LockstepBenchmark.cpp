@@ -0,0 +1,159 @@
+#include "pocket_fsm_lockstep.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// The moods of a crowd hearing the same remarks : LockstepMachines stepping every
+// machine of the crowd at once, against a scalar loop through the same table.
+// Usage : LockstepBenchmark [machines] [remarks]
+
+class MoodStateIF : public pocket_fsm::StateIF
+{
+	BASE_STATE(MoodStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+};
+
+class Neutral : public MoodStateIF
+{
+	CONCRETE_STATE(Neutral)
+};
+
+class Happy : public MoodStateIF
+{
+	CONCRETE_STATE(Happy)
+};
+
+class Annoyed : public MoodStateIF
+{
+	CONCRETE_STATE(Annoyed)
+};
+
+class InLove : public MoodStateIF
+{
+	CONCRETE_STATE(InLove)
+};
+
+using MoodStates = pocket_fsm::StateList<Neutral, Happy, Annoyed, InLove>;
+
+// The symbols of the remarks
+enum : size_t { COMPLIMENT, JOKE, INSULT, SYMBOLS };
+
+using MoodTable = pocket_fsm::TransitionTable<MoodStates, SYMBOLS>;
+using Crowd = pocket_fsm::LockstepMachines<MoodStates, SYMBOLS>;
+
+// Jokes are lost on most of the crowd, and only the lovers react to them
+constexpr MoodTable makeTable()
+{
+	MoodTable table;
+	table.jump<Neutral, Happy>(COMPLIMENT).ignore<Neutral>(JOKE).jump<Neutral, Annoyed>(INSULT);
+	table.jump<Happy, InLove>(COMPLIMENT).ignore<Happy>(JOKE).jump<Happy, Neutral>(INSULT);
+	table.jump<Annoyed, Neutral>(COMPLIMENT).ignore<Annoyed>(JOKE).ignore<Annoyed>(INSULT);
+	table.ignore<InLove>(COMPLIMENT).react<InLove>(JOKE).jump<InLove, Annoyed>(INSULT);
+	return table;
+}
+
+constexpr MoodTable moodTable = makeTable();
+
+const char *vectorPath()
+{
+#if defined(__AVX2__)
+	return "AVX2";
+#elif defined(__SSSE3__)
+	return "SSSE3";
+#else
+	return "scalar";
+#endif
+}
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+	const size_t count = argc > 1 ? size_t(std::strtoull(argv[1], nullptr, 10)) : 300000;
+	const size_t remarkCount = argc > 2 ? size_t(std::strtoull(argv[2], nullptr, 10)) : 1000;
+
+	// Mostly jokes, with the odd compliment or insult
+	std::vector<size_t> remarks(remarkCount);
+	unsigned seed = 1;
+	for (size_t &remark : remarks)
+	{
+		seed = seed * 1103515245 + 12345;
+		const unsigned draw = (seed >> 16) % 10;
+		remark = draw < 7 ? JOKE : draw < 9 ? COMPLIMENT : INSULT;
+	}
+
+	// Both crowds start with the same mix of moods
+	Crowd crowd(moodTable, count, Neutral::stateId());
+	std::vector<uint8_t> reference(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		crowd.setState(i, MoodStates::idAt(i * 7919 % MoodStates::size));
+		reference[i] = uint8_t(i * 7919 % MoodStates::size);
+	}
+
+	// Lovers hearing a joke stay in love, and count it
+	std::vector<unsigned> crowdLaughs(count);
+	Clock::time_point start = Clock::now();
+	size_t crowdChanges = 0;
+	for (size_t remark : remarks)
+	{
+		crowdChanges += crowd.step(remark, [&crowdLaughs](size_t machine, uint8_t, uint8_t to) -> uint8_t
+		{
+			if (to == MoodTable::REACT)
+			{
+				++crowdLaughs[machine];
+				return Crowd::indexOf<InLove>();
+			}
+			return to;
+		});
+	}
+	const double crowdMs = elapsedMs(start);
+
+	std::vector<unsigned> referenceLaughs(count);
+	start = Clock::now();
+	size_t referenceChanges = 0;
+	for (size_t remark : remarks)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			const uint8_t to = moodTable.next(reference[i], remark);
+			if (to == reference[i])
+			{
+				continue;
+			}
+			if (to == MoodTable::REACT)
+			{
+				++referenceLaughs[i];
+			}
+			else
+			{
+				reference[i] = to;
+			}
+			++referenceChanges;
+		}
+	}
+	const double referenceMs = elapsedMs(start);
+
+	printf("%zu machines, %zu remarks : lockstep (%s) %.1f ms, scalar loop %.1f ms (%.1fx), %zu changes\n",
+		count, remarkCount, vectorPath(), crowdMs, referenceMs, referenceMs / crowdMs, crowdChanges);
+
+	bool same = crowdChanges == referenceChanges;
+	for (size_t i = 0; same && i < count; ++i)
+	{
+		same = crowd.states()[i] == reference[i] && crowdLaughs[i] == referenceLaughs[i];
+	}
+	if (!same)
+	{
+		printf("The lockstep crowd differs from the scalar loop!\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,159 @@
+#include "pocket_fsm_mapped.h"
+#include <cstdio>
+#include <cstdlib>
+#include <sys/wait.h>
+
+// A bank of lockers kept in a memory mapped file. A first process rents lockers and
+// crashes without closing anything : the next one maps the file and resumes every
+// locker where it stood, without calling entry again.
+
+struct Rent { uint32_t code; };
+struct Open { uint32_t code; };
+
+// Everything persisted about a locker
+struct LockerData
+{
+	uint32_t code;
+	uint32_t rentals;
+};
+
+constexpr uint32_t LAYOUT_VERSION = 1;
+constexpr size_t LOCKERS = 5000;
+
+class LockerImpl : public pocket_fsm::MappedPimpl<LockerData>
+{
+public:
+	bool opens(uint32_t code)
+	{
+		return data().code == code;
+	}
+};
+
+class LockerStateIF : public pocket_fsm::StatePimplIF<LockerImpl>
+{
+	BASE_STATE(LockerStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Rent) {};
+	REACT(Open) {};
+};
+
+class Free : public LockerStateIF
+{
+	CONCRETE_STATE(Free)
+
+	REACT(OnEntry) override
+	{
+		++entries;
+	}
+
+	REACT(Rent) override;
+
+public:
+	static unsigned entries; // Counts the lockers set up from scratch or freed
+};
+
+unsigned Free::entries = 0;
+
+class Taken : public LockerStateIF
+{
+	CONCRETE_STATE(Taken)
+
+	REACT(Open) override
+	{
+		if (pimpl()->opens(e.code))
+		{
+			changeState<Free>();
+		}
+	}
+};
+
+void Free::react(Rent &rent)
+{
+	pimpl()->data().code = rent.code;
+	++pimpl()->data().rentals;
+	changeState<Taken>();
+}
+
+using LockerStates = pocket_fsm::StateList<Free, Taken>;
+
+class Locker : public pocket_fsm::MappedStateMachine<LockerStateIF, LockerStates>
+{
+public:
+	explicit Locker(pocket_fsm::MappedRecord<LockerData> &record)
+	{
+		attach<Free>(record);
+	}
+};
+
+using LockerBank = pocket_fsm::MappedMachines<Locker, LockerData>;
+
+// Every third locker is rented, and every sixth one is returned
+void business(LockerBank &bank)
+{
+	for (size_t i = 0; i < LOCKERS; i += 3)
+	{
+		Rent rent{ uint32_t(1000 + i) };
+		bank[i].sendEvent(rent);
+	}
+	for (size_t i = 0; i < LOCKERS; i += 6)
+	{
+		Open open{ uint32_t(1000 + i) };
+		bank[i].sendEvent(open);
+	}
+}
+
+int main(void)
+{
+	char path[] = "/tmp/MappedLockersXXXXXX";
+	const int fd = ::mkstemp(path);
+	if (fd < 0)
+	{
+		return 1;
+	}
+	::close(fd);
+
+	const pid_t pid = ::fork();
+	if (pid == 0)
+	{
+		LockerBank bank;
+		if (!bank.open(path, LOCKERS, LAYOUT_VERSION))
+		{
+			_exit(1);
+		}
+		business(bank);
+		// Crash : no checkpoint and no close, the kernel still holds the pages
+		_exit(0);
+	}
+	int status = 0;
+	::waitpid(pid, &status, 0);
+
+	LockerBank bank;
+	bool same = WIFEXITED(status) && WEXITSTATUS(status) == 0 && bank.open(path, LOCKERS, LAYOUT_VERSION);
+	size_t taken = 0;
+	for (size_t i = 0; same && i < LOCKERS; ++i)
+	{
+		const bool rented = i % 3 == 0 && i % 6 != 0;
+		taken += rented ? 1 : 0;
+		same = bank[i].getCurrentStateId() == (rented ? Taken::stateId() : Free::stateId()) &&
+			bank.record(i).data.rentals == (i % 3 == 0 ? 1u : 0u);
+	}
+	// Only the lockers never touched before the crash were set up from scratch
+	same = same && Free::entries == LOCKERS - (LOCKERS + 2) / 3;
+
+	// A locker rented before the crash opens with its code
+	Open open{ 1003 };
+	bank[3].sendEvent(open);
+	same = same && bank[3].getCurrentStateId() == Free::stateId() && bank.checkpoint();
+	bank.close();
+
+	// A program built for another layout of the data cannot map the file
+	LockerBank other;
+	same = same && !other.open(path, LOCKERS, LAYOUT_VERSION + 1);
+	::unlink(path);
+
+	printf(same ? "%zu lockers resumed taken after the crash\n" : "The lockers did not resume after the crash!\n", taken);
+	return same ? 0 : 1;
+}
@@ -0,0 +1,116 @@
+#include "pocket_fsm_queue.h"
+#include <cstdio>
+#include <thread>
+
+// A motor controller fed by a sensor thread faster than it keeps up with. Its small
+// queue keeps the latest readings only, and an emergency stop posted behind them is
+// still delivered first.
+
+// A reading always carries a value : the events need no default constructor
+struct Telemetry
+{
+	explicit Telemetry(int rpm)
+		: rpm(rpm)
+	{}
+
+	int rpm;
+};
+struct EmergencyStop {};
+
+using MotorEvents = pocket_fsm::EventList<Telemetry, EmergencyStop>;
+
+class MotorImpl : public pocket_fsm::PimplBase
+{
+public:
+	int lastRpm = -1;         // Latest reading handled while running
+	unsigned afterStop = 0;   // Readings delivered once stopped
+	int latestAfterStop = -1; // Latest of them
+};
+
+class MotorStateIF : public pocket_fsm::StatePimplIF<MotorImpl>
+{
+	BASE_STATE(MotorStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Telemetry) = 0;
+	REACT(EmergencyStop) {};
+};
+
+class Running : public MotorStateIF
+{
+	CONCRETE_STATE(Running)
+	INITIAL_STATE(Running)
+
+	REACT(Telemetry) override
+	{
+		pimpl()->lastRpm = e.rpm;
+	}
+
+	REACT(EmergencyStop) override;
+};
+
+class Stopped : public MotorStateIF
+{
+	CONCRETE_STATE(Stopped)
+
+	REACT(Telemetry) override
+	{
+		++pimpl()->afterStop;
+		pimpl()->latestAfterStop = e.rpm;
+	}
+};
+
+void Running::react(EmergencyStop &)
+{
+	changeState<Stopped>();
+}
+
+class Motor : public pocket_fsm::FiniteStateMachine<MotorStateIF>
+{
+public:
+	Motor()
+	{
+		initialize(new Running(new MotorImpl()));
+	}
+
+	const MotorImpl &impl() const
+	{
+		using Access = pocket_fsm::internal::FrameworkAccess;
+		return *static_cast<const MotorImpl *>(Access::pimpl(*Access::currentState(*this)).get());
+	}
+};
+
+using MotorQueue = pocket_fsm::EventQueue<Motor, MotorEvents>;
+
+constexpr size_t CAPACITY = 4;
+constexpr int READINGS = 100;
+
+int main(void)
+{
+	Motor motor;
+	MotorQueue queue(motor, CAPACITY, pocket_fsm::ShedPolicy::DropOldest);
+	queue.setPriority<EmergencyStop>(1);
+
+	// The controller is busy elsewhere while the sensor reports, then trips the stop
+	std::thread sensor([&queue]()
+	{
+		for (int rpm = 1; rpm <= READINGS; ++rpm)
+		{
+			queue.post(Telemetry{ rpm });
+		}
+	});
+	sensor.join();
+	const bool posted = queue.post(EmergencyStop());
+
+	const size_t delivered = queue.run();
+	const pocket_fsm::QueueStats stats = queue.stats();
+	printf("%llu posted, %llu dropped, %zu delivered. The motor is %s, with %u readings after the stop\n",
+		(unsigned long long)stats.posted, (unsigned long long)stats.dropped, delivered, motor.getCurrentStateName(), motor.impl().afterStop);
+
+	// The stop overtook the readings still queued, which were the latest ones
+	return posted && motor.getCurrentStateId() == Stopped::stateId() && motor.impl().lastRpm == -1 &&
+		motor.impl().afterStop == CAPACITY - 1 && motor.impl().latestAfterStop == READINGS &&
+		stats.dropped == READINGS - (CAPACITY - 1) && stats.depth == 0 ? 0 : 1;
+}
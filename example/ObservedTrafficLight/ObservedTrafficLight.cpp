@@ -0,0 +1,151 @@
+#include "pocket_fsm_observe.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// A traffic light driven as fast as possible by its controller thread, watched by
+// monitoring threads that never take its lock. Every observation they make needs to
+// be consistent : the light, its name and the tick count all from the same moment.
+
+struct Tick {};
+
+class LightImpl : public pocket_fsm::PimplBase
+{
+public:
+	uint64_t ticks = 0;
+	uint64_t cycles = 0;
+};
+
+// The part of the pimpl published to the monitors
+struct LightSummary
+{
+	uint64_t ticks;
+	uint64_t cycles;
+};
+
+namespace pocket_fsm
+{
+template<>
+struct PimplSummary<LightImpl>
+{
+	using Summary = LightSummary;
+
+	static Summary summarize(const LightImpl &pimpl)
+	{
+		return { pimpl.ticks, pimpl.cycles };
+	}
+};
+}
+
+class LightStateIF : public pocket_fsm::StatePimplIF<LightImpl>
+{
+	BASE_STATE(LightStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Tick) = 0;
+};
+
+class Green : public LightStateIF
+{
+	CONCRETE_STATE(Green)
+	INITIAL_STATE(Green)
+
+	REACT(Tick) override;
+};
+
+class Yellow : public LightStateIF
+{
+	CONCRETE_STATE(Yellow)
+
+	REACT(Tick) override;
+};
+
+class Red : public LightStateIF
+{
+	CONCRETE_STATE(Red)
+
+	REACT(Tick) override
+	{
+		++pimpl()->ticks;
+		++pimpl()->cycles;
+		changeState<Green>();
+	}
+};
+
+void Green::react(Tick &)
+{
+	++pimpl()->ticks;
+	changeState<Yellow>();
+}
+
+void Yellow::react(Tick &)
+{
+	++pimpl()->ticks;
+	changeState<Red>();
+}
+
+class TrafficLight : public pocket_fsm::ObservableStateMachine<LightStateIF>
+{
+public:
+	TrafficLight()
+	{
+		initialize(new Green(new LightImpl()));
+	}
+};
+
+constexpr uint64_t TICKS = 300000;
+
+// Whether an observation could have been taken between two events
+bool consistent(const TrafficLight::Observation &observation)
+{
+	const uint64_t ticks = observation.summary.ticks;
+	const pocket_fsm::StateId expected[] = { Green::stateId(), Yellow::stateId(), Red::stateId() };
+	const char *names[] = { "Green", "Yellow", "Red" };
+	return observation.id == expected[ticks % 3] && std::strcmp(observation.name, names[ticks % 3]) == 0 &&
+		observation.summary.cycles == ticks / 3 && observation.version == ticks + 1;
+}
+
+int main(void)
+{
+	TrafficLight light;
+	std::atomic<bool> running(true);
+	std::atomic<uint64_t> observations(0);
+	std::atomic<uint64_t> inconsistent(0);
+
+	std::vector<std::thread> monitors;
+	for (int m = 0; m < 2; ++m)
+	{
+		monitors.emplace_back([&]()
+		{
+			uint64_t lastVersion = 0;
+			while (running)
+			{
+				const TrafficLight::Observation observation = light.observe();
+				if (!consistent(observation) || observation.version < lastVersion)
+				{
+					++inconsistent;
+				}
+				lastVersion = observation.version;
+				++observations;
+			}
+		});
+	}
+
+	for (uint64_t i = 0; i < TICKS; ++i)
+	{
+		Tick tick;
+		light.sendEvent(tick);
+	}
+	running = false;
+	for (std::thread &monitor : monitors)
+	{
+		monitor.join();
+	}
+
+	const TrafficLight::Observation last = light.observe();
+	printf("%llu observations while ticking, %llu inconsistent. The light is %s after %llu cycles\n",
+		(unsigned long long)observations.load(), (unsigned long long)inconsistent.load(), last.name, (unsigned long long)last.summary.cycles);
+	return inconsistent == 0 && last.summary.ticks == TICKS && consistent(last) ? 0 : 1;
+}
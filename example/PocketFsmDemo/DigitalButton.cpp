@@ -36,6 +36,13 @@ public:
 	const std::string _name;
 };
 
+// Step #5.2 (optional): Opt in to deep copies of the pimpl, so that copies of the state machine are independent
+namespace pocket_fsm
+{
+template<>
+struct IsCopyablePimpl<ButtonImpl> : std::true_type { };
+}
+
 // Step #6: Forward declare all your concrete states first, then for each concrete state:
 //  - Declare and use CONCRETE_STATE macro to set up constructor with stringified name
 //  - The Initial State needs the macro of the same name for the initial construction.
@@ -103,7 +110,7 @@ class BtnPress : public ButtonStateIF
 
 // The base state's final functions will need a definition here
 // The REACT macro won't work here unfortunately
-void ButtonStateIF::react(GetKeyCode &e)
+void ButtonStateIF::react(GetKeyCode &e) const
 {
 	e.keycode = pimpl()->_downKey;
 }
@@ -127,6 +134,17 @@ DigitalButton::DigitalButton(const char *name)
 	initialize(new NoPress(new ButtonImpl(name)));
 }
 
+DigitalButton::DigitalButton(const DigitalButton &copy)
+	: FiniteStateMachine()
+{
+	cloneFrom(copy);
+}
+
+DigitalButton::DigitalButton(DigitalButton &&other) noexcept
+	: FiniteStateMachine(std::move(other))
+{
+}
+
 void DigitalButton::lock()
 {
 	// Spin to win
@@ -136,4 +154,15 @@ void DigitalButton::lock()
 void DigitalButton::unlock()
 {
 	_dumbSpinlock.unlock();
+}
+
+void DigitalButton::lockShared()
+{
+	// Queries only wait for writers
+	while (!_dumbSpinlock.try_lock_shared());
+}
+
+void DigitalButton::unlockShared()
+{
+	_dumbSpinlock.unlock_shared();
 }
\ No newline at end of file
@@ -38,7 +38,10 @@ class ButtonStateIF : public pocket_fsm::StatePimplIF<ButtonImpl>
 
 	// Step #3.4: Declare a react function for each event in Step 2. Use macro to ensure consistent signature.
 	// Implement default behaviour, leave undefined or mark final.
-	REACT(PressEvent) {};
+	// Events most states ignore are listed, then declared with IGNORE_REACT : the states not overriding
+	// them are known at compile time, and skip them without locking.
+	using IgnoredEvents = pocket_fsm::EventList<PressEvent>;
+	IGNORE_REACT(PressEvent);
 	REACT(ReleaseEvent) 
 	{ 
 		e.result = false; 
@@ -46,7 +49,8 @@ class ButtonStateIF : public pocket_fsm::StatePimplIF<ButtonImpl>
 
 	// You can make sure all event have the same reaction by making the react function final
 	REACT(ResetEvt) final;
-	REACT(GetKeyCode) final;
+	// Getters only read the pimpl : declare them as queries so that they run under a shared lock
+	QUERY_REACT(GetKeyCode) final;
 	
 	// Pure virtual ensures concrete classes have to define this function and use the enum
 	virtual E_ButtonState getState() const = 0;
@@ -58,7 +62,11 @@ class DigitalButton : public pocket_fsm::FiniteStateMachine<ButtonStateIF>
 public:
 	// Add parameters required to instantiate your pimpl
 	DigitalButton(const char *name);
-	DigitalButton(const DigitalButton &copy) : FiniteStateMachine(copy){};
+	// Copies get their own state and pimpl instead of sharing them with the original
+	DigitalButton(const DigitalButton &copy);
+	// Moves take over the state and pimpl without exit or entry, so that containers can grow cheaply.
+	// The lock is not moved : each button has its own.
+	DigitalButton(DigitalButton &&other) noexcept;
 
 	// Getter for custom state identifier. This is arguably better than the stringified name of the class.
 	inline E_ButtonState getState()
@@ -74,5 +82,10 @@ protected:
 	void lock() override;
 
 	void unlock() override;
+
+	// Step #4.3: Optionally override lockShared/unlockShared() to let query events run concurrently.
+	void lockShared() override;
+
+	void unlockShared() override;
 };
 
@@ -11,6 +11,22 @@ ResetEvt reset;
 
 using pocket_fsm::internal::ASSERT;
 
+// Counts the locks taken, to tell the ignored events apart
+class CountingButton : public DigitalButton
+{
+public:
+	using DigitalButton::DigitalButton;
+
+	unsigned locks = 0;
+
+protected:
+	void lock() override
+	{
+		++locks;
+		DigitalButton::lock();
+	}
+};
+
 int main(void)
 {
 	std::vector<DigitalButton> buttons;
@@ -51,5 +67,16 @@ int main(void)
 	ASSERT(buttonA.getState() == E_ButtonState::NoPress, L"Button did not transition state");
 	ASSERT(gkc.keycode == UINT16_MAX, L"Button did not clear the keycode");
 
+	// Only NoPress overrides the react to PressEvent : BtnPress ignores it before it ever sees one
+	CountingButton counted("Counted button");
+	ASSERT(counted.accepts<PressEvent>() && counted.accepts<ReleaseEvent>(), L"NoPress does not accept a press");
+	counted.sendEvent(press);
+	ASSERT(!counted.accepts<PressEvent>() && counted.accepts<ReleaseEvent>(), L"BtnPress accepts a press");
+	const unsigned locks = counted.locks;
+	counted.sendEvent(press);
+	ASSERT(counted.locks == locks && counted.getState() == E_ButtonState::BtnPress, L"An ignored press was dispatched");
+	counted.sendEvent(release);
+	ASSERT(counted.locks == locks + 1 && counted.accepts<PressEvent>(), L"The release was not dispatched");
+
 	return 0;
 }
@@ -0,0 +1,165 @@
+#include "pocket_fsm_footprint.h"
+#include <cstdlib>
+#include <new>
+
+// A battery powered sensor node with a few kilobytes of heap. Its state machine comes
+// with a memory budget checked at build time, and the allocations made while it runs
+// are counted to show that the computed footprint holds.
+
+// Every allocation of the program goes through here
+static size_t allocated = 0;
+
+void *operator new(size_t size)
+{
+	allocated += size;
+	void *p = std::malloc(size ? size : 1);
+	if (!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	std::free(p);
+}
+
+struct Tick {};
+struct Sample { uint16_t value; };
+struct Ack {};
+
+class NodeImpl : public pocket_fsm::PimplBase
+{
+public:
+	uint32_t sent = 0;
+	uint32_t samples = 0;
+};
+
+class NodeStateIF : public pocket_fsm::StatePimplIF<NodeImpl>
+{
+	BASE_STATE(NodeStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Tick) {};
+	REACT(Sample) {};
+	REACT(Ack) {};
+};
+
+class Sleeping : public NodeStateIF
+{
+	CONCRETE_STATE(Sleeping)
+	INITIAL_STATE(Sleeping)
+
+	REACT(Tick) override;
+};
+
+class Sampling : public NodeStateIF
+{
+	CONCRETE_STATE(Sampling)
+
+	REACT(Sample) override;
+
+	uint16_t _readings[8];
+	uint8_t _count = 0;
+};
+
+// The packet being sent is the largest state, and bounds every transition
+class Transmitting : public NodeStateIF
+{
+	CONCRETE_STATE(Transmitting)
+
+	REACT(OnEntry) override
+	{
+		++pimpl()->sent;
+	}
+
+	REACT(Ack) override
+	{
+		changeState<Sleeping>();
+	}
+
+	uint8_t _packet[64];
+};
+
+void Sleeping::react(Tick &)
+{
+	changeState<Sampling>();
+}
+
+void Sampling::react(Sample &sample)
+{
+	++pimpl()->samples;
+	_readings[_count++] = sample.value;
+	if (_count == sizeof(_readings) / sizeof(_readings[0]))
+	{
+		changeState<Transmitting>();
+	}
+}
+
+class SensorNode : public pocket_fsm::FiniteStateMachine<NodeStateIF>
+{
+public:
+	SensorNode()
+	{
+		_impl = new NodeImpl();
+		initialize(new Sleeping(_impl));
+	}
+
+	const NodeImpl &impl() const
+	{
+		return *_impl;
+	}
+
+private:
+	NodeImpl *_impl; // Owned by the states
+};
+
+using NodeFootprint = pocket_fsm::Footprint<SensorNode, pocket_fsm::StateList<Sleeping, Sampling, Transmitting>>;
+
+// The node may keep 512 bytes allocated, and a transition may take 256 of them. A
+// state growing past that, say a bigger packet, fails the build here.
+static_assert(pocket_fsm::FootprintBudget<NodeFootprint, 512, 256>::value, "");
+
+constexpr int CYCLES = 100;
+
+int main(void)
+{
+	NodeFootprint::report();
+
+	const size_t before = allocated;
+	SensorNode node;
+	const size_t startup = allocated - before;
+
+	// The bytes allocated by the event that allocated the most
+	size_t largestEvent = 0;
+	auto send = [&node, &largestEvent](auto event)
+	{
+		const size_t before = allocated;
+		node.sendEvent(event);
+		largestEvent = allocated - before > largestEvent ? allocated - before : largestEvent;
+	};
+	for (int cycle = 0; cycle < CYCLES; ++cycle)
+	{
+		send(Tick());
+		for (uint16_t i = 0; i < 8; ++i)
+		{
+			send(Sample{ i });
+		}
+		send(Ack());
+	}
+
+	// The packet going out is the costliest transition, and no event went past it
+	printf("%zu bytes allocated at startup, at most %zu per event. The node is %s after sending %u packets\n",
+		startup, largestEvent, node.getCurrentStateName(), node.impl().sent);
+	return startup <= NodeFootprint::resident - NodeFootprint::machineSize && largestEvent == NodeFootprint::perTransition &&
+		node.getCurrentStateId() == Sleeping::stateId() && node.impl().sent == CYCLES &&
+		node.impl().samples == 8 * CYCLES ? 0 : 1;
+}
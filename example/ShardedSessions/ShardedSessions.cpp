@@ -0,0 +1,165 @@
+#include "pocket_fsm_router.h"
+#include <chrono>
+#include <cstdio>
+
+// User sessions spread across the shards of a router. Two front end threads each
+// serve their own users, then tally the sessions they served by visiting them.
+
+struct Login {};
+struct Logout {};
+struct Click {};
+
+using SessionEvents = pocket_fsm::EventList<Login, Logout, Click>;
+
+class SessionImpl : public pocket_fsm::PimplBase
+{
+public:
+	unsigned logins = 0;
+	unsigned clicks = 0;
+};
+
+class SessionStateIF : public pocket_fsm::StatePimplIF<SessionImpl>
+{
+	BASE_STATE(SessionStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Login) {};
+	REACT(Logout) {};
+	REACT(Click) {};
+};
+
+class LoggedOut : public SessionStateIF
+{
+	CONCRETE_STATE(LoggedOut)
+	INITIAL_STATE(LoggedOut)
+
+	REACT(Login) override;
+};
+
+class LoggedIn : public SessionStateIF
+{
+	CONCRETE_STATE(LoggedIn)
+
+	REACT(Logout) override
+	{
+		changeState<LoggedOut>();
+	}
+
+	REACT(Click) override
+	{
+		++pimpl()->clicks;
+	}
+};
+
+void LoggedOut::react(Login &)
+{
+	++pimpl()->logins;
+	changeState<LoggedIn>();
+}
+
+// No lock needed : a session is only ever used by the worker of its shard
+class Session : public pocket_fsm::FiniteStateMachine<SessionStateIF>
+{
+public:
+	Session()
+	{
+		initialize(new LoggedOut(new SessionImpl()));
+	}
+
+	const SessionImpl &impl() const
+	{
+		using Access = pocket_fsm::internal::FrameworkAccess;
+		return *static_cast<const SessionImpl *>(Access::pimpl(*Access::currentState(*this)).get());
+	}
+};
+
+using Router = pocket_fsm::ShardedRouter<Session, SessionEvents>;
+
+constexpr uint64_t USERS = 1000;   // Per front end
+constexpr unsigned VISITS = 50;    // Per user
+constexpr unsigned FRONT_ENDS = 2;
+
+// Tallied by the workers while visiting the sessions
+std::atomic<uint64_t> tallied(0);
+std::atomic<uint64_t> logins(0);
+std::atomic<uint64_t> clicks(0);
+std::atomic<uint64_t> loggedIn(0);
+
+void frontEnd(Router::Producer producer, uint64_t firstUser)
+{
+	for (uint64_t user = firstUser; user < firstUser + USERS; ++user)
+	{
+		producer.create(user);
+	}
+	// Each visit logs in, clicks around and logs out, except the last one
+	for (unsigned visit = 0; visit < VISITS; ++visit)
+	{
+		for (uint64_t user = firstUser; user < firstUser + USERS; ++user)
+		{
+			producer.send(user, Login());
+			producer.send(user, Click());
+			producer.send(user, Click());
+			if (visit + 1 < VISITS)
+			{
+				producer.send(user, Logout());
+			}
+		}
+	}
+	// Clicks from a user without a session are dropped
+	producer.send(firstUser + USERS * FRONT_ENDS, Click());
+
+	// Commands from this producer are processed in order : the visits see all the traffic above
+	for (uint64_t user = firstUser; user < firstUser + USERS; ++user)
+	{
+		producer.visit(user, [](Session *session)
+		{
+			if (session)
+			{
+				logins += session->impl().logins;
+				clicks += session->impl().clicks;
+				loggedIn += session->getCurrentStateId() == LoggedIn::stateId() ? 1 : 0;
+			}
+			++tallied;
+		});
+	}
+}
+
+int main(void)
+{
+	Router router([](const uint64_t &) { return std::unique_ptr<Session>(new Session()); }, 4, FRONT_ENDS);
+
+	std::vector<std::thread> frontEnds;
+	for (unsigned f = 0; f < FRONT_ENDS; ++f)
+	{
+		frontEnds.emplace_back(frontEnd, *router.makeProducer(), f * USERS);
+	}
+	// Every producer was handed out
+	const bool refused = !router.makeProducer();
+	for (std::thread &thread : frontEnds)
+	{
+		thread.join();
+	}
+
+	for (int i = 0; i < 1000 && tallied < USERS * FRONT_ENDS; ++i)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+
+	uint64_t dropped = 0;
+	size_t sessions = 0;
+	for (size_t s = 0; s < router.shardCount(); ++s)
+	{
+		const pocket_fsm::ShardStats stats = router.stats(s);
+		printf("Shard %zu : %zu sessions, %llu commands\n", s, stats.machines, (unsigned long long)stats.processed);
+		dropped += stats.dropped;
+		sessions += stats.machines;
+	}
+	printf("%llu logins, %llu clicks, %llu users logged in, %llu clicks dropped\n", (unsigned long long)logins.load(),
+		(unsigned long long)clicks.load(), (unsigned long long)loggedIn.load(), (unsigned long long)dropped);
+
+	const uint64_t users = USERS * FRONT_ENDS;
+	return refused && sessions == users && logins == users * VISITS && clicks == users * VISITS * 2 &&
+		loggedIn == users && dropped == FRONT_ENDS ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+#include "pocket_fsm_shm.h"
+#include <chrono>
+#include <cstdio>
+#include <sys/wait.h>
+#include <thread>
+
+// A plant controller owning a row of pumps, and a separate operator process. The
+// operator reads the pumps from shared memory without any system call, and drives
+// them by submitting events that the controller pumps into its machines. A second
+// controller cannot take over the table while it is being created.
+
+struct Start { uint32_t rpm; };
+struct Stop {};
+
+using PumpEvents = pocket_fsm::EventList<Start, Stop>;
+
+// What the operator sees of a pump
+struct PumpStatus
+{
+	uint32_t rpm;
+	uint32_t starts;
+};
+
+constexpr uint32_t LAYOUT_VERSION = 1;
+constexpr size_t PUMPS = 16;
+
+using PumpTable = pocket_fsm::SharedStateTable<PumpEvents, PumpStatus>;
+
+class PumpImpl : public pocket_fsm::PimplBase
+{
+public:
+	PumpStatus status = {};
+};
+
+class PumpStateIF : public pocket_fsm::StatePimplIF<PumpImpl>
+{
+	BASE_STATE(PumpStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Start) {};
+	REACT(Stop) {};
+};
+
+class Stopped : public PumpStateIF
+{
+	CONCRETE_STATE(Stopped)
+	INITIAL_STATE(Stopped)
+
+	REACT(OnEntry) override
+	{
+		pimpl()->status.rpm = 0;
+	}
+
+	REACT(Start) override;
+};
+
+class Running : public PumpStateIF
+{
+	CONCRETE_STATE(Running)
+
+	REACT(Stop) override
+	{
+		changeState<Stopped>();
+	}
+};
+
+void Stopped::react(Start &start)
+{
+	pimpl()->status.rpm = start.rpm;
+	++pimpl()->status.starts;
+	changeState<Running>();
+}
+
+class Pump : public pocket_fsm::FiniteStateMachine<PumpStateIF>
+{
+public:
+	Pump()
+	{
+		_impl = new PumpImpl();
+		initialize(new Stopped(_impl));
+	}
+
+	const PumpStatus &status() const
+	{
+		return _impl->status;
+	}
+
+private:
+	PumpImpl *_impl; // Owned by the states
+};
+
+// Waits until every pump shows the expected state, reading the table only
+bool waitFor(const PumpTable &table, pocket_fsm::StateId (*expected)(size_t))
+{
+	for (int attempt = 0; attempt < 5000; ++attempt)
+	{
+		size_t ready = 0;
+		for (size_t i = 0; i < PUMPS; ++i)
+		{
+			ready += table.read(i).state == expected(i) ? 1 : 0;
+		}
+		if (ready == PUMPS)
+		{
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+// The operator process : starts every pump, then stops the even ones
+int operate(const std::string &name)
+{
+	PumpTable table;
+	if (!table.open(name, LAYOUT_VERSION))
+	{
+		return 1;
+	}
+	for (size_t i = 0; i < PUMPS; ++i)
+	{
+		while (!table.submit(i, Start{ uint32_t(1000 + 100 * i) }))
+		{
+			std::this_thread::yield();
+		}
+	}
+	if (!waitFor(table, [](size_t) { return Running::stateId(); }))
+	{
+		return 1;
+	}
+	for (size_t i = 0; i < PUMPS; i += 2)
+	{
+		while (!table.submit(i, Stop()))
+		{
+			std::this_thread::yield();
+		}
+	}
+	if (!waitFor(table, [](size_t i) { return i % 2 ? Running::stateId() : Stopped::stateId(); }))
+	{
+		return 1;
+	}
+	// The status blocks came along with the states
+	bool same = true;
+	for (size_t i = 0; i < PUMPS; ++i)
+	{
+		const PumpTable::Entry entry = table.read(i);
+		same = same && entry.status.starts == 1 && entry.status.rpm == (i % 2 ? 1000 + 100 * i : 0);
+	}
+	return same ? 0 : 1;
+}
+
+// A segment created by another controller but not sized yet is left to it
+bool sparesSegmentBeingCreated(const std::string &name)
+{
+	const int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0660);
+	if (fd < 0)
+	{
+		return false;
+	}
+	PumpTable table;
+	const bool refused = !table.create(name, PUMPS, 64, LAYOUT_VERSION) && errno == EEXIST;
+	struct stat info;
+	const bool spared = ::fstat(fd, &info) == 0 && info.st_size == 0 && ::shm_unlink(name.c_str()) == 0;
+	::close(fd);
+	return refused && spared;
+}
+
+int main(void)
+{
+	if (!sparesSegmentBeingCreated("/PocketFsmPumpsBeingCreated." + std::to_string(::getpid())))
+	{
+		printf("A segment being created was taken over!\n");
+		return 1;
+	}
+
+	const std::string name = "/PocketFsmPumps." + std::to_string(::getpid());
+	PumpTable table;
+	if (!table.create(name, PUMPS, 64, LAYOUT_VERSION))
+	{
+		return 1;
+	}
+	Pump pumps[PUMPS];
+	for (size_t i = 0; i < PUMPS; ++i)
+	{
+		table.publish(i, pumps[i], pumps[i].status());
+	}
+
+	const pid_t pid = ::fork();
+	if (pid == 0)
+	{
+		_exit(operate(name));
+	}
+
+	// The controller loop : deliver the submitted events, then publish the pumps that received one
+	int status = 0;
+	size_t delivered = 0;
+	while (::waitpid(pid, &status, WNOHANG) == 0)
+	{
+		bool received[PUMPS] = {};
+		delivered += table.pump([&](size_t index)
+		{
+			received[index] = true;
+			return &pumps[index];
+		});
+		for (size_t i = 0; i < PUMPS; ++i)
+		{
+			if (received[i])
+			{
+				table.publish(i, pumps[i], pumps[i].status());
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+	table.close();
+	PumpTable::unlink(name);
+
+	const bool operated = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	printf("%zu events from the operator, who %s\n", delivered, operated ? "saw every pump where expected" : "did not see the pumps as expected!");
+	return operated && delivered == PUMPS + PUMPS / 2 ? 0 : 1;
+}
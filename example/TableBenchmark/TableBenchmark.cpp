@@ -0,0 +1,182 @@
+#include "pocket_fsm_table.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Counts the words and lines of a text, one character at a time : virtual dispatch
+// of every character with sendEvent, against runStream and its transition table.
+// Reacting cells cost the same on both sides, so the gain grows with the share of
+// characters that the table steps through on its own.
+// Usage : TableBenchmark [characters]
+
+class CounterImpl : public pocket_fsm::PimplBase
+{
+public:
+	long words = 0;
+	long lines = 0;
+};
+
+class CounterStateIF : public pocket_fsm::StatePimplIF<CounterImpl>
+{
+	BASE_STATE(CounterStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(char) = 0;
+};
+
+class Blank : public CounterStateIF
+{
+	CONCRETE_STATE(Blank)
+	INITIAL_STATE(Blank)
+
+	REACT(char) override;
+};
+
+class InWord : public CounterStateIF
+{
+	CONCRETE_STATE(InWord)
+
+	REACT(char) override
+	{
+		if (e == '\n')
+		{
+			++pimpl()->lines;
+			changeState<Blank>();
+		}
+		else if (e == ' ')
+		{
+			changeState<Blank>();
+		}
+	}
+};
+
+void Blank::react(char &c)
+{
+	if (c == '\n')
+	{
+		++pimpl()->lines;
+	}
+	else if (c != ' ')
+	{
+		++pimpl()->words;
+		changeState<InWord>();
+	}
+}
+
+using CounterStates = pocket_fsm::StateList<Blank, InWord>;
+
+// The symbols of the characters
+enum : size_t { SPACE, LETTER, NEWLINE, SYMBOLS };
+
+size_t classify(char c)
+{
+	return c == ' ' ? SPACE : c == '\n' ? NEWLINE : LETTER;
+}
+
+using CounterTable = pocket_fsm::TransitionTable<CounterStates, SYMBOLS>;
+
+// Only the counting cells react, spaces are stepped through the table
+constexpr CounterTable makeTable()
+{
+	CounterTable table;
+	table.ignore<Blank>(SPACE);
+	table.ignore<InWord>(LETTER);
+	table.jump<InWord, Blank>(SPACE);
+	return table;
+}
+
+constexpr CounterTable counterTable = makeTable();
+
+class Counter : public pocket_fsm::TableStateMachine<CounterStateIF, CounterStates, SYMBOLS>
+{
+public:
+	Counter()
+		: TableStateMachine(counterTable)
+		, _impl(new CounterImpl())
+	{
+		initialize(new Blank(_impl));
+	}
+
+	const CounterImpl &impl() const
+	{
+		return *_impl;
+	}
+
+private:
+	CounterImpl *_impl; // Owned by the states
+};
+
+// Follows the transitions of a counter, which need to chain up when the table jumps
+class Follower : public pocket_fsm::TransitionObserver<CounterStateIF>
+{
+public:
+	void onTransition(const pocket_fsm::FiniteStateMachine<CounterStateIF> &, pocket_fsm::StateId from, pocket_fsm::StateId to) override
+	{
+		chained = chained && from == state;
+		state = to;
+	}
+
+	pocket_fsm::StateId state = Blank::stateId();
+	bool chained = true;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+	const size_t count = argc > 1 ? size_t(std::strtoull(argv[1], nullptr, 10)) : 20000000;
+
+	// Pseudo random text, mostly letters
+	std::vector<char> text(count);
+	unsigned seed = 1;
+	for (char &c : text)
+	{
+		seed = seed * 1103515245 + 12345;
+		const unsigned draw = (seed >> 16) % 100;
+		c = draw < 15 ? ' ' : draw < 16 ? '\n' : 'a';
+	}
+
+	Counter dispatched;
+	Clock::time_point start = Clock::now();
+	for (char c : text)
+	{
+		dispatched.sendEvent(c);
+	}
+	const double dispatchedMs = elapsedMs(start);
+
+	Counter streamed;
+	start = Clock::now();
+	const size_t reacts = streamed.runStream(text.data(), text.size(), classify);
+	const double streamedMs = elapsedMs(start);
+
+	printf("%zu characters : sendEvent %.1f ms, runStream %.1f ms (%.1fx), %zu reacts\n",
+		count, dispatchedMs, streamedMs, dispatchedMs / streamedMs, reacts);
+	printf("%ld words, %ld lines\n", streamed.impl().words, streamed.impl().lines);
+
+	// Without timing, the observer of a streamed counter sees where the jumps lead
+	Counter observed;
+	Follower follower;
+	observed.setObserver(&follower);
+	observed.runStream(text.data(), text.size(), classify);
+	if (!follower.chained || follower.state != observed.getCurrentStateId())
+	{
+		printf("The observer lost track of the stream!\n");
+		return 1;
+	}
+
+	if (dispatched.impl().words != streamed.impl().words || dispatched.impl().lines != streamed.impl().lines ||
+		dispatched.getCurrentStateId() != streamed.getCurrentStateId())
+	{
+		printf("The stream differs from the dispatched characters!\n");
+		return 1;
+	}
+	return 0;
+}
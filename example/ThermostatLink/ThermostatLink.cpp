@@ -0,0 +1,243 @@
+#include "pocket_fsm_codec.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+
+// A thermostat fed by its controller over a socket. The controller streams readings
+// and set points in frames, which the thermostat pumps into its state machine however
+// the reads cut them. Frames it cannot hold or decode stop the pump with an error.
+
+struct SetPoint { int32_t tenths; };
+struct Reading { int32_t tenths; };
+struct Rename { std::string name; };
+
+using LinkEvents = pocket_fsm::EventList<SetPoint, Reading, Rename>;
+using LinkCodec = pocket_fsm::Codec<LinkEvents>;
+
+// The name is sent as its characters
+namespace pocket_fsm
+{
+template<>
+struct WireLayout<Rename>
+{
+	static constexpr bool inPlace = false;
+
+	static size_t size(const Rename &evt)
+	{
+		return evt.name.size();
+	}
+
+	static void encode(const Rename &evt, uint8_t *out)
+	{
+		std::memcpy(out, evt.name.data(), evt.name.size());
+	}
+
+	static bool decode(const uint8_t *in, size_t size, Rename &evt)
+	{
+		evt.name.assign(reinterpret_cast<const char *>(in), size);
+		return true;
+	}
+};
+}
+
+class ThermostatImpl : public pocket_fsm::PimplBase
+{
+public:
+	std::string name;
+	int32_t setPoint = 200;
+	int32_t lastReading = 0;
+	unsigned readings = 0;
+	unsigned heatings = 0;
+};
+
+class ThermostatStateIF : public pocket_fsm::StatePimplIF<ThermostatImpl>
+{
+	BASE_STATE(ThermostatStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(SetPoint)
+	{
+		pimpl()->setPoint = e.tenths;
+	}
+	REACT(Reading) = 0;
+	REACT(Rename)
+	{
+		pimpl()->name = e.name;
+	}
+};
+
+class Idle : public ThermostatStateIF
+{
+	CONCRETE_STATE(Idle)
+	INITIAL_STATE(Idle)
+
+	REACT(Reading) override;
+};
+
+class Heating : public ThermostatStateIF
+{
+	CONCRETE_STATE(Heating)
+
+	REACT(OnEntry) override
+	{
+		++pimpl()->heatings;
+	}
+
+	REACT(Reading) override
+	{
+		++pimpl()->readings;
+		pimpl()->lastReading = e.tenths;
+		if (e.tenths >= pimpl()->setPoint)
+		{
+			changeState<Idle>();
+		}
+	}
+};
+
+void Idle::react(Reading &reading)
+{
+	++pimpl()->readings;
+	pimpl()->lastReading = reading.tenths;
+	if (reading.tenths < pimpl()->setPoint - 5)
+	{
+		changeState<Heating>();
+	}
+}
+
+class Thermostat : public pocket_fsm::FiniteStateMachine<ThermostatStateIF>
+{
+public:
+	Thermostat()
+	{
+		_impl = new ThermostatImpl();
+		initialize(new Idle(_impl));
+	}
+
+	const ThermostatImpl &impl() const
+	{
+		return *_impl;
+	}
+
+private:
+	ThermostatImpl *_impl; // Owned by the states
+};
+
+// A connected pair of sockets, closed on destruction
+struct Link
+{
+	Link()
+	{
+		ok = ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0;
+	}
+
+	~Link()
+	{
+		::close(fds[0]);
+		::close(fds[1]);
+	}
+
+	bool send(const void *data, size_t size)
+	{
+		return ::write(fds[1], data, size) == ssize_t(size);
+	}
+
+	template<typename E>
+	bool send(const E &evt)
+	{
+		uint8_t frame[256];
+		return send(frame, LinkCodec::encode(evt, frame, sizeof(frame)));
+	}
+
+	int fds[2] = { -1, -1 };
+	bool ok = false;
+};
+
+constexpr int READINGS = 10000;
+
+// The controller swings the temperature around the set point until it hangs up
+bool streamReadings(int &pumped)
+{
+	Link link;
+	Thermostat thermostat;
+	std::thread controller([&link]()
+	{
+		link.send(Rename{ "Living room" });
+		link.send(SetPoint{ 210 });
+		for (int i = 0; i < READINGS; ++i)
+		{
+			link.send(Reading{ 180 + (i % 60) });
+		}
+		::shutdown(link.fds[1], SHUT_WR);
+	});
+	pocket_fsm::StreamPump<LinkEvents> pump(link.fds[0]);
+	pumped = int(pump.run(thermostat));
+	controller.join();
+
+	const ThermostatImpl &impl = thermostat.impl();
+	return pumped == READINGS + 2 && impl.readings == READINGS && impl.name == "Living room" &&
+		impl.setPoint == 210 && impl.heatings == READINGS / 60 + (READINGS % 60 > 0 ? 1 : 0);
+}
+
+// A reading cut in three writes only reaches the state machine once whole
+bool splitFrame()
+{
+	Link link;
+	Thermostat thermostat;
+	::fcntl(link.fds[0], F_SETFL, O_NONBLOCK);
+	pocket_fsm::StreamPump<LinkEvents> pump(link.fds[0]);
+
+	uint8_t frame[64];
+	const size_t size = LinkCodec::encode(Reading{ 150 }, frame, sizeof(frame));
+	bool ok = link.send(frame, 3) && pump.pump(thermostat) == 0;
+	ok = ok && link.send(frame + 3, 7) && pump.pump(thermostat) == 0;
+	ok = ok && link.send(frame + 10, size - 10) && pump.pump(thermostat) == 1;
+	return ok && thermostat.impl().lastReading == 150 && thermostat.getCurrentStateId() == Heating::stateId();
+}
+
+// A name longer than the read buffer cannot be held
+bool oversizedFrame()
+{
+	Link link;
+	Thermostat thermostat;
+	pocket_fsm::StreamPump<LinkEvents> pump(link.fds[0], 64);
+	const bool sent = link.send(Rename{ std::string(200, 'x') });
+	ssize_t events = 0;
+	while (events == 0)
+	{
+		events = pump.pump(thermostat);
+	}
+	return sent && events == -1 && errno == EMSGSIZE && thermostat.impl().name.empty();
+}
+
+// Unknown event types are skipped, while a reading of the wrong length is malformed
+bool malformedFrames()
+{
+	Link link;
+	Thermostat thermostat;
+	pocket_fsm::StreamPump<LinkEvents> pump(link.fds[0]);
+
+	const uint32_t unknown[4] = { 8, 99, 0xDEAD, 0xBEEF }; // Length 8, type 99, then the payload
+	const uint32_t tooShort[2] = { 2, uint32_t(LinkEvents::indexOf<Reading>()) };
+	const uint8_t payload[8] = {};
+	bool ok = link.send(unknown, sizeof(unknown)) && link.send(SetPoint{ 190 }) && pump.pump(thermostat) == 1;
+	ok = ok && thermostat.impl().setPoint == 190;
+	ok = ok && link.send(tooShort, sizeof(tooShort)) && link.send(payload, sizeof(payload));
+	return ok && pump.pump(thermostat) == -1 && errno == EBADMSG && thermostat.impl().readings == 0;
+}
+
+int main(void)
+{
+	int pumped = 0;
+	const bool streamed = streamReadings(pumped);
+	const bool split = splitFrame();
+	const bool oversized = oversizedFrame();
+	const bool malformed = malformedFrames();
+
+	printf("%d events pumped : %s. Split frame : %s, oversized frame : %s, malformed frames : %s\n", pumped,
+		streamed ? "ok" : "wrong", split ? "ok" : "wrong", oversized ? "refused" : "wrong", malformed ? "refused" : "wrong");
+	return streamed && split && oversized && malformed ? 0 : 1;
+}
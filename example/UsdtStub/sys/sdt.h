@@ -0,0 +1,23 @@
+/*!
+ *  @file sdt.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Stand-in for the sys/sdt.h header of systemtap, so that the USDT probes of pocket_fsm
+ *  are compiled on systems without the systemtap development package. Like the real
+ *  probes, every argument goes through an asm operand, which checks that it can be
+ *  passed in a register or as an immediate. No tracepoint is emitted.
+ */
+
+#pragma once
+
+#define POCKET_FSM_SDT_ARG(x) __asm__ __volatile__("" :: "nor"(x));
+#define POCKET_FSM_SDT_ARGS1(a) POCKET_FSM_SDT_ARG(a)
+#define POCKET_FSM_SDT_ARGS2(a, b) POCKET_FSM_SDT_ARGS1(a) POCKET_FSM_SDT_ARG(b)
+#define POCKET_FSM_SDT_ARGS3(a, b, c) POCKET_FSM_SDT_ARGS2(a, b) POCKET_FSM_SDT_ARG(c)
+#define POCKET_FSM_SDT_ARGS4(a, b, c, d) POCKET_FSM_SDT_ARGS3(a, b, c) POCKET_FSM_SDT_ARG(d)
+#define POCKET_FSM_SDT_ARGS5(a, b, c, d, e) POCKET_FSM_SDT_ARGS4(a, b, c, d) POCKET_FSM_SDT_ARG(e)
+#define POCKET_FSM_SDT_PICK(_1, _2, _3, _4, _5, NAME, ...) NAME
+
+#define STAP_PROBEV(PROVIDER, NAME, ...) \
+	do { POCKET_FSM_SDT_PICK(__VA_ARGS__, POCKET_FSM_SDT_ARGS5, POCKET_FSM_SDT_ARGS4, POCKET_FSM_SDT_ARGS3, POCKET_FSM_SDT_ARGS2, POCKET_FSM_SDT_ARGS1)(__VA_ARGS__) } while (0)
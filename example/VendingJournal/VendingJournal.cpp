@@ -0,0 +1,205 @@
+#include "pocket_fsm_journal.h"
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <sys/wait.h>
+
+// A bank of vending machines whose coins and selections are journaled, so that an
+// audit can replay the day and check that every machine went through the same states.
+// The journal rolls over small segments, survives a crash of the process recording it,
+// and the replay tells a damaged or diverging journal apart.
+
+struct Coin { int32_t cents; };
+struct Select { int32_t slot; };
+
+using VendingEvents = pocket_fsm::EventList<Coin, Select>;
+
+constexpr int32_t PRICE = 150;
+
+class VendingImpl : public pocket_fsm::PimplBase
+{
+public:
+	int32_t credit = 0;
+	unsigned vended = 0;
+};
+
+class VendingStateIF : public pocket_fsm::StatePimplIF<VendingImpl>
+{
+	BASE_STATE(VendingStateIF)
+
+	REACT(OnEntry) override {};
+	REACT(OnExit) override {};
+
+	REACT(Coin);
+	REACT(Select) {};
+};
+
+class Waiting : public VendingStateIF
+{
+	CONCRETE_STATE(Waiting)
+	INITIAL_STATE(Waiting)
+};
+
+class Ready : public VendingStateIF
+{
+	CONCRETE_STATE(Ready)
+
+	REACT(Select) override
+	{
+		pimpl()->credit -= PRICE;
+		++pimpl()->vended;
+		if (pimpl()->credit < PRICE)
+		{
+			changeState<Waiting>();
+		}
+	}
+};
+
+void VendingStateIF::react(Coin &coin)
+{
+	pimpl()->credit += coin.cents;
+	if (pimpl()->credit >= PRICE)
+	{
+		changeState<Ready>();
+	}
+}
+
+class VendingMachine : public pocket_fsm::JournaledStateMachine<VendingStateIF, VendingEvents>
+{
+public:
+	VendingMachine()
+	{
+		initialize(new Waiting(new VendingImpl()));
+	}
+};
+
+constexpr size_t MACHINES = 8;
+constexpr int ROUNDS = 2000;               // Each round sends a coin and a selection
+constexpr size_t EVENTS = 2 * ROUNDS;
+constexpr size_t SEGMENT_SIZE = 16 * 1024; // A few thousand records each
+
+using Bank = std::unique_ptr<VendingMachine[]>;
+
+Bank newBank(pocket_fsm::EventJournal *journal)
+{
+	Bank bank(new VendingMachine[MACHINES]);
+	for (size_t i = 0; journal && i < MACHINES; ++i)
+	{
+		bank[i].attachJournal(journal, i);
+	}
+	return bank;
+}
+
+// Customers walking up to random machines with random coins
+void trade(VendingMachine *bank, int rounds, unsigned seed)
+{
+	for (int round = 0; round < rounds; ++round)
+	{
+		seed = seed * 1103515245 + 12345;
+		Coin coin{ int32_t(25 * (1 + (seed >> 16) % 4)) };
+		bank[(seed >> 20) % MACHINES].sendEvent(coin);
+		seed = seed * 1103515245 + 12345;
+		Select select{ int32_t((seed >> 16) % 10) };
+		bank[(seed >> 20) % MACHINES].sendEvent(select);
+	}
+}
+
+pocket_fsm::ReplayResult replay(const std::string &directory, VendingMachine *bank, size_t *segments = nullptr)
+{
+	pocket_fsm::JournalReplay<VendingEvents> journal(directory);
+	if (segments)
+	{
+		*segments = journal.segmentCount();
+	}
+	return journal.run([bank](uint64_t id) { return id < MACHINES ? &bank[id] : nullptr; });
+}
+
+std::string lastSegment(const std::string &directory)
+{
+	unsigned index = 0;
+	while (::access(pocket_fsm::internal::journalSegmentPath(directory, index + 1).c_str(), F_OK) == 0)
+	{
+		++index;
+	}
+	return pocket_fsm::internal::journalSegmentPath(directory, index);
+}
+
+void removeJournal(const std::string &directory)
+{
+	for (unsigned index = 0; ::unlink(pocket_fsm::internal::journalSegmentPath(directory, index).c_str()) == 0; ++index)
+	{
+	}
+	::rmdir(directory.c_str());
+}
+
+// A day recorded in full, replayed as is, against a tampered machine, then with a torn tail
+bool audit(const std::string &directory)
+{
+	{
+		pocket_fsm::EventJournal journal(directory, SEGMENT_SIZE);
+		Bank bank = newBank(&journal);
+		trade(bank.get(), ROUNDS, 7);
+	} // The journal writes and syncs everything before closing
+
+	size_t segments = 0;
+	Bank replayed = newBank(nullptr);
+	const pocket_fsm::ReplayResult clean = replay(directory, replayed.get(), &segments);
+
+	// A machine holding credit the journal knows nothing of goes its own way
+	Bank tampered = newBank(nullptr);
+	Coin coin{ 100 };
+	tampered[3].sendEvent(coin);
+	const pocket_fsm::ReplayResult diverging = replay(directory, tampered.get());
+
+	// The last record loses its end, as if the disk filled up while it was written
+	const std::string last = lastSegment(directory);
+	struct stat info;
+	const bool torn = ::stat(last.c_str(), &info) == 0 && ::truncate(last.c_str(), info.st_size - 5) == 0;
+	Bank truncated = newBank(nullptr);
+	const pocket_fsm::ReplayResult damaged = replay(directory, truncated.get());
+
+	printf("Audit : %zu segments, %llu events replayed, %llu mismatches once tampered with, first on machine %llu\n", segments,
+		(unsigned long long)clean.events, (unsigned long long)diverging.mismatches, (unsigned long long)diverging.mismatchMachine);
+	return segments > 2 && clean.events == EVENTS && clean.mismatches == 0 && !clean.corrupted && clean.skipped == 0 &&
+		diverging.mismatches > 0 && diverging.mismatchMachine == 3 && diverging.expectedState != diverging.actualState &&
+		torn && damaged.corrupted && damaged.events == EVENTS - 1 && damaged.mismatches == 0;
+}
+
+// The recording process crashes after committing half of its day. What was committed survives.
+bool crash(const std::string &directory)
+{
+	const pid_t pid = ::fork();
+	if (pid == 0)
+	{
+		pocket_fsm::EventJournal journal(directory, SEGMENT_SIZE);
+		Bank bank = newBank(&journal);
+		trade(bank.get(), ROUNDS / 2, 11);
+		const bool committed = journal.commit();
+		trade(bank.get(), ROUNDS / 2, 13);
+		_exit(committed ? 0 : 1); // Neither the journal nor the machines are destroyed
+	}
+	int status = 0;
+	const bool committed = ::waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+	// Only a record torn by the crash can be damaged, after everything committed
+	Bank replayed = newBank(nullptr);
+	const pocket_fsm::ReplayResult survived = replay(directory, replayed.get());
+	printf("Crash : %llu of the %zu events committed before it survived%s\n", (unsigned long long)survived.events, EVENTS / 2,
+		survived.corrupted ? ", up to a torn record" : "");
+	return committed && survived.events >= EVENTS / 2 && survived.events <= EVENTS && survived.mismatches == 0;
+}
+
+int main(void)
+{
+	char auditDirectory[] = "/tmp/PocketFsmAudit.XXXXXX";
+	char crashDirectory[] = "/tmp/PocketFsmCrash.XXXXXX";
+	if (!::mkdtemp(auditDirectory) || !::mkdtemp(crashDirectory))
+	{
+		return 1;
+	}
+	const bool audited = audit(auditDirectory);
+	const bool recovered = crash(crashDirectory);
+	removeJournal(auditDirectory);
+	removeJournal(crashDirectory);
+	return audited && recovered ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+#include "pocket_fsm_snapshot.h"
+#include <cstdio>
+#include <cstring>
+
+// A washing machine that resumes its cycle after a power cut. Its state, three levels
+// deep, is saved in a snapshot and restored into a new machine without running any entry
+// or exit. Damaged snapshots are refused and leave no trace either.
+
+struct PowerButton {};
+struct Start {};
+struct Tick {};
+
+// Every entry and exit run by the program
+static int reactions = 0;
+
+class WasherState : public pocket_fsm::StateIF
+{
+	BASE_STATE(WasherState)
+
+	REACT(OnEntry) override
+	{
+		++reactions;
+	}
+
+	REACT(OnExit) override
+	{
+		++reactions;
+	}
+
+	REACT(PowerButton) {};
+	REACT(Start) {};
+	REACT(Tick) {};
+};
+
+// The states while powered on
+class CycleState : public WasherState
+{
+};
+
+// The phases of a wash
+class PhaseState : public CycleState
+{
+};
+
+class Off : public WasherState
+{
+	CONCRETE_STATE(Off)
+
+	REACT(PowerButton) override;
+};
+
+class Idle : public CycleState
+{
+	CONCRETE_STATE(Idle)
+
+	REACT(Start) override;
+};
+
+class Draining : public PhaseState
+{
+	CONCRETE_STATE(Draining)
+
+	REACT(Tick) override
+	{
+		changeState<Idle>();
+	}
+};
+
+class Agitating : public PhaseState
+{
+	CONCRETE_STATE(Agitating)
+
+	REACT(Tick) override
+	{
+		changeState<Draining>();
+	}
+};
+
+class Filling : public PhaseState
+{
+	CONCRETE_STATE(Filling)
+
+	REACT(Tick) override
+	{
+		changeState<Agitating>();
+	}
+};
+
+class Washing : public pocket_fsm::NestedStateMachine<PhaseState, CycleState, WasherState>
+{
+	CONCRETE_STATE(Washing)
+
+	REACT(OnEntry) override
+	{
+		++reactions;
+		initialize(new Filling());
+	}
+
+	NESTED_REACT(Tick)
+};
+
+class On : public pocket_fsm::NestedStateMachine<CycleState, WasherState>
+{
+	CONCRETE_STATE(On)
+
+	REACT(OnEntry) override
+	{
+		++reactions;
+		initialize(new Idle());
+	}
+
+	REACT(PowerButton) override
+	{
+		changeState<Off>();
+	}
+
+	NESTED_REACT(Start)
+	NESTED_REACT(Tick)
+};
+
+void Off::react(PowerButton &)
+{
+	changeState<On>();
+}
+
+void Idle::react(Start &)
+{
+	changeState<Washing>();
+}
+
+using WasherStates = pocket_fsm::StateList<Off, On, Idle, Washing, Filling, Agitating, Draining>;
+
+class Washer : public pocket_fsm::FiniteStateMachine<WasherState>
+{
+public:
+	// A washer about to be restored is left without a state
+	explicit Washer(bool powered)
+	{
+		if (powered)
+		{
+			initialize(new Off());
+		}
+	}
+
+	bool hasState() const
+	{
+		return pocket_fsm::internal::FrameworkAccess::currentState(*this).get() != nullptr;
+	}
+
+	// The state of the deepest level
+	pocket_fsm::StateId phase() const
+	{
+		const pocket_fsm::StateIF *state = pocket_fsm::internal::FrameworkAccess::currentState(*this).get();
+		while (state->getNestedState())
+		{
+			state = state->getNestedState();
+		}
+		return state->getStateId();
+	}
+};
+
+// Restores a snapshot into a new washer, which is destroyed when it is refused
+bool restore(const std::vector<uint8_t> &snapshot, pocket_fsm::StateId expectedPhase)
+{
+	Washer washer(false);
+	pocket_fsm::SnapshotReader in(snapshot);
+	if (!pocket_fsm::restoreSnapshot<WasherStates>(washer, in))
+	{
+		return !washer.hasState();
+	}
+	if (washer.phase() != expectedPhase)
+	{
+		return false;
+	}
+	// The cycle carries on where it was cut
+	Tick tick;
+	washer.sendEvent(tick);
+	return washer.phase() == Draining::stateId();
+}
+
+// A copy of the snapshot with the state of the given level replaced
+std::vector<uint8_t> damaged(std::vector<uint8_t> snapshot, size_t level, pocket_fsm::StateId id)
+{
+	std::memcpy(snapshot.data() + 2 + level * sizeof(pocket_fsm::StateId), &id, sizeof(id));
+	return snapshot;
+}
+
+int main(void)
+{
+	Washer washer(true);
+	PowerButton power;
+	Start start;
+	Tick tick;
+	washer.sendEvent(power);
+	washer.sendEvent(start);
+	washer.sendEvent(tick);
+
+	// The power goes while agitating
+	std::vector<uint8_t> snapshot;
+	pocket_fsm::SnapshotWriter out(snapshot);
+	pocket_fsm::saveSnapshot(washer, out);
+
+	int before = reactions;
+	const bool resumed = restore(snapshot, Agitating::stateId());
+	// Only the exit of Agitating and the entry of Draining ran, then the exits of the destroyed washer
+	const bool resumedQuietly = reactions == before + 2 + 3;
+
+	// An unknown phase, and a phase at the wrong level, after the first two levels were adopted
+	before = reactions;
+	const bool unknownRefused = restore(damaged(snapshot, 2, 0x12345678), 0);
+	const bool misplacedRefused = restore(damaged(snapshot, 2, Idle::stateId()), 0);
+	const bool refusedQuietly = reactions == before;
+
+	printf("Snapshot of %zu bytes resumed : %s. Damaged snapshots refused : %s, without a reaction : %s\n", snapshot.size(),
+		resumed && resumedQuietly ? "yes" : "no", unknownRefused && misplacedRefused ? "yes" : "no", refusedQuietly ? "yes" : "no");
+	return resumed && resumedQuietly && unknownRefused && misplacedRefused && refusedQuietly ? 0 : 1;
+}
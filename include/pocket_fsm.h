@@ -8,11 +8,33 @@
 
 #pragma once
 
+#include <atomic>     // std::atomic
+#include <cstdint>    // uint32_t, uint64_t
+#include <cstring>    // std::memmove
 #include <functional> // std::function
 #include <memory>     // std::unique_ptr
+#include <new>        // placement new
+#include <utility>    // std::declval, std::index_sequence
 #if defined (UNIX)
 #include <cassert>    // assert
 #endif
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define POCKET_FSM_CXX17
+#include <variant>    // std::variant
+#endif
+#if defined(POCKET_FSM_USDT)
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>  // STAP_PROBEV
+#define POCKET_FSM_PROBE(NAME, ...) STAP_PROBEV(pocket_fsm, NAME, __VA_ARGS__)
+#endif
+#endif
+#if !defined(POCKET_FSM_PROBE)
+#error "POCKET_FSM_USDT requires <sys/sdt.h>, from the systemtap sdt development package"
+#endif
+#else
+#define POCKET_FSM_PROBE(NAME, ...) do { } while (0)
+#endif
 
 namespace pocket_fsm
 {
@@ -22,10 +44,14 @@ namespace pocket_fsm
 -------------------------------------------------------------------------------------
 
 BASE_STATE(BASENAME) : Put at the top of your base state class header.
-CONCRETE_STATE(NAME) : Put at the top of all concrete states in source file.
+CONCRETE_STATE(NAME) : Put at the top of all concrete states in source file. Defines the state ID.
 INITIAL_STATE(NAME) : Put in the concrete state that will serve as initial state.
 REACT(EVENT) : Function signature for react functions. Event parameter is e.
 NESTED_REACT(EVENT) : React implementation for nested state machines
+QUERY_REACT(EVENT) : Function signature for read only react functions, run under a shared lock
+IGNORE_REACT(EVENT) : Empty default react of a base state, skipped by sendEvent without locking in states not overriding it
+NESTED_QUERY_REACT(EVENT) : Query react implementation for nested state machines
+POCKET_FSM_PROBE(NAME, ...) : USDT probe of the pocket_fsm provider, compiled in when POCKET_FSM_USDT is defined
 
 
 *************************************************************************************
@@ -37,6 +63,9 @@ StateIF : The core for a state machine state that has no pimpl
 StatePimplIF<Pimpl> : A state IF that also has a parameterized pimpl
 FiniteStateMachine<Base> : The core fsm processing of states of the parameterized type
 NestedStateMachine<Nest, Base> : FSM varaint nested inside a concrete state
+EventList<Events...> : Compile time registry of event types
+StateList<States...> : Compile time registry of concrete state types
+TransitionObserver<Base> : Interface notified of the transitions of state machines
 
 
 *************************************************************************************
@@ -93,13 +122,18 @@ takes in each state, on transitions, on entry and on exit.
 	public:
 
  /*!
-  *  Call this macro in a concrete state to set up the stringified name.
+  *  Call this macro in a concrete state to set up the stringified name
+  *  and the state ID, a hash of the name that is stable across builds.
   *
   *  @param NAME This concrete class
   */
 #define CONCRETE_STATE(NAME) \
 public: \
-	NAME() { _name=#NAME; }
+	NAME() { _name=#NAME; } \
+	static constexpr pocket_fsm::StateId stateId() { return pocket_fsm::internal::hashName(#NAME); } \
+	pocket_fsm::StateId getStateId() const override { return stateId(); } \
+	pocket_fsm::StateIF *newInstance() const override { return new NAME(); } \
+	uint64_t ignoredEvents() const override { return pocket_fsm::internal::ignoredEventMask<NAME>(); }
 
 /*!
 *  Use this macro to define the constructor of your initial state.
@@ -127,11 +161,12 @@ public: \
 /*!
 *  Use this macro to reliaby declare your react functions with the proper signature.
 *  The event parameter is simply named e ans is a non const reference.
-*  Call this macro in a concrete state.
+*  Call this macro in a concrete state. It also tells IGNORE_REACT that the event is overridden.
 *
 *  @param EVENT The type of the parameter of the react function
 */
 #define REACT(EVENT) \
+	operator pocket_fsm::internal::ReactDeclared<EVENT>() const; \
 	virtual void react(EVENT &e)
 
 /*!
@@ -141,11 +176,48 @@ public: \
 *  @param EVENT The type of the parameter of the react function
 */
 #define NESTED_REACT(EVENT) \
+	operator pocket_fsm::internal::ReactDeclared<EVENT>() const; \
 	virtual void react(EVENT &e) override \
 	{ \
 		sendEvent(e); \
 	}
 
+/*!
+*  Use this macro to declare the react function of a query event, such as a getter.
+*  The react is const : it can read the pimpl but cannot call changeState.
+*  The state machine runs queries under its shared lock, concurrently with each other.
+*
+*  @param EVENT The type of the parameter of the react function
+*/
+#define QUERY_REACT(EVENT) \
+	virtual void react(EVENT &e) const
+
+/*!
+*  Use this macro in a base state to declare an empty default react for an event that
+*  most states ignore. The event needs to be listed in the IgnoredEvents of the base state.
+*  Concrete states can still override it with REACT. Those that do not are known at compile
+*  time, and sendEvent returns right away without locking whenever one of them is current.
+*
+*  @param EVENT The type of the parameter of the react function
+*/
+#define IGNORE_REACT(EVENT) \
+	static_assert(IgnoredEvents::contains<EVENT>(), "List the event in the IgnoredEvents of the base state : using IgnoredEvents = pocket_fsm::EventList<...>;"); \
+	operator pocket_fsm::internal::ReactDeclared<EVENT>() const noexcept; \
+	virtual void react(EVENT &) \
+	{ \
+	}
+
+/*!
+*  Use this macro in a nested state machine to forward a query event.
+*
+*  @param EVENT The type of the parameter of the react function
+*/
+#define NESTED_QUERY_REACT(EVENT) \
+	virtual void react(EVENT &e) const override \
+	{ \
+		sendQuery(e); \
+	}
+
 /*!
 	*  This namespace includes all things to be obfuscated from users of the header and only relate to the inner workings of pocket_fsm
 	*/
@@ -170,7 +242,327 @@ constexpr void ASSERT(bool expr, const wchar_t *msg) {
  */
 struct OnEntry { };
 struct OnExit { };
+
+/*!
+ *  FNV-1a hash of a concrete state name, used as state ID
+ *
+ *      @param [in] name The stringified name of the state
+ *
+ *      @return The state ID
+ */
+constexpr uint32_t hashName(const char *name)
+{
+	uint32_t hash = 2166136261u;
+	while (*name)
+	{
+		hash = (hash ^ uint8_t(*name++)) * 16777619u;
+	}
+	return hash;
+}
+
+/*!
+ *  Name of an event type for tracing, from the signature of this function
+ */
+template<typename E>
+constexpr const char *eventTypeName()
+{
+#if defined(_MSC_VER)
+	return __FUNCSIG__;
+#else
+	return __PRETTY_FUNCTION__;
+#endif
+}
+
+/*!
+ *  ID of an event type for tracing, the hash of its name.
+ *  Stable across builds with the same compiler.
+ */
+template<typename E>
+constexpr uint32_t eventTypeId()
+{
+	return hashName(eventTypeName<E>());
+}
+
+/*!
+ *  Declared by REACT and IGNORE_REACT as a conversion of the state. Conversions to different
+ *  types do not hide each other, so the most derived declaration for an event tells whether
+ *  a state overrides the react declared by IGNORE_REACT, which alone is noexcept.
+ */
+template<typename E>
+struct ReactDeclared
+{
+};
+
+/*!
+ *  Grants the optional extension headers access to the protected members of the framework
+ */
+struct FrameworkAccess;
+
+/*!
+ *  Deep copies states and pimpls for FiniteStateMachine::cloneFrom()
+ */
+template<class BASE, class PIMPL>
+struct StateCloner;
+
+/*!
+ *  Detects whether STATE declares a react function for the event E
+ */
+template<class STATE, typename E, typename = void>
+struct HasReact : std::false_type { };
+
+template<class STATE, typename E>
+struct HasReact<STATE, E, decltype(std::declval<STATE &>().react(std::declval<E &>()))> : std::true_type { };
+
+/*!
+ *  Whether STATE reacts to E with a const react, declared with QUERY_REACT
+ */
+template<class STATE, typename E, typename = void>
+struct IsQuery : std::false_type { };
+
+template<class STATE, typename E>
+struct IsQuery<STATE, E, decltype(std::declval<const STATE &>().react(std::declval<E &>()))> : std::true_type { };
+
+/*!
+ *  Whether the react of STATE to E is the one declared by IGNORE_REACT, not overridden with REACT
+ */
+template<class STATE, typename E, typename = void>
+struct IgnoresEvent : std::false_type { };
+
+template<class STATE, typename E>
+struct IgnoresEvent<STATE, E, decltype(void(static_cast<ReactDeclared<E>>(std::declval<const STATE &>())))>
+	: std::integral_constant<bool, noexcept(static_cast<ReactDeclared<E>>(std::declval<const STATE &>()))> { };
+
+/*!
+ *  Index of the first occurence of E in Es, or sizeof...(Es) if absent
+ */
+template<typename E, typename... Es>
+constexpr size_t indexOf()
+{
+	constexpr bool matches[] = { std::is_same<E, Es>::value..., false };
+	size_t i = 0;
+	while (i < sizeof...(Es) && !matches[i])
+	{
+		++i;
+	}
+	return i;
+}
+
+#if defined(POCKET_FSM_CXX17)
+/*!
+ *  Generates a jump table sending the active alternative of a variant to a state machine
+ *  whose base state is STATE, with the lock already held.
+ */
+template<class STATE, class VARIANT, class INDICES>
+struct VariantDispatcher;
+
+template<class STATE, typename... Es, size_t... Is>
+struct VariantDispatcher<STATE, std::variant<Es...>, std::index_sequence<Is...>>
+{
+	using Variant = std::variant<Es...>;
+
+	template<size_t I, class MACHINE>
+	static void reactTo(MACHINE &machine, Variant &evt)
+	{
+		machine.processLocked(*std::get_if<I>(&evt), IsQuery<STATE, std::variant_alternative_t<I, Variant>>());
+	}
+
+	template<class MACHINE>
+	static void dispatch(MACHINE &machine, Variant &evt)
+	{
+		static constexpr void (*table[])(MACHINE &, Variant &) = { &reactTo<Is, MACHINE>... };
+		table[evt.index()](machine, evt);
+	}
+};
+#endif
+}
+
+/*!
+ *  A compile time registry of event types. It gives each event type a stable
+ *  index in the order of declaration, usable as an event type ID.
+ *
+ *      @tparam Es The event types
+ */
+template<typename... Es>
+struct EventList
+{
+	/*!
+	 *  Number of event types in the list
+	 */
+	static constexpr size_t size = sizeof...(Es);
+
+	/*!
+	 *  Index of an event type in the list, or size if it is not registered
+	 */
+	template<typename E>
+	static constexpr size_t indexOf()
+	{
+		return internal::indexOf<E, Es...>();
+	}
+
+	/*!
+	 *  Whether an event type is registered in the list
+	 */
+	template<typename E>
+	static constexpr bool contains()
+	{
+		return indexOf<E>() < size;
+	}
+
+	/*!
+	 *  Whether STATE declares a react function for every event type in the list
+	 */
+	template<class STATE>
+	static constexpr bool isHandledBy()
+	{
+		constexpr bool handled[] = { internal::HasReact<STATE, Es>::value..., true };
+		for (bool h : handled)
+		{
+			if (!h) return false;
+		}
+		return true;
+	}
+
+#if defined(POCKET_FSM_CXX17)
+	/*!
+	 *  A variant able to hold any of the events, to be sent with FiniteStateMachine::sendEvent
+	 */
+	using Variant = std::variant<Es...>;
+#endif
+};
+
+/*!
+ *  Identifies a concrete state. See CONCRETE_STATE
+ */
+using StateId = uint32_t;
+
+namespace internal
+{
+/*!
+ *  The mask of the events of the list that STATE ignores, one bit per index in the list
+ */
+template<class STATE, typename... Es>
+constexpr uint64_t ignoredEventMaskOf(EventList<Es...> *)
+{
+	constexpr bool ignored[] = { IgnoresEvent<STATE, Es>::value..., false };
+	uint64_t mask = 0;
+	for (size_t i = 0; i < sizeof...(Es); ++i)
+	{
+		mask |= ignored[i] ? uint64_t(1) << i : 0;
+	}
+	return mask;
+}
+
+/*!
+ *  The mask of the IgnoredEvents of its base state that a concrete state does not override
+ */
+template<class STATE>
+constexpr uint64_t ignoredEventMask()
+{
+	static_assert(STATE::IgnoredEvents::size <= 64, "A base state can list up to 64 IgnoredEvents");
+	return ignoredEventMaskOf<STATE>(static_cast<typename STATE::IgnoredEvents *>(nullptr));
+}
+
+/*!
+ *  Whether the IDs of the states are all different
+ */
+template<typename... Ss>
+constexpr bool uniqueStateIds()
+{
+	constexpr StateId ids[] = { Ss::stateId()..., 0 };
+	for (size_t i = 0; i < sizeof...(Ss); ++i)
+	{
+		for (size_t j = i + 1; j < sizeof...(Ss); ++j)
+		{
+			if (ids[i] == ids[j]) return false;
+		}
+	}
+	return true;
 }
+}
+
+/*!
+ *  A compile time registry of concrete state types, used to recreate a state from its ID.
+ *  List the concrete states of all levels of nested state machines in a single list.
+ *
+ *      @tparam Ss The concrete state types, all using the CONCRETE_STATE macro
+ */
+template<typename... Ss>
+struct StateList
+{
+	static_assert(internal::uniqueStateIds<Ss...>(), "Two states of the StateList have the same ID : a state is listed twice or the hashes of two names collide");
+
+	/*!
+	 *  Number of state types in the list
+	 */
+	static constexpr size_t size = sizeof...(Ss);
+
+	/*!
+	 *  Index of the state with the given ID in the list, or size if it is not listed
+	 */
+	static constexpr size_t indexOf(StateId id)
+	{
+		constexpr StateId ids[] = { Ss::stateId()..., 0 };
+		size_t i = 0;
+		while (i < size && ids[i] != id)
+		{
+			++i;
+		}
+		return i;
+	}
+
+	template<class S>
+	static constexpr size_t indexOf()
+	{
+		return indexOf(S::stateId());
+	}
+
+	/*!
+	 *  ID of the state at the given index in the list
+	 */
+	static constexpr StateId idAt(size_t index)
+	{
+		constexpr StateId ids[] = { Ss::stateId()..., 0 };
+		return ids[index];
+	}
+
+	/*!
+	 *  Create a new instance of the listed state with the given ID.
+	 *
+	 *      @tparam BASE The base state of the state to create
+	 *
+	 *      @param [in] id The ID of the state to create
+	 *
+	 *      @return A new state, or nullptr if no state deriving from BASE in the list has this ID
+	 */
+	template<class BASE>
+	static BASE *create(StateId id)
+	{
+		using Factory = BASE *(*)();
+		static const StateId ids[] = { Ss::stateId()..., 0 };
+		static const Factory factories[] = { &make<BASE, Ss>..., nullptr };
+		for (size_t i = 0; i < size; ++i)
+		{
+			if (ids[i] == id)
+			{
+				return factories[i]();
+			}
+		}
+		return nullptr;
+	}
+
+private:
+	template<class BASE, class S>
+	static typename std::enable_if<std::is_base_of<BASE, S>::value, BASE *>::type make()
+	{
+		return new S();
+	}
+
+	template<class BASE, class S>
+	static typename std::enable_if<!std::is_base_of<BASE, S>::value, BASE *>::type make()
+	{
+		return nullptr;
+	}
+};
 
 /*!
  *  A pimpl needs to derive from this class to expose a virtual destructor to the smart pointer
@@ -195,6 +587,11 @@ public:
 	using OnEntry = pocket_fsm::internal::OnEntry;
 	using OnExit = pocket_fsm::internal::OnExit;
 
+	/*!
+	 *  The events a base state declares with IGNORE_REACT. Redeclare it in your base state.
+	 */
+	using IgnoredEvents = EventList<>;
+
 	/*!
 	 *  Constructor. All states should be created clean : no copying allowed!
 	 */
@@ -238,12 +635,78 @@ public:
 		return _nextState;
 	}
 
+	/*!
+	 *  Returns the ID of the concrete class, defined by the CONCRETE_STATE macro.
+	 *
+	 *      @return The state ID, or 0 if this is not a concrete state
+	 */
+	virtual StateId getStateId() const
+	{
+		return 0;
+	}
+
+	/*!
+	 *  Creates a new clean instance of the concrete class, defined by the CONCRETE_STATE macro.
+	 *
+	 *      @return The new state, or nullptr if this is not a concrete state
+	 */
+	virtual StateIF *newInstance() const
+	{
+		return nullptr;
+	}
+
+	/*!
+	 *  Returns the mask of the IgnoredEvents this concrete class does not override, defined by the CONCRETE_STATE macro.
+	 *
+	 *      @return One bit per index in IgnoredEvents, or 0 if this is not a concrete state
+	 */
+	virtual uint64_t ignoredEvents() const
+	{
+		return 0;
+	}
+
+	/*!
+	 *  Returns the current state of the state machine nested in this state, if any.
+	 *
+	 *      @return The current nested state, or nullptr
+	 */
+	virtual StateIF *getNestedState() const
+	{
+		return nullptr;
+	}
+
 	/*!
 	 *  Stringified name of the concrete class
 	 */
 	const char *_name = nullptr;
 
 protected:
+	friend struct internal::FrameworkAccess;
+
+	/*!
+	 *  Makes the given state the current state of the nested state machine, without
+	 *  calling entry. Only states holding a nested state machine accept it.
+	 *
+	 *      @param [in] nestedState The new nested state. Ownership is taken on success
+	 *
+	 *      @return Whether the state was adopted
+	 */
+	virtual bool restoreNestedState(StateIF *nestedState)
+	{
+		(void)nestedState;
+		return false;
+	}
+
+	/*!
+	 *  Drops the current state of the nested state machine, if any, without calling exit.
+	 */
+	virtual void discardNestedState()
+	{
+	}
+
+	template<class BASE>
+	friend class FiniteStateMachine;
+
 	/*!
 	 *  Beautifiers
 	 */
@@ -301,6 +764,8 @@ public:
 	}
 
 protected:
+	friend struct internal::FrameworkAccess;
+
 	/*!
 	 *  Beautifiers
 	 */
@@ -318,6 +783,17 @@ protected:
 		return static_cast<PimplType*>(_pimpl.get());
 	}
 
+	/*!
+	 *  Access the Implementation class as its proper type, read only. For QUERY_REACT functions.
+	 *
+	 *      @return
+	 */
+	inline const PimplType * pimpl() const
+	{
+		static_assert(std::is_base_of<PimplBase, Pimpl>::value, "The pimpl class needs to have pocket_fsm::PimplBase as a base");
+		return static_cast<const PimplType*>(_pimpl.get());
+	}
+
 	/*!
 	 *  Pointer to implementation.
 	 *  This object will contain all fields and output methods. It is unknown outside of the concrete states.
@@ -325,6 +801,41 @@ protected:
 	PimplSmartPtr _pimpl = { nullptr };
 };
 
+/*!
+ *  Opt-in trait for pimpls that FiniteStateMachine::cloneFrom() can deep copy with their
+ *  copy constructor. Specialize it as std::true_type for your pimpl.
+ *
+ *  @tparam Pimpl The implementation class
+ */
+template<class Pimpl>
+struct IsCopyablePimpl : std::false_type { };
+
+template<class BASE>
+class FiniteStateMachine;
+
+/*!
+ *  Interface notified of the transitions of state machines, attached with
+ *  FiniteStateMachine::setObserver(). Called under the lock of the state machine,
+ *  once per event causing transitions, so it needs to return quickly.
+ *
+ *  @tparam BASE The base state of the observed state machines
+ */
+template<class BASE>
+class TransitionObserver
+{
+public:
+	virtual ~TransitionObserver() {}
+
+	/*!
+	 *  The state machine left a state and settled in another
+	 *
+	 *      @param [in] machine The state machine
+	 *      @param [in] from The ID of the state before the event
+	 *      @param [in] to The ID of the state after the event and all its transitions
+	 */
+	virtual void onTransition(const FiniteStateMachine<BASE> &machine, StateId from, StateId to) = 0;
+};
+
 /*!
  * The State Machine handles sending events to the current state and operates state transitions. Derive from this class
  *  with your base state class as parameters and set up a constructor that initializes the initial state.
@@ -349,7 +860,70 @@ public:
 	FiniteStateMachine() = default;
 
 	/*!
-	 *  Destructor. Call exit event before deletion.
+	 *  Copies would share the current state and both call its exit.
+	 *  Derive a copy constructor calling cloneFrom() instead.
+	 */
+	FiniteStateMachine(const FiniteStateMachine &) = delete;
+	FiniteStateMachine &operator=(const FiniteStateMachine &) = delete;
+
+	/*!
+	 *  Move constructor. Takes over the current state, pimpl and observer of another
+	 *  state machine without calling exit or entry, under the lock of the other one.
+	 *  The other state machine is left uninitialized and its destructor does nothing.
+	 *  Registrations holding the address of the other state machine, such as in a
+	 *  StateChangeBus subscriber, a MachineGroup or an EventLoop, are not moved along :
+	 *  register this state machine again.
+	 *
+	 *      @param [in,out] other The state machine to move from
+	 */
+	FiniteStateMachine(FiniteStateMachine &&other) noexcept
+	{
+		// This lock is not constructed yet: the lock of a descendant lives in the descendant
+		other.lock();
+		_currentState = std::move(other._currentState);
+		_observer = other._observer;
+		_ignoredEvents.store(other._ignoredEvents.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		_eventHooks = other._eventHooks;
+		other._observer = nullptr;
+		other._ignoredEvents.store(0, std::memory_order_relaxed);
+		other.unlock();
+	}
+
+	/*!
+	 *  Move assignment. The current state of this state machine, if any, is exited
+	 *  and replaced by the state of the other one, which is neither exited nor entered.
+	 *  Both state machines are locked, in order of address so that two assignments in
+	 *  opposite directions cannot deadlock. Registrations are not moved, as with the
+	 *  move constructor.
+	 *
+	 *      @param [in,out] other The state machine to move from
+	 *
+	 *      @return This state machine
+	 */
+	FiniteStateMachine &operator=(FiniteStateMachine &&other)
+	{
+		if (this != &other)
+		{
+			const bool thisFirst = std::less<const FiniteStateMachine *>()(this, &other);
+			FiniteStateMachine &first = thisFirst ? *this : other;
+			FiniteStateMachine &second = thisFirst ? other : *this;
+			first.lock();
+			second.lock();
+			setCurrentState(nullptr); // Call exit on the replaced state
+			_currentState = std::move(other._currentState);
+			_observer = other._observer;
+			_ignoredEvents.store(other._ignoredEvents.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			_eventHooks = other._eventHooks;
+			other._observer = nullptr;
+			other._ignoredEvents.store(0, std::memory_order_relaxed);
+			second.unlock();
+			first.unlock();
+		}
+		return *this;
+	}
+
+	/*!
+	 *  Destructor. Call exit event before deletion.
 	 */
 	virtual ~FiniteStateMachine()
 	{
@@ -359,6 +933,7 @@ public:
 	/*!
 	 *  Send an external event to the state machine.
 	 *  You cannot call internal events such as OnEntry and OnExit externally!
+	 *  Query events, declared with QUERY_REACT, are handled under the shared lock.
 	 *
 	 *      @tparam E The type of the event the current state needs to react to.
 	 *
@@ -370,17 +945,39 @@ public:
 	E &sendEvent(E &evt)
 	{
 		static_assert(!std::is_same<E, OnEntry>::value && !std::is_same<E, OnExit>::value, "Cannot send an internal event");
-		internal::ASSERT(_currentState.get(), L"You did not call \"initialize(new MyInitialState(...));\" in your constructor!");
+		POCKET_FSM_PROBE(send_event_entry, this, uint32_t(std::integral_constant<uint32_t, internal::eventTypeId<E>()>()), internal::eventTypeName<E>(), &evt);
+		dispatchEvent(evt, internal::IsQuery<BASE, E>());
+		POCKET_FSM_PROBE(send_event_exit, this, uint32_t(std::integral_constant<uint32_t, internal::eventTypeId<E>()>()), internal::eventTypeName<E>(), &evt);
+		return evt;
+	}
+
+#if defined(POCKET_FSM_CXX17)
+	/*!
+	 *  Send an event held in a variant, such as an event decoded off a queue.
+	 *  The react is selected through a single jump table instead of instantiating
+	 *  sendEvent for each alternative. Requires C++17.
+	 *
+	 *      @tparam Es The alternatives of the variant. BASE needs a react function for each of them.
+	 *
+	 *      @param [in,out] evt The variant holding the event the state machine will handle
+	 *
+	 *      @return the input parameter reference
+	 */
+	template<typename... Es>
+	std::variant<Es...> &sendEvent(std::variant<Es...> &evt)
+	{
+		static_assert(!EventList<Es...>::template contains<OnEntry>() && !EventList<Es...>::template contains<OnExit>(), "Cannot send an internal event");
+		static_assert(EventList<Es...>::template isHandledBy<BASE>(), "The base state needs a react function for every alternative of the variant");
+		internal::ASSERT(!evt.valueless_by_exception(), L"Cannot send an empty variant!");
+		POCKET_FSM_PROBE(send_event_entry, this, uint32_t(std::integral_constant<uint32_t, internal::eventTypeId<std::variant<Es...>>()>()), internal::eventTypeName<std::variant<Es...>>(), &evt);
 		lock();
-		_currentState->react(evt);					// Call concrete state's react function
-		while (_currentState->getNextState())
-		{
-			// This cast is safe because of the static assert at the top of this class
-			setCurrentState(static_cast<BASE*>(_currentState->getNextState()));
-		}
+		internal::ASSERT(_currentState.get(), L"You did not call \"initialize(new MyInitialState(...));\" in your constructor!");
+		internal::VariantDispatcher<BASE, std::variant<Es...>, std::index_sequence_for<Es...>>::dispatch(*this, evt);
 		unlock();
+		POCKET_FSM_PROBE(send_event_exit, this, uint32_t(std::integral_constant<uint32_t, internal::eventTypeId<std::variant<Es...>>()>()), internal::eventTypeName<std::variant<Es...>>(), &evt);
 		return evt;
 	}
+#endif
 
 	/*!
 	 *  Returns the finite state machine's current state stringified name.
@@ -392,7 +989,53 @@ public:
 		return _currentState ? _currentState->_name : "";
 	}
 
+	/*!
+	 *  Returns the finite state machine's current state ID.
+	 *
+	 *      @return The current state ID, or 0 if uninitialized
+	 */
+	inline StateId getCurrentStateId() const
+	{
+		return _currentState ? _currentState->getStateId() : 0;
+	}
+
+	/*!
+	 *  Whether the current state may react to an event. Returns false when the current
+	 *  state does not override a react declared by IGNORE_REACT, as worked out at compile
+	 *  time, in which case sendEvent returns right away. Lock free, so that routers can skip
+	 *  the machines an event means nothing to. Always true while event hooks are set.
+	 *
+	 *      @tparam E The type of the event
+	 *
+	 *      @return false if the current state ignores the event
+	 */
+	template<typename E>
+	bool accepts() const
+	{
+		using Ignorable = typename BASE::IgnoredEvents;
+		constexpr size_t index = Ignorable::template indexOf<E>();
+		return index >= Ignorable::size || (_ignoredEvents.load(std::memory_order_relaxed) & (uint64_t(1) << (index % 64))) == 0;
+	}
+
+	/*!
+	 *  Set the observer notified of the transitions of this state machine.
+	 *  Without an observer, transitions cost a single check.
+	 *
+	 *      @param [in] observer The observer, which needs to outlive the state machine, or nullptr
+	 */
+	void setObserver(TransitionObserver<BASE> *observer)
+	{
+		lock();
+		_observer = observer;
+		unlock();
+	}
+
 protected:
+	friend struct internal::FrameworkAccess;
+#if defined(POCKET_FSM_CXX17)
+	template<class, class, class> friend struct internal::VariantDispatcher;
+#endif
+
 	/*!
 	 *  Descendants call this in their constructor typically to set the initial state.
 	 *  The state machine takes ownership of the pointer.
@@ -407,14 +1050,189 @@ protected:
 		// Reinitialize state machine with provided state
 		// The pimpl is not handed off because _currentState->_nextState is nullptr at this point
 		setCurrentState(newInitialState);   
-		while (_currentState->getNextState()) // Entry usually doesn't changeState, but it can.
+		processTransitions(); // Entry usually doesn't changeState, but it can.
+		unlock();
+	}
+
+	/*!
+	 *  Reacts to an event and performs the resulting transitions without locking.
+	 *  This is the body of sendEvent(), for descendants that manage the lock themselves.
+	 *
+	 *      @tparam E The type of the event the current state needs to react to.
+	 *
+	 *      @param [in,out] evt The user defined object the state machine will handle
+	 */
+	template<typename E>
+	void processEvent(E &evt)
+	{
+		if (_eventHooks)
+		{
+			beforeEvent(&evt, internal::eventTypeId<E>());
+		}
+		_currentState->react(evt);					// Call concrete state's react function
+		processTransitions();
+		if (_eventHooks)
+		{
+			afterEvent();
+		}
+	}
+
+	/*!
+	 *  Reacts to an event with the lock already held. Query events only run their const react.
+	 */
+	template<typename E>
+	void processLocked(E &evt, std::false_type)
+	{
+		processEvent(evt);
+	}
+
+	template<typename E>
+	void processLocked(E &evt, std::true_type)
+	{
+		static_cast<const BASE &>(*_currentState).react(evt);
+	}
+
+	/*!
+	 *  Called by processEvent() under the lock before the current state reacts to an event,
+	 *  if _eventHooks is set. Query events, which cannot change the state, are not passed.
+	 *
+	 *      @param [in] evt The event, of the type identified by eventType
+	 *      @param [in] eventType The ID of the type of the event, see internal::eventTypeId()
+	 */
+	virtual void beforeEvent(const void *evt, uint32_t eventType)
+	{
+		(void)evt;
+		(void)eventType;
+	}
+
+	/*!
+	 *  Called by processEvent() under the lock once an event and the transitions it caused
+	 *  are handled, if _eventHooks is set.
+	 */
+	virtual void afterEvent()
+	{
+	}
+
+	/*!
+	 *  Descendants overriding beforeEvent() and afterEvent() call this to have them called.
+	 *  Hooks see every event, so ignored events are no longer skipped. Call it under the lock.
+	 *
+	 *      @param [in] enabled Whether processEvent() calls the hooks
+	 */
+	void setEventHooks(bool enabled)
+	{
+		_eventHooks = enabled;
+		cacheIgnoredEvents();
+	}
+
+	/*!
+	 *  Publish the mask of ignored events of the current state for accepts()
+	 */
+	void cacheIgnoredEvents()
+	{
+		_ignoredEvents.store(_currentState && !_eventHooks ? _currentState->ignoredEvents() : 0, std::memory_order_relaxed);
+	}
+
+	/*!
+	 *  Send a regular event under the exclusive lock, unless the current state ignores it
+	 */
+	template<typename E>
+	void dispatchEvent(E &evt, std::false_type)
+	{
+		if (!accepts<E>())
 		{
-			// This upcast is safe because of the static assert in this class
+			return;
+		}
+		lock();
+		internal::ASSERT(_currentState.get(), L"You did not call \"initialize(new MyInitialState(...));\" in your constructor!");
+		processEvent(evt);
+		unlock();
+	}
+
+	/*!
+	 *  Send a query event under the shared lock. The const react cannot change state.
+	 */
+	template<typename E>
+	void dispatchEvent(E &evt, std::true_type)
+	{
+		lockShared();
+		internal::ASSERT(_currentState.get(), L"You did not call \"initialize(new MyInitialState(...));\" in your constructor!");
+		processLocked(evt, std::true_type());
+		unlockShared();
+	}
+
+	/*!
+	 *  Changes state for as long as the current state registers a next state.
+	 *  The observer, if any, is notified once for all of them.
+	 */
+	void processTransitions()
+	{
+		if (!_currentState->getNextState())
+		{
+			return;
+		}
+		const StateId from = _observer ? _currentState->getStateId() : 0;
+		while (_currentState->getNextState())
+		{
+			// This cast is safe because of the static assert at the top of this class
 			setCurrentState(static_cast<BASE*>(_currentState->getNextState()));
 		}
+		if (_observer)
+		{
+			_observer->onTransition(*this, from, _currentState->getStateId());
+		}
+	}
+
+	/*!
+	 *  Makes this state machine a deep copy of another. The current state, nested states
+	 *  included, is recreated and the pimpl is copied, without calling exit or entry.
+	 *  Call this in the copy constructor of your state machine instead of sharing states.
+	 *  The pimpl needs to opt in with IsCopyablePimpl. The prototype should not be
+	 *  receiving events while it is cloned.
+	 *
+	 *      @param [in] prototype The initialized state machine to copy
+	 */
+	void cloneFrom(const FiniteStateMachine &prototype)
+	{
+		internal::ASSERT(prototype._currentState.get(), L"Cannot clone a state machine that is not initialized!");
+		BASE *state = internal::StateCloner<BASE, void>::clone(*prototype._currentState);
+		lock();
+		replaceState(std::shared_ptr<BASE>(state));
 		unlock();
 	}
 
+	/*!
+	 *  Replaces the current state without calling exit or entry, such as to restore a
+	 *  saved state. Every swap of the state outside of transitions goes through here,
+	 *  so that the events ignored by the state stay in sync. Call it under the lock.
+	 *
+	 *      @param [in] state The new current state, or nullptr
+	 */
+	void replaceState(std::shared_ptr<BASE> state)
+	{
+		if (_currentState && _currentState != state)
+		{
+			_currentState->discardNestedState(); // Or its destructor would call exit on the nested state
+		}
+		_currentState = std::move(state);
+		cacheIgnoredEvents();
+		if (_currentState)
+		{
+			adoptState(*_currentState);
+		}
+	}
+
+	/*!
+	 *  Called by replaceState() for a state built outside of a transition, such as a clone
+	 *  or a restored snapshot, so that descendants can set it up as initialize() would.
+	 *
+	 *      @param [in,out] state The new current state
+	 */
+	virtual void adoptState(BASE &state)
+	{
+		(void)state;
+	}
+
 	/*!
 	 *  Sets the finite state machine's current state.
 	 *  Also perform the state transition and call internal events
@@ -427,18 +1245,23 @@ protected:
 		{
 			OnExit exit;
 			_currentState->react(exit);
+			POCKET_FSM_PROBE(state_exit, this, _currentState->_name);
 		}
 
 		if (nextState)
 		{
+			POCKET_FSM_PROBE(transition_start, this, _currentState ? _currentState->_name : nullptr, nextState->_name);
 			_currentState.reset(nextState); // old state destructor calls onTransition, hands off pimpl and gets deleted
+			POCKET_FSM_PROBE(transition_end, this, _currentState->_name);
 			OnEntry entry;
 			_currentState->react(entry);
+			POCKET_FSM_PROBE(state_entry, this, _currentState->_name);
 		}
 		else
 		{
 			_currentState.reset();
 		}
+		cacheIgnoredEvents();
 	}
 
 	/*!
@@ -458,12 +1281,42 @@ protected:
 	virtual void lock() {};
 	virtual void unlock() {};
 
+	/*!
+	 * Override these functions with the shared mode of your lock mechanism
+	 *  to run query events concurrently. By default, queries take the exclusive lock.
+	 */
+	virtual void lockShared()
+	{
+		lock();
+	}
+
+	virtual void unlockShared()
+	{
+		unlock();
+	}
+
 	/*!
 	 *  The current state of the state machine.
-	 *  Shared instead of unique to enable copy ctor
-	 *  but instance should not get widespread
+	 *  Owned by this state machine only and moved along with it.
 	 */
 	std::shared_ptr<BASE> _currentState = nullptr;
+
+	/*!
+	 *  Notified of transitions, if set.
+	 */
+	TransitionObserver<BASE> *_observer = nullptr;
+
+	/*!
+	 *  The IgnoredEvents the current concrete state ignores, read without locking by sendEvent.
+	 *  Empty while event hooks are set.
+	 */
+	std::atomic<uint64_t> _ignoredEvents{ 0 };
+
+	/*!
+	 *  Whether processEvent() calls beforeEvent() and afterEvent(). Set by the descendants
+	 *  overriding them, through setEventHooks().
+	 */
+	bool _eventHooks = false;
 };
 
 /*!
@@ -508,6 +1361,7 @@ public:
 	{
 		static_assert(!std::is_same<E, OnEntry>::value && !std::is_same<E, OnExit>::value, "Cannot send an internal event");
 		internal::ASSERT(FSM::_currentState.get(), L"You did not call \"initialize(new MyInitialState(...));\" in your constructor!");
+		POCKET_FSM_PROBE(send_event_entry, static_cast<FSM *>(this), uint32_t(std::integral_constant<uint32_t, internal::eventTypeId<E>()>()), internal::eventTypeName<E>(), &evt);
 		FSM::lock();
 		FSM::_currentState.get()->react(evt);					// Call concrete state's react function
 		while (FSM::_currentState->getNextState())
@@ -525,8 +1379,302 @@ public:
 			}
 		}
 		FSM::unlock();
+		POCKET_FSM_PROBE(send_event_exit, static_cast<FSM *>(this), uint32_t(std::integral_constant<uint32_t, internal::eventTypeId<E>()>()), internal::eventTypeName<E>(), &evt);
+		return evt;
+	}
+
+	/*!
+	 *  Send a query event to the nested state machine, used by NESTED_QUERY_REACT.
+	 *  The lock of the enclosing state machine is already held in shared mode.
+	 *
+	 *      @tparam E The type of the query event
+	 *
+	 *      @param [in,out] evt The user defined object the state machine will handle
+	 *
+	 *      @return the input parameter reference
+	 */
+	template<typename E>
+	E &sendQuery(E &evt) const
+	{
+		internal::ASSERT(FSM::_currentState.get(), L"You did not call \"initialize(new MyInitialState(...));\" in your constructor!");
+		static_cast<const BASE_ROOT_STATE &>(*FSM::_currentState).react(evt);
 		return evt;
 	}
+
+	/*!
+	 *  Returns the current state of the nested state machine.
+	 *
+	 *      @return The current nested state, or nullptr if not initialized
+	 */
+	StateIF *getNestedState() const override
+	{
+		return FSM::_currentState.get();
+	}
+
+protected:
+	/*!
+	 *  Makes the given state the current nested state, without calling entry.
+	 *
+	 *      @param [in] nestedState The new nested state. Ownership is taken on success
+	 *
+	 *      @return Whether the state is a nested state of this state machine
+	 */
+	bool restoreNestedState(StateIF *nestedState) override
+	{
+		BASE_NEST_STATE *nestType = dynamic_cast<BASE_NEST_STATE*>(nestedState);
+		if (!nestType)
+		{
+			return false;
+		}
+		FSM::replaceState(std::shared_ptr<BASE_ROOT_STATE>(nestType));
+		return true;
+	}
+
+	/*!
+	 *  Drops the current nested state without calling exit, nested states included.
+	 */
+	void discardNestedState() override
+	{
+		FSM::replaceState(nullptr);
+	}
+};
+
+/*!
+ *  Constructs copies of a prototype state machine in preallocated, uninitialized storage
+ *  with the copy constructor of the machine, which should call cloneFrom().
+ *
+ *      @tparam MACHINE Your state machine type
+ *
+ *      @param [in] prototype The configured state machine to copy
+ *      @param [out] storage Uninitialized memory for count state machines
+ *      @param [in] count The number of copies
+ */
+template<class MACHINE>
+void cloneInto(const MACHINE &prototype, MACHINE *storage, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		new (storage + i) MACHINE(prototype);
+	}
+}
+
+/*!
+ *  Opt-in trait for state machines that relocateMachines() can move with a memmove.
+ *  Specialize it as std::true_type for your state machine if none of its members point
+ *  into the state machine itself. The members of FiniteStateMachine do not, but most
+ *  lock objects do. Registrations holding the address of a machine, such as in an
+ *  EventLoop, need to be updated after any relocation.
+ *
+ *  @tparam MACHINE Your state machine type
+ */
+template<class MACHINE>
+struct IsTriviallyRelocatable : std::false_type { };
+
+namespace internal
+{
+template<class MACHINE>
+void relocate(MACHINE *source, MACHINE *destination, size_t count, std::true_type)
+{
+	std::memmove(static_cast<void *>(destination), static_cast<const void *>(source), count * sizeof(MACHINE));
+}
+
+template<class MACHINE>
+void relocate(MACHINE *source, MACHINE *destination, size_t count, std::false_type)
+{
+	// Walk away from the overlap so that no source is overwritten before it is moved
+	const bool backward = destination > source;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const size_t at = backward ? count - 1 - i : i;
+		new (destination + at) MACHINE(std::move(source[at]));
+		source[at].~MACHINE();
+	}
+}
+}
+
+/*!
+ *  Moves state machines to other storage without calling exit or entry, to grow or
+ *  compact arrays of state machines. The sources are destroyed and their storage is
+ *  left uninitialized. The ranges may overlap. Machines opting in with
+ *  IsTriviallyRelocatable are moved with a single memmove, others with their move
+ *  constructor.
+ *
+ *      @tparam MACHINE Your state machine type
+ *
+ *      @param [in,out] source The state machines to move
+ *      @param [out] destination Uninitialized memory for count state machines
+ *      @param [in] count The number of state machines
+ */
+template<class MACHINE>
+void relocateMachines(MACHINE *source, MACHINE *destination, size_t count)
+{
+	if (source != destination)
+	{
+		internal::relocate(source, destination, count, IsTriviallyRelocatable<MACHINE>());
+	}
+}
+
+namespace internal
+{
+/*!
+ *  Grants the optional extension headers access to the protected members of the framework.
+ *  This is not meant to be used by state machine implementations.
+ */
+struct FrameworkAccess
+{
+	/*!
+	 *  Read the current state of a state machine. Use replaceState() to change it.
+	 */
+	template<class BASE>
+	static const std::shared_ptr<BASE> &currentState(const FiniteStateMachine<BASE> &fsm)
+	{
+		return fsm._currentState;
+	}
+
+	/*!
+	 *  Replace the current state of a state machine without calling exit or entry
+	 */
+	template<class BASE>
+	static void replaceState(FiniteStateMachine<BASE> &fsm, typename std::common_type<std::shared_ptr<BASE>>::type state)
+	{
+		fsm.replaceState(std::move(state));
+	}
+
+	template<class BASE>
+	static void lock(FiniteStateMachine<BASE> &fsm)
+	{
+		fsm.lock();
+	}
+
+	template<class BASE>
+	static void unlock(FiniteStateMachine<BASE> &fsm)
+	{
+		fsm.unlock();
+	}
+
+	template<class BASE, typename E>
+	static void processEvent(FiniteStateMachine<BASE> &fsm, E &evt)
+	{
+		fsm.processEvent(evt);
+	}
+
+#if defined(POCKET_FSM_CXX17)
+	/*!
+	 *  Send the active alternative of a variant to a state machine whose lock is held
+	 */
+	template<class BASE, typename... Es>
+	static void processEvent(FiniteStateMachine<BASE> &fsm, std::variant<Es...> &evt)
+	{
+		internal::ASSERT(!evt.valueless_by_exception(), L"Cannot send an empty variant!");
+		VariantDispatcher<BASE, std::variant<Es...>, std::index_sequence_for<Es...>>::dispatch(fsm, evt);
+	}
+#endif
+
+	/*!
+	 *  Call entry on a current state installed without initialize(), and perform the resulting transitions
+	 */
+	template<class BASE>
+	static void enter(FiniteStateMachine<BASE> &fsm)
+	{
+		OnEntry entry;
+		fsm._currentState->react(entry);
+		POCKET_FSM_PROBE(state_entry, &fsm, fsm._currentState->_name);
+		fsm.processTransitions();
+	}
+
+	static bool restoreNestedState(StateIF &state, StateIF *nestedState)
+	{
+		return state.restoreNestedState(nestedState);
+	}
+
+	static void discardNestedState(StateIF &state)
+	{
+		state.discardNestedState();
+	}
+
+	template<typename Pimpl>
+	static std::shared_ptr<PimplBase> &pimpl(StatePimplIF<Pimpl> &state)
+	{
+		return state._pimpl;
+	}
+
+	/*!
+	 *  Give a state the pimpl of another, if their base state has one
+	 */
+	template<typename Pimpl>
+	static void sharePimpl(StatePimplIF<Pimpl> &state, StatePimplIF<Pimpl> &from)
+	{
+		state._pimpl = from._pimpl;
+	}
+
+	static void sharePimpl(StateIF &, StateIF &) {}
+
+	/*!
+	 *  The pimpl type of a state, or void if it derives from StateIF directly
+	 */
+	template<typename Pimpl>
+	static Pimpl pimplTypeOf(StatePimplIF<Pimpl> *);
+	static void pimplTypeOf(StateIF *);
+
+	template<class STATE>
+	using PimplOf = decltype(pimplTypeOf(static_cast<STATE *>(nullptr)));
 };
 
+/*!
+ *  Copies the pimpl of the prototype state, if any, and the state path from there down
+ */
+template<class BASE, class PIMPL>
+struct StateCloner
+{
+	static_assert(IsCopyablePimpl<PIMPL>::value, "Specialize pocket_fsm::IsCopyablePimpl as std::true_type for your pimpl to clone its state machine");
+
+	static std::shared_ptr<PimplBase> clonePimpl(BASE &prototype)
+	{
+		return std::make_shared<PIMPL>(*static_cast<PIMPL *>(FrameworkAccess::pimpl(prototype).get()));
+	}
+
+	static void attach(BASE &state, const std::shared_ptr<PimplBase> &pimpl)
+	{
+		FrameworkAccess::pimpl(state) = pimpl;
+	}
+};
+
+template<class BASE>
+struct StateCloner<BASE, void>
+{
+	/*!
+	 *  Entry point : dispatches on the pimpl type of BASE
+	 */
+	static BASE *clone(BASE &prototype)
+	{
+		using Cloner = typename std::conditional<std::is_void<FrameworkAccess::PimplOf<BASE>>::value,
+			StateCloner<BASE, void>, StateCloner<BASE, FrameworkAccess::PimplOf<BASE>>>::type;
+		std::shared_ptr<PimplBase> pimpl = Cloner::clonePimpl(prototype);
+
+		BASE *state = static_cast<BASE *>(prototype.newInstance());
+		ASSERT(state, L"Only concrete states using the CONCRETE_STATE macro can be cloned!");
+		Cloner::attach(*state, pimpl);
+
+		// Nested states derive from the root base state and share the pimpl
+		BASE *parent = state;
+		for (const StateIF *nested = prototype.getNestedState(); nested; nested = nested->getNestedState())
+		{
+			BASE *copy = static_cast<BASE *>(nested->newInstance());
+			ASSERT(copy, L"Only concrete states using the CONCRETE_STATE macro can be cloned!");
+			Cloner::attach(*copy, pimpl);
+			FrameworkAccess::restoreNestedState(*parent, copy);
+			parent = copy;
+		}
+		return state;
+	}
+
+	static std::shared_ptr<PimplBase> clonePimpl(BASE &)
+	{
+		return nullptr;
+	}
+
+	static void attach(BASE &, const std::shared_ptr<PimplBase> &) {}
+};
+}
+
 } // End of namespace
@@ -0,0 +1,303 @@
+/*!
+ *  @file pocket_fsm_arena.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: bulk construction of state machines in an arena.
+ *  N state machines, their initial states, their pimpls and the control blocks of their
+ *  shared pointers are carved out of a single allocation. Entry of the initial states
+ *  can run right away, on first use of each machine, or in parallel across threads.
+ *  Requires C++17.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <algorithm>         // std::min
+#include <atomic>            // std::atomic
+#include <cstddef>           // std::max_align_t
+#include <memory_resource>   // std::pmr::monotonic_buffer_resource
+#include <thread>            // std::thread
+#include <vector>            // std::vector
+
+#if !defined(POCKET_FSM_CXX17)
+#error "pocket_fsm_arena.h requires C++17"
+#endif
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. Give your state machine a constructor that does not call initialize(), usually its
+	default constructor.
+2. Create a MachineArena<Machine, InitialState> with the number of machines and a
+	function returning the pimpl of the machine at an index. Without a pimpl, or with
+	a default constructed one, the function can be omitted.
+3. Choose when the initial states are entered :
+	- EntryPolicy::Immediate enters each machine as it is constructed.
+	- EntryPolicy::Deferred enters each machine the first time it is accessed with
+		operator[], which costs an atomic load on every access.
+	- EntryPolicy::Parallel enters all the machines on several threads after construction.
+4. Access the machines with operator[]. They live as long as the arena.
+
+Machines of an arena must not be moved out of it : their states and pimpls are in the
+arena, and freed with it. States entered after the initial one are allocated as usual.
+A deferred machine that was never accessed is destroyed without calling exit.
+
+************************************************************************************/
+
+/*!
+ *  When the initial states of the machines of an arena are entered
+ */
+enum class EntryPolicy : uint8_t
+{
+	Immediate, // During construction, in order
+	Deferred,  // On first access with operator[]
+	Parallel,  // After construction, on several threads
+};
+
+namespace internal
+{
+/*!
+ *  Deleter of objects placed in an arena : their memory is released with the arena
+ */
+template<class T>
+struct ArenaDestroy
+{
+	void operator()(T *object) const
+	{
+		object->~T();
+	}
+};
+
+/*!
+ *  Pimpl factory of arenas without a factory : default constructs the pimpl, if any
+ */
+struct DefaultPimplFactory
+{
+};
+
+/*!
+ *  An estimate of the control block of a shared_ptr with a deleter and an allocator :
+ *  a vtable pointer, the use and weak counts, the pointer and the allocator
+ */
+constexpr size_t ARENA_CONTROL_BLOCK = 4 * sizeof(void *) + 2 * sizeof(int);
+
+constexpr size_t arenaAligned(size_t size)
+{
+	return (size + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+}
+}
+
+/*!
+ *  A fixed number of state machines constructed in bulk in a single allocation
+ *
+ *      @tparam MACHINE Your state machine type, with a constructor not calling initialize()
+ *      @tparam INITIAL The initial state of the machines
+ */
+template<class MACHINE, class INITIAL>
+class MachineArena
+{
+	using Access = internal::FrameworkAccess;
+	using StatePtr = typename std::decay<decltype(Access::currentState(std::declval<MACHINE &>()))>::type;
+	using Base = typename StatePtr::element_type;
+	using Pimpl = Access::PimplOf<INITIAL>;
+	using Allocator = std::pmr::polymorphic_allocator<char>;
+
+	static_assert(std::is_base_of<Base, INITIAL>::value, "The initial state needs to be a descendant of the base state of the machine");
+
+public:
+	/*!
+	 *  Constructor, for machines without a pimpl or with a default constructed one
+	 *
+	 *      @param [in] count The number of machines
+	 *      @param [in] entry When the initial states are entered
+	 *      @param [in] threads The number of threads of EntryPolicy::Parallel, or 0 for one per core
+	 */
+	explicit MachineArena(size_t count, EntryPolicy entry = EntryPolicy::Immediate, unsigned threads = 0)
+		: MachineArena(count, internal::DefaultPimplFactory(), entry, threads)
+	{
+	}
+
+	/*!
+	 *  Constructor
+	 *
+	 *      @tparam FACTORY A function returning the pimpl of the machine at an index, by value
+	 *
+	 *      @param [in] count The number of machines
+	 *      @param [in] makePimpl Called once per machine, in order, with the index of the machine
+	 *      @param [in] entry When the initial states are entered
+	 *      @param [in] threads The number of threads of EntryPolicy::Parallel, or 0 for one per core
+	 */
+	template<class FACTORY>
+	MachineArena(size_t count, FACTORY makePimpl, EntryPolicy entry = EntryPolicy::Immediate, unsigned threads = 0)
+		: _resource(estimate(count, entry))
+		, _count(count)
+		, _entry(entry)
+	{
+		_machines = static_cast<MACHINE *>(_resource.allocate(count * sizeof(MACHINE), alignof(MACHINE)));
+		if (entry == EntryPolicy::Deferred)
+		{
+			_entered = static_cast<std::atomic<bool> *>(_resource.allocate(count * sizeof(std::atomic<bool>), alignof(std::atomic<bool>)));
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			MACHINE *machine = ::new (_machines + i) MACHINE();
+			internal::ASSERT(!Access::currentState(*machine), L"The machines of an arena should not call initialize() in their constructor!");
+			Access::replaceState(*machine, StatePtr(create(makePimpl, i), internal::ArenaDestroy<Base>(), Allocator(&_resource)));
+			if (entry == EntryPolicy::Immediate)
+			{
+				enter(*machine);
+			}
+			else if (entry == EntryPolicy::Deferred)
+			{
+				::new (_entered + i) std::atomic<bool>(false);
+			}
+		}
+		if (entry == EntryPolicy::Parallel)
+		{
+			enterParallel(threads);
+		}
+	}
+
+	MachineArena(const MachineArena &) = delete;
+
+	/*!
+	 *  Destructor. Destroys the machines, calling exit on those that were entered.
+	 */
+	~MachineArena()
+	{
+		for (size_t i = 0; i < _count; ++i)
+		{
+			if (_entered && !_entered[i].load(std::memory_order_relaxed))
+			{
+				Access::replaceState(_machines[i], nullptr); // Never entered : no exit either
+			}
+			_machines[i].~MACHINE();
+		}
+	}
+
+	/*!
+	 *  Access a machine, entering its initial state first if entry was deferred and it was
+	 *  never accessed. Thread safe, if the machine overrides lock() and unlock().
+	 *
+	 *      @param [in] index The index of the machine
+	 *
+	 *      @return The machine
+	 */
+	MACHINE &operator[](size_t index)
+	{
+		internal::ASSERT(index < _count, L"Index of machine out of the arena!");
+		if (_entered && !_entered[index].load(std::memory_order_acquire))
+		{
+			Access::lock(_machines[index]);
+			if (!_entered[index].load(std::memory_order_relaxed))
+			{
+				Access::enter(_machines[index]);
+				_entered[index].store(true, std::memory_order_release);
+			}
+			Access::unlock(_machines[index]);
+		}
+		return _machines[index];
+	}
+
+	inline size_t size() const
+	{
+		return _count;
+	}
+
+	inline EntryPolicy entryPolicy() const
+	{
+		return _entry;
+	}
+
+private:
+	/*!
+	 *  Size of the single allocation holding everything, if the control block estimate holds.
+	 *  If it does not, the arena makes further allocations.
+	 */
+	static size_t estimate(size_t count, EntryPolicy entry)
+	{
+		size_t perMachine = internal::arenaAligned(sizeof(MACHINE)) + internal::arenaAligned(sizeof(INITIAL)) + internal::arenaAligned(internal::ARENA_CONTROL_BLOCK);
+		if constexpr (!std::is_void<Pimpl>::value)
+		{
+			perMachine += internal::arenaAligned(sizeof(Pimpl)) + internal::arenaAligned(internal::ARENA_CONTROL_BLOCK);
+		}
+		if (entry == EntryPolicy::Deferred)
+		{
+			perMachine += sizeof(std::atomic<bool>);
+		}
+		return count * perMachine + alignof(std::max_align_t);
+	}
+
+	/*!
+	 *  Construct the initial state and the pimpl of a machine in the arena
+	 */
+	template<class FACTORY>
+	INITIAL *create(FACTORY &makePimpl, size_t index)
+	{
+		INITIAL *state = ::new (_resource.allocate(sizeof(INITIAL), alignof(INITIAL))) INITIAL();
+		if constexpr (!std::is_void<Pimpl>::value)
+		{
+			void *storage = _resource.allocate(sizeof(Pimpl), alignof(Pimpl));
+			Pimpl *pimpl;
+			if constexpr (std::is_same<FACTORY, internal::DefaultPimplFactory>::value)
+			{
+				pimpl = ::new (storage) Pimpl();
+			}
+			else
+			{
+				pimpl = ::new (storage) Pimpl(makePimpl(index));
+			}
+			Access::pimpl(*state) = std::shared_ptr<PimplBase>(pimpl, internal::ArenaDestroy<Pimpl>(), Allocator(&_resource));
+		}
+		else
+		{
+			(void)makePimpl;
+			(void)index;
+		}
+		return state;
+	}
+
+	static void enter(MACHINE &machine)
+	{
+		Access::lock(machine);
+		Access::enter(machine);
+		Access::unlock(machine);
+	}
+
+	void enterParallel(unsigned threads)
+	{
+		if (threads == 0)
+		{
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		const size_t chunk = (_count + threads - 1) / threads;
+		std::vector<std::thread> workers;
+		for (size_t begin = 0; begin < _count; begin += chunk)
+		{
+			const size_t end = std::min(_count, begin + chunk);
+			workers.emplace_back([this, begin, end]()
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					enter(_machines[i]);
+				}
+			});
+		}
+		for (std::thread &worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	std::pmr::monotonic_buffer_resource _resource; // Deallocations are no-ops until the arena is destroyed
+	const size_t _count;
+	const EntryPolicy _entry;
+	MACHINE *_machines = nullptr;
+	std::atomic<bool> *_entered = nullptr; // Only for deferred entry
+};
+
+} // End of namespace
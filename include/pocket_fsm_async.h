@@ -0,0 +1,398 @@
+/*!
+ *  @file pocket_fsm_async.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: asynchronous reactions.
+ *  A react can start slow work on an executor and return right away. When the work
+ *  completes, a Completion<T> event is sent back to the same state machine.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <algorithm>          // std::max
+#include <atomic>             // std::atomic_bool
+#include <condition_variable> // std::condition_variable
+#include <deque>              // std::deque
+#include <exception>          // std::exception_ptr
+#include <functional>         // std::function
+#include <mutex>              // std::mutex
+#include <thread>             // std::thread
+#include <utility>            // std::declval
+#include <vector>             // std::vector
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. Derive your base state from AsyncState<BaseState, StateIF or StatePimplIF<Pimpl>>
+	instead of StateIF or StatePimplIF<Pimpl> directly.
+2. Declare REACT(Completion<T>) in your base state for each result type T.
+3. Derive your state machine from AsyncStateMachine<BaseState> and optionally pass
+	an executor to its constructor, such as the executor() of your own AsyncThreadPool.
+	By default, the work runs on a pool of one thread per core shared by the process.
+	If you override lock() and unlock(), call stopAsync() in your destructor.
+4. In any react, call startAsync([](const CancelToken &token) { ... return T; });
+	The work runs on the executor and its result is sent back as a Completion<T>.
+
+Pending work is cancelled when the state that started it exits: its completion will
+not be delivered, and the work can poll the token to stop early. Work started from a
+react that also calls changeState is therefore cancelled as soon as it is started.
+States installed without a transition, by cloneFrom(), a snapshot, a mapped record or
+an arena, can start work as well.
+
+************************************************************************************/
+
+/*!
+ *  The event sent back to the state machine when asynchronous work completes.
+ *  Use a distinct result type for each kind of work to tell the completions apart.
+ *
+ *  @tparam T The type returned by the asynchronous work
+ */
+template<typename T>
+struct Completion
+{
+	T result = T();
+	std::exception_ptr error = nullptr; // Set if the work threw
+
+	/*!
+	 *  Access the result, rethrowing the exception raised by the work if any
+	 *
+	 *      @return The result of the work
+	 */
+	T &get()
+	{
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+		return result;
+	}
+};
+
+/*!
+ *  A function that runs jobs asynchronously, such as posting to a thread pool.
+ *  It must not run the job inline in the calling thread.
+ */
+using Executor = std::function<void(std::function<void()>)>;
+
+/*!
+ *  A fixed number of threads running jobs in the order they are posted.
+ *  Work that blocks holds its thread : size the pool for the work it runs.
+ */
+class AsyncThreadPool
+{
+public:
+	/*!
+	 *  Constructor. Starts the threads.
+	 *
+	 *      @param [in] threads The number of threads, or 0 for one per core
+	 */
+	explicit AsyncThreadPool(unsigned threads = 0)
+	{
+		if (threads == 0)
+		{
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		_threads.reserve(threads);
+		for (unsigned i = 0; i < threads; ++i)
+		{
+			_threads.emplace_back(&AsyncThreadPool::run, this);
+		}
+	}
+
+	AsyncThreadPool(const AsyncThreadPool &) = delete;
+
+	/*!
+	 *  Destructor. Drops the jobs not started yet and waits for the running ones.
+	 */
+	~AsyncThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			_running = false;
+			_jobs.clear();
+		}
+		_wake.notify_all();
+		for (std::thread &thread : _threads)
+		{
+			thread.join();
+		}
+	}
+
+	/*!
+	 *  Queue a job for the next free thread
+	 */
+	void post(std::function<void()> job)
+	{
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			_jobs.push_back(std::move(job));
+		}
+		_wake.notify_one();
+	}
+
+	/*!
+	 *  An executor posting to this pool, which needs to outlive the state machines using it
+	 */
+	Executor executor()
+	{
+		return [this](std::function<void()> job) { post(std::move(job)); };
+	}
+
+private:
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		for (;;)
+		{
+			_wake.wait(lock, [this]() { return !_running || !_jobs.empty(); });
+			if (!_running)
+			{
+				return;
+			}
+			std::function<void()> job = std::move(_jobs.front());
+			_jobs.pop_front();
+			lock.unlock();
+			job();
+			lock.lock();
+		}
+	}
+
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::deque<std::function<void()>> _jobs;
+	bool _running = true;
+	std::vector<std::thread> _threads;
+};
+
+/*!
+ *  The default executor posts to a pool of one thread per core, shared by the process
+ */
+inline void sharedPoolExecutor(std::function<void()> job)
+{
+	static AsyncThreadPool pool;
+	pool.post(std::move(job));
+}
+
+/*!
+ *  Handed to asynchronous work so it can stop early once the state that started it exited.
+ */
+class CancelToken
+{
+public:
+	explicit CancelToken(std::shared_ptr<std::atomic_bool> flag)
+		: _flag(std::move(flag))
+	{}
+
+	inline bool isCancelled() const
+	{
+		return _flag->load(std::memory_order_acquire);
+	}
+
+private:
+	std::shared_ptr<std::atomic_bool> _flag;
+};
+
+template<class BASE>
+class AsyncStateMachine;
+
+namespace internal
+{
+/*!
+ *  Shared between a state machine and its pending work. Completions use it to
+ *  safely find the machine, which clears the pointer when it is destroyed.
+ */
+template<class BASE>
+struct AsyncContext
+{
+	std::mutex mutex;
+	AsyncStateMachine<BASE> *machine = nullptr;
+	Executor executor;
+};
+
+/*!
+ *  Identifies descendants of AsyncState
+ */
+struct AsyncStateTag { };
+}
+
+/*!
+ *  Base state mixin that enables the startAsync() function in reacts.
+ *  The context of the state machine is handed off to the next state alongside the pimpl.
+ *
+ *  @tparam BASENAME Your base state class deriving from this one
+ *  @tparam STATE_IF Either StateIF or StatePimplIF<Pimpl>
+ */
+template<class BASENAME, class STATE_IF>
+class AsyncState : public STATE_IF, public internal::AsyncStateTag
+{
+	static_assert(std::is_base_of<StateIF, STATE_IF>::value, "The second parameter of AsyncState needs to be StateIF or StatePimplIF");
+	friend class AsyncStateMachine<BASENAME>;
+
+public:
+	AsyncState() = default;
+	AsyncState(AsyncState &s) = delete;
+
+	/*!
+	 *  Destructor. Cancel the work started by this state and hand off the context.
+	 */
+	virtual ~AsyncState()
+	{
+		if (_cancelled)
+		{
+			_cancelled->store(true, std::memory_order_release);
+		}
+
+		if (StateIF::_nextState)
+		{
+			// downcast is safe because changeState only creates descendants of BASENAME
+			static_cast<AsyncState*>(StateIF::_nextState)->_async = _async;
+		}
+	}
+
+protected:
+	/*!
+	 *  Start work on the state machine's executor. Its return value is sent back
+	 *  to the state machine as a Completion<T> unless this state has exited by then.
+	 *
+	 *      @tparam WORK A callable with the signature T(const CancelToken &)
+	 *
+	 *      @param [in] work The slow operation to run asynchronously
+	 */
+	template<typename WORK>
+	void startAsync(WORK work)
+	{
+		using T = decltype(work(std::declval<const CancelToken &>()));
+		internal::ASSERT(_async.get(), L"This state was not created by an AsyncStateMachine!");
+		if (!_cancelled)
+		{
+			_cancelled = std::make_shared<std::atomic_bool>(false);
+		}
+
+		std::shared_ptr<internal::AsyncContext<BASENAME>> context = _async;
+		CancelToken token(_cancelled);
+		context->executor([context, token, work]() mutable
+		{
+			Completion<T> completion;
+			try
+			{
+				completion.result = work(token);
+			}
+			catch (...)
+			{
+				completion.error = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> guard(context->mutex);
+			if (context->machine)
+			{
+				context->machine->deliver(completion, token);
+			}
+		});
+	}
+
+private:
+	/*!
+	 *  Context of the owning state machine
+	 */
+	std::shared_ptr<internal::AsyncContext<BASENAME>> _async = nullptr;
+
+	/*!
+	 *  Cancellation flag shared with the work started by this state, created on first use
+	 */
+	std::shared_ptr<std::atomic_bool> _cancelled = nullptr;
+};
+
+/*!
+ *  A FiniteStateMachine whose states can start asynchronous work.
+ *
+ *      @tparam BASE The name of your base state, deriving from AsyncState<BASE, ...>
+ */
+template<class BASE>
+class AsyncStateMachine : public FiniteStateMachine<BASE>
+{
+	static_assert(std::is_base_of<internal::AsyncStateTag, BASE>::value, "The parameter of AsyncStateMachine needs to be a descendant of AsyncState");
+	template<class, class> friend class AsyncState;
+
+protected:
+	using FSM = FiniteStateMachine<BASE>;
+
+public:
+	/*!
+	 *  Constructor.
+	 *
+	 *      @param [in] executor Runs the asynchronous work of the states
+	 */
+	AsyncStateMachine(Executor executor = sharedPoolExecutor)
+		: _async(std::make_shared<internal::AsyncContext<BASE>>())
+	{
+		_async->machine = this;
+		_async->executor = std::move(executor);
+	}
+
+	/*!
+	 *  Destructor. Pending completions are dropped from now on.
+	 */
+	virtual ~AsyncStateMachine()
+	{
+		stopAsync();
+	}
+
+protected:
+	/*!
+	 *  Drop all pending completions, waiting for the one being delivered if any.
+	 *  Call this in your destructor if you override lock() and unlock(): deliveries
+	 *  use them and your lock would otherwise be destroyed before this base class.
+	 */
+	void stopAsync()
+	{
+		std::lock_guard<std::mutex> guard(_async->mutex);
+		_async->machine = nullptr;
+	}
+
+	/*!
+	 *  Hand the asynchronous context to the initial state, then initialize.
+	 *
+	 *      @param [in,out] newInitialState
+	 */
+	void initialize(BASE *newInitialState)
+	{
+		internal::ASSERT(newInitialState, L"Need to pass an initial state to the initialize function.");
+		newInitialState->_async = _async;
+		FSM::initialize(newInitialState);
+	}
+
+	/*!
+	 *  Hand the asynchronous context to states installed without a transition
+	 *
+	 *      @param [in,out] state The new current state
+	 */
+	void adoptState(BASE &state) override
+	{
+		state._async = _async;
+	}
+
+private:
+	/*!
+	 *  Send a completion to the current state unless the state that started the work has exited.
+	 *  The token is checked under the machine lock so no transition can slip in between.
+	 */
+	template<typename T>
+	void deliver(Completion<T> &completion, const CancelToken &token)
+	{
+		this->lock();
+		if (!token.isCancelled())
+		{
+			FSM::processEvent(completion);
+		}
+		this->unlock();
+	}
+
+	std::shared_ptr<internal::AsyncContext<BASE>> _async;
+};
+
+} // End of namespace
@@ -0,0 +1,332 @@
+/*!
+ *  @file pocket_fsm_bus.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: state change bus for views.
+ *  State machines publish their transitions to the bus, which forwards them to each
+ *  subscriber through a lock free channel. Between two drains, the notifications of a
+ *  machine are coalesced : a slow view only sees where each machine went from its last
+ *  drain, instead of a backlog.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <algorithm>  // std::min
+#include <atomic>     // std::atomic
+#include <memory>     // std::unique_ptr
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. Create a StateChangeBus<BaseState> that outlives your state machines, and attach
+	it to each of them with machine.setObserver(&bus).
+2. Each view calls subscribe() once to get its Subscriber, with the number of
+	machines it may track.
+3. The view thread calls drain(callback) periodically. The callback receives each
+	machine that changed state since the last drain, the state the view last saw it
+	in, and its latest state.
+
+Transitions are published from the threads sending events. Each Subscriber is drained
+by a single thread. A machine that comes back to the state the view last saw is not
+reported. Machines are identified by address and beyond the capacity of a subscriber,
+their notifications are dropped and counted. A machine moved to another address keeps
+its observer and is reported as a new machine, while its old address stays tracked.
+
+************************************************************************************/
+
+/*!
+ *  The coalesced notifications of one view
+ *
+ *      @tparam BASE The base state of the observed state machines
+ */
+template<class BASE>
+class Subscriber
+{
+public:
+	using Machine = FiniteStateMachine<BASE>;
+
+	/*!
+	 *  Constructor
+	 *
+	 *      @param [in] capacity The number of machines tracked, rounded up to a power of 2
+	 */
+	explicit Subscriber(size_t capacity)
+	{
+		size_t size = 1;
+		while (size < capacity * 2) // Keep the table at most half full
+		{
+			size *= 2;
+		}
+		_mask = size - 1;
+		_slots.reset(new Slot[size]);
+		_queue.reset(new Cell[size]);
+		for (size_t i = 0; i < size; ++i)
+		{
+			_queue[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	Subscriber(const Subscriber &) = delete;
+
+	/*!
+	 *  Call a function for each machine that changed state since the last drain.
+	 *  Only one thread may drain a subscriber.
+	 *
+	 *      @param [in] callback void(const Machine *machine, StateId from, StateId to)
+	 *
+	 *      @return The number of notifications delivered
+	 */
+	template<typename CALLBACK>
+	size_t drain(CALLBACK &&callback)
+	{
+		size_t delivered = 0;
+		uint32_t index;
+		while (pop(index))
+		{
+			Slot &slot = _slots[index];
+			// Clear first : a transition published after this point queues the slot again
+			slot.dirty.exchange(false, std::memory_order_acq_rel);
+			const StateId to = slot.latest.load(std::memory_order_acquire);
+			if (!slot.seen)
+			{
+				slot.last = slot.first.load(std::memory_order_relaxed);
+				slot.seen = true;
+			}
+			if (to != slot.last)
+			{
+				callback(slot.machine.load(std::memory_order_acquire), slot.last, to);
+				slot.last = to;
+				++delivered;
+			}
+		}
+		return delivered;
+	}
+
+	/*!
+	 *  Stop receiving notifications. The subscriber stays valid until the bus is destroyed.
+	 */
+	void close()
+	{
+		_open.store(false, std::memory_order_release);
+	}
+
+	inline bool isOpen() const
+	{
+		return _open.load(std::memory_order_acquire);
+	}
+
+	/*!
+	 *  The number of notifications dropped because too many machines were tracked
+	 */
+	inline uint64_t dropped() const
+	{
+		return _dropped.load(std::memory_order_relaxed);
+	}
+
+	/*!
+	 *  Record a transition. Transitions of the same machine are never published concurrently,
+	 *  since they happen under its lock.
+	 */
+	void publish(const Machine &machine, StateId from, StateId to)
+	{
+		bool inserted = false;
+		Slot *slot = find(machine, inserted);
+		if (!slot)
+		{
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		if (inserted)
+		{
+			slot->first.store(from, std::memory_order_relaxed);
+		}
+		slot->latest.store(to, std::memory_order_relaxed);
+		if (!slot->dirty.exchange(true, std::memory_order_acq_rel))
+		{
+			push(uint32_t(slot - _slots.get()));
+		}
+	}
+
+private:
+	/*!
+	 *  The notifications of one machine. Written by the thread holding the machine lock,
+	 *  except for the fields of the draining thread.
+	 */
+	struct alignas(64) Slot
+	{
+		std::atomic<const Machine *> machine = { nullptr };
+		std::atomic<StateId> first = { 0 };  // The state before the first transition
+		std::atomic<StateId> latest = { 0 };
+		std::atomic<bool> dirty = { false }; // Queued and not drained yet
+		StateId last = 0;                    // Draining thread : the state last delivered
+		bool seen = false;                   // Draining thread : whether last is set
+	};
+
+	/*!
+	 *  A cell of the bounded multiple producer queue of dirty slots
+	 */
+	struct Cell
+	{
+		std::atomic<size_t> sequence = { 0 };
+		uint32_t index = 0;
+	};
+
+	/*!
+	 *  Open addressing on the address of the machine. Slots are never freed.
+	 */
+	Slot *find(const Machine &machine, bool &inserted)
+	{
+		size_t i = (reinterpret_cast<uintptr_t>(&machine) >> 4) * 0x9E3779B97F4A7C15ull >> 20;
+		for (size_t probe = 0; probe <= _mask; ++probe, ++i)
+		{
+			Slot &slot = _slots[i & _mask];
+			const Machine *key = slot.machine.load(std::memory_order_acquire);
+			if (key == &machine)
+			{
+				return &slot;
+			}
+			if (!key)
+			{
+				if (slot.machine.compare_exchange_strong(key, &machine, std::memory_order_acq_rel))
+				{
+					inserted = true;
+					return &slot;
+				}
+				if (key == &machine)
+				{
+					return &slot;
+				}
+			}
+			if (probe * 2 > _mask)
+			{
+				break; // Past half of the table : too many machines
+			}
+		}
+		return nullptr;
+	}
+
+	/*!
+	 *  Bounded queue with a sequence per cell. It never fills up since a slot is queued
+	 *  at most once and there are as many cells as slots.
+	 */
+	void push(uint32_t index)
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell &cell = _queue[tail & _mask];
+			const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			if (sequence == tail)
+			{
+				if (_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+				{
+					cell.index = index;
+					cell.sequence.store(tail + 1, std::memory_order_release);
+					return;
+				}
+			}
+			else
+			{
+				tail = _tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool pop(uint32_t &index)
+	{
+		Cell &cell = _queue[_head & _mask];
+		if (cell.sequence.load(std::memory_order_acquire) != _head + 1)
+		{
+			return false;
+		}
+		index = cell.index;
+		cell.sequence.store(_head + _mask + 1, std::memory_order_release);
+		++_head;
+		return true;
+	}
+
+	size_t _mask = 0;
+	std::unique_ptr<Slot[]> _slots;
+	std::unique_ptr<Cell[]> _queue;
+	alignas(64) std::atomic<size_t> _tail = { 0 }; // Producers
+	alignas(64) size_t _head = 0;                  // Draining thread
+	std::atomic<uint64_t> _dropped = { 0 };
+	std::atomic<bool> _open = { true };
+};
+
+/*!
+ *  Forwards the transitions of the state machines it observes to its subscribers.
+ *
+ *      @tparam BASE The base state of the observed state machines
+ */
+template<class BASE>
+class StateChangeBus : public TransitionObserver<BASE>
+{
+public:
+	/*!
+	 *  Constructor
+	 *
+	 *      @param [in] maxSubscribers The maximum number of calls to subscribe()
+	 */
+	explicit StateChangeBus(size_t maxSubscribers = 8)
+		: _maxSubscribers(maxSubscribers)
+		, _subscribers(new std::atomic<Subscriber<BASE> *>[maxSubscribers])
+		, _owned(new std::unique_ptr<Subscriber<BASE>>[maxSubscribers])
+	{
+		for (size_t i = 0; i < maxSubscribers; ++i)
+		{
+			_subscribers[i].store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	StateChangeBus(const StateChangeBus &) = delete;
+
+	/*!
+	 *  Add a view. Can be called while machines publish.
+	 *
+	 *      @param [in] machines The number of machines the view may track
+	 *
+	 *      @return The subscriber, owned by the bus, or nullptr if there are too many
+	 */
+	Subscriber<BASE> *subscribe(size_t machines = 1024)
+	{
+		const size_t index = _count.fetch_add(1, std::memory_order_acq_rel);
+		if (index >= _maxSubscribers)
+		{
+			return nullptr;
+		}
+		_owned[index].reset(new Subscriber<BASE>(machines));
+		_subscribers[index].store(_owned[index].get(), std::memory_order_release);
+		return _owned[index].get();
+	}
+
+	/*!
+	 *  Called by the observed state machines
+	 */
+	void onTransition(const FiniteStateMachine<BASE> &machine, StateId from, StateId to) override
+	{
+		const size_t count = std::min(_count.load(std::memory_order_acquire), _maxSubscribers);
+		for (size_t i = 0; i < count; ++i)
+		{
+			// Null while the subscriber is being created
+			Subscriber<BASE> *subscriber = _subscribers[i].load(std::memory_order_acquire);
+			if (subscriber && subscriber->isOpen())
+			{
+				subscriber->publish(machine, from, to);
+			}
+		}
+	}
+
+private:
+	const size_t _maxSubscribers;
+	std::unique_ptr<std::atomic<Subscriber<BASE> *>[]> _subscribers;
+	std::unique_ptr<std::unique_ptr<Subscriber<BASE>>[]> _owned;
+	std::atomic<size_t> _count = { 0 }; // Calls to subscribe()
+};
+
+} // End of namespace
@@ -0,0 +1,371 @@
+/*!
+ *  @file pocket_fsm_channel.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: typed channels between state machines.
+ *  Instead of calling the sendEvent of the next machine of a pipeline from its react,
+ *  a machine sends its outputs into a bounded channel. Each stage of the pipeline
+ *  drains its input channel into its machine in batches, on its own thread or on an
+ *  executor, and a full channel blocks its producers until the stage catches up. An idle
+ *  stage parks its thread until an event is sent to it.
+ *  Requires C++17.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <atomic>             // std::atomic
+#include <condition_variable> // std::condition_variable
+#include <cstdint>            // uint64_t
+#include <memory>             // std::unique_ptr
+#include <mutex>              // std::mutex
+#include <thread>             // std::thread, std::this_thread::yield
+
+#if !defined(POCKET_FSM_CXX17)
+#error "pocket_fsm_channel.h requires C++17"
+#endif
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. List the events a machine receives from upstream machines in an EventList.
+2. Create a Stage<Machine, Events> for each downstream machine, and give the upstream
+	machines a pointer to its input() channel, for example in their pimpl.
+3. In the reacts of the upstream machine, call send(evt) on the channel instead of
+	calling the sendEvent of the downstream machine.
+4. Call start() on each stage to drain its channel on its own thread, or call
+	runOnce() from your own executor.
+
+send() blocks while the channel is full : a slow stage slows its producers down
+instead of letting its queue grow. Channels must therefore not form a cycle. Stop the
+stages from upstream to downstream so that every event is delivered.
+
+A stage delivers each batch under a single lock of its machine. A stage without
+events spins briefly, yields, then parks until an event is sent to its channel.
+
+************************************************************************************/
+
+/*!
+ *  A bounded queue of events with many producers and a single consumer
+ *
+ *      @tparam EVENTS The EventList of the events carried by the channel
+ */
+template<class EVENTS>
+class Channel
+{
+public:
+	using Variant = typename EVENTS::Variant;
+
+	/*!
+	 *  Constructor
+	 *
+	 *      @param [in] capacity The number of events the channel holds, a power of 2
+	 */
+	explicit Channel(size_t capacity)
+		: _mask(capacity - 1)
+		, _cells(new Cell[capacity])
+	{
+		internal::ASSERT(capacity > 0 && (capacity & _mask) == 0, L"The channel capacity needs to be a power of 2");
+		for (size_t i = 0; i < capacity; ++i)
+		{
+			_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	Channel(const Channel &) = delete;
+
+	/*!
+	 *  Queue an event if the channel is not full. Can be called from any thread.
+	 *
+	 *      @return false if the channel is full
+	 */
+	template<typename E>
+	bool trySend(const E &evt)
+	{
+		static_assert(EVENTS::template contains<E>(), "The event type is not registered in the EventList of the channel");
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell &cell = _cells[tail & _mask];
+			const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			if (sequence == tail)
+			{
+				if (_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+				{
+					cell.event.template emplace<EVENTS::template indexOf<E>()>(evt);
+					cell.sequence.store(tail + 1, std::memory_order_release);
+					// Pairs with the fence in park() : either the consumer sees the event, or this sees it parked
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					if (_parked.load(std::memory_order_relaxed))
+					{
+						wake();
+					}
+					return true;
+				}
+			}
+			else if (sequence < tail)
+			{
+				return false; // The consumer has not freed this cell yet
+			}
+			else
+			{
+				tail = _tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/*!
+	 *  Queue an event, waiting while the channel is full. Can be called from any thread.
+	 */
+	template<typename E>
+	void send(const E &evt)
+	{
+		if (trySend(evt))
+		{
+			return;
+		}
+		_stalls.fetch_add(1, std::memory_order_relaxed);
+		unsigned attempt = 0;
+		while (!trySend(evt))
+		{
+			if (++attempt > 64)
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	/*!
+	 *  Pass the queued events to a function, in order. Only one thread may drain a channel.
+	 *
+	 *      @param [in] consume void(Variant &evt)
+	 *      @param [in] max The maximum number of events to consume
+	 *
+	 *      @return The number of events consumed
+	 */
+	template<typename CONSUMER>
+	size_t drain(CONSUMER &&consume, size_t max)
+	{
+		size_t consumed = 0;
+		while (consumed < max)
+		{
+			Cell &cell = _cells[_head & _mask];
+			if (cell.sequence.load(std::memory_order_acquire) != _head + 1)
+			{
+				break;
+			}
+			consume(cell.event);
+			cell.sequence.store(_head + _mask + 1, std::memory_order_release);
+			++_head;
+			++consumed;
+		}
+		if (consumed > 0)
+		{
+			_drained.store(_head, std::memory_order_release);
+		}
+		return consumed;
+	}
+
+	/*!
+	 *  Whether the next event to drain is ready. Only the consumer may call this.
+	 */
+	inline bool ready() const
+	{
+		return _cells[_head & _mask].sequence.load(std::memory_order_acquire) == _head + 1;
+	}
+
+	/*!
+	 *  Block the consumer until an event is ready, or until it is woken up and stop returns true
+	 *
+	 *      @param [in] stop bool(), checked whenever the consumer is woken up
+	 */
+	template<typename STOP>
+	void park(STOP &&stop)
+	{
+		std::unique_lock<std::mutex> lock(_parking);
+		_parked.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		_wake.wait(lock, [this, &stop]()
+		{
+			return ready() || stop();
+		});
+		_parked.store(false, std::memory_order_relaxed);
+	}
+
+	/*!
+	 *  Wake the parked consumer up so that it checks its stop condition
+	 */
+	void wake()
+	{
+		{
+			std::lock_guard<std::mutex> guard(_parking);
+		}
+		_wake.notify_one();
+	}
+
+	/*!
+	 *  The number of queued events, approximate while producers are sending
+	 */
+	inline size_t size() const
+	{
+		return _tail.load(std::memory_order_acquire) - _drained.load(std::memory_order_acquire);
+	}
+
+	/*!
+	 *  The number of sends that had to wait for room in the channel
+	 */
+	inline uint64_t stalls() const
+	{
+		return _stalls.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> sequence = { 0 };
+		Variant event;
+	};
+
+	const size_t _mask;
+	std::unique_ptr<Cell[]> _cells;
+	alignas(64) std::atomic<size_t> _tail = { 0 };    // Producers
+	alignas(64) size_t _head = 0;                     // Consumer
+	std::atomic<size_t> _drained = { 0 };             // Consumer, published for size()
+	alignas(64) std::atomic<uint64_t> _stalls = { 0 };
+	// Parking of the idle consumer. Producers only take the mutex while it is parked.
+	std::atomic<bool> _parked = { false };
+	std::mutex _parking;
+	std::condition_variable _wake;
+};
+
+/*!
+ *  A state machine fed by a channel
+ *
+ *      @tparam MACHINE Your state machine type
+ *      @tparam EVENTS The EventList of the events received through the channel
+ */
+template<class MACHINE, class EVENTS>
+class Stage
+{
+public:
+	/*!
+	 *  Constructor
+	 *
+	 *      @param [in] machine The state machine receiving the events, which needs to outlive the stage
+	 *      @param [in] capacity The capacity of the input channel, a power of 2
+	 *      @param [in] batch The maximum number of events delivered per runOnce()
+	 */
+	explicit Stage(MACHINE &machine, size_t capacity = 1024, size_t batch = 64)
+		: _machine(machine)
+		, _input(capacity)
+		, _batch(batch)
+	{}
+
+	Stage(const Stage &) = delete;
+
+	/*!
+	 *  Destructor. Stops the thread of the stage after delivering the queued events.
+	 */
+	~Stage()
+	{
+		stop();
+	}
+
+	/*!
+	 *  The channel to send the events of this stage to
+	 */
+	inline Channel<EVENTS> &input()
+	{
+		return _input;
+	}
+
+	/*!
+	 *  Deliver a batch of queued events to the machine, locking it once. Call from a single
+	 *  thread at a time, when the stage is not started.
+	 *
+	 *      @return The number of events delivered
+	 */
+	size_t runOnce()
+	{
+		if (!_input.ready())
+		{
+			return 0;
+		}
+		internal::FrameworkAccess::lock(_machine);
+		internal::ASSERT(internal::FrameworkAccess::currentState(_machine).get(), L"You did not call \"initialize(new MyInitialState(...));\" in your constructor!");
+		const size_t delivered = _input.drain([this](typename Channel<EVENTS>::Variant &evt)
+		{
+			internal::FrameworkAccess::processEvent(_machine, evt);
+		}, _batch);
+		internal::FrameworkAccess::unlock(_machine);
+		return delivered;
+	}
+
+	/*!
+	 *  Start a thread delivering the events to the machine
+	 */
+	void start()
+	{
+		internal::ASSERT(!_worker.joinable(), L"The stage is already started!");
+		_running.store(true, std::memory_order_release);
+		_worker = std::thread(&Stage::work, this);
+	}
+
+	/*!
+	 *  Stop the thread of the stage after delivering the queued events
+	 */
+	void stop()
+	{
+		if (_worker.joinable())
+		{
+			_running.store(false, std::memory_order_release);
+			_input.wake();
+			_worker.join();
+		}
+	}
+
+private:
+	void work()
+	{
+		unsigned idle = 0;
+		bool running = true;
+		while (running)
+		{
+			// Read the flag before draining so that events sent before stopping are delivered
+			running = _running.load(std::memory_order_acquire);
+			if (runOnce() > 0)
+			{
+				idle = 0;
+				running = true; // Deliver everything before stopping
+			}
+			else if (running && ++idle > SPINS + YIELDS)
+			{
+				_input.park([this]()
+				{
+					return !_running.load(std::memory_order_acquire);
+				});
+				idle = 0;
+			}
+			else if (idle > SPINS)
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	// An idle stage polls its channel SPINS times, then yields YIELDS times, then parks
+	static constexpr unsigned SPINS = 64;
+	static constexpr unsigned YIELDS = 1024;
+
+	MACHINE &_machine;
+	Channel<EVENTS> _input;
+	const size_t _batch;
+	std::atomic<bool> _running = { false };
+	std::thread _worker;
+};
+
+} // End of namespace
@@ -0,0 +1,342 @@
+/*!
+ *  @file pocket_fsm_codec.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: binary event codec and stream pump.
+ *  Events registered in an EventList are framed with their type ID and decoded straight
+ *  from the read buffer of a file descriptor, then sent to a state machine.
+ *  Requires a POSIX system.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <cerrno>     // errno
+#include <cstdint>    // uint8_t, uint16_t, uint32_t
+#include <cstring>    // std::memcpy, std::memmove
+#include <sys/types.h>
+#include <unistd.h>   // read
+
+#if !defined(POCKET_FSM_CXX17)
+#error "pocket_fsm_codec.h requires C++17"
+#endif
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. List the events of the stream in an EventList. The index in the list is the type
+	ID on the wire, so the writer and the reader have to use the same list.
+2. Trivially copyable events are encoded as their raw bytes and copied out of the read
+	buffer. Other events need a specialization of WireLayout<E> with inPlace = false.
+3. The writer encodes events with Codec<Events>::encode() and writes the frames.
+4. The reader creates a StreamPump<Events> on the file descriptor and calls pump()
+	with the state machine when the descriptor is readable, or run() to block until
+	the end of the stream.
+
+Frames are an 8 bytes header (payload length, type ID) followed by the payload padded
+to 8 bytes, so that payloads are aligned in the read buffer. Both ends of the stream
+need the same byte order.
+
+************************************************************************************/
+
+/*!
+ *  Binary layout of an event on the wire. By default, the event is encoded as its raw
+ *  bytes, which are copied out of the read buffer into the event sent to the state machine.
+ *  Specialize for events that are not trivially copyable, with inPlace = false and:
+ *      static size_t size(const E &evt);                          // Encoded size
+ *      static void encode(const E &evt, uint8_t *out);            // Write size(evt) bytes
+ *      static bool decode(const uint8_t *in, size_t size, E &evt); // False if malformed
+ *
+ *      @tparam E The event type
+ */
+template<typename E>
+struct WireLayout
+{
+	static_assert(std::is_trivially_copyable<E>::value, "Specialize pocket_fsm::WireLayout for events that are not trivially copyable");
+
+	static constexpr bool inPlace = true;
+
+	static constexpr size_t size(const E &)
+	{
+		return sizeof(E);
+	}
+
+	static void encode(const E &evt, uint8_t *out)
+	{
+		std::memcpy(out, &evt, sizeof(E));
+	}
+};
+
+namespace internal
+{
+/*!
+ *  Header preceding each event on the wire
+ */
+struct FrameHeader
+{
+	uint32_t length; // Payload length in bytes, without padding
+	uint16_t type;   // Index of the event in the EventList
+	uint16_t reserved;
+};
+static_assert(sizeof(FrameHeader) == 8, "Frame headers keep payloads aligned");
+
+constexpr size_t padFrame(size_t length)
+{
+	return (length + 7) & ~size_t(7);
+}
+
+template<typename E, typename TARGET, bool IN_PLACE = WireLayout<E>::inPlace>
+struct FrameDecoder
+{
+	static bool decode(uint8_t *payload, size_t length, TARGET &target)
+	{
+		if (length != sizeof(E))
+		{
+			return false;
+		}
+		// No E lives in the read buffer : its bytes are copied into one
+		E evt;
+		std::memcpy(&evt, payload, sizeof(E));
+		target.sendEvent(evt);
+		return true;
+	}
+};
+
+template<typename E, typename TARGET>
+struct FrameDecoder<E, TARGET, false>
+{
+	static bool decode(uint8_t *payload, size_t length, TARGET &target)
+	{
+		E evt;
+		if (!WireLayout<E>::decode(payload, length, evt))
+		{
+			return false;
+		}
+		target.sendEvent(evt);
+		return true;
+	}
+};
+}
+
+template<class EVENTS>
+class Codec;
+
+/*!
+ *  Encodes and decodes the frames of the events in an EventList
+ *
+ *      @tparam Es The event types, in the same order on both ends of the stream
+ */
+template<typename... Es>
+class Codec<EventList<Es...>>
+{
+public:
+	using Events = EventList<Es...>;
+	static_assert(Events::size <= UINT16_MAX, "Too many event types for the frame header");
+
+	/*!
+	 *  Size of the frame of an event, including header and padding
+	 */
+	template<typename E>
+	static size_t frameSize(const E &evt)
+	{
+		return sizeof(internal::FrameHeader) + internal::padFrame(WireLayout<E>::size(evt));
+	}
+
+	/*!
+	 *  Write the frame of an event in a buffer
+	 *
+	 *      @param [in] evt The event to encode
+	 *      @param [out] out The buffer receiving the frame
+	 *      @param [in] capacity The size of the buffer
+	 *
+	 *      @return The number of bytes written, or 0 if the buffer is too small
+	 */
+	template<typename E>
+	static size_t encode(const E &evt, uint8_t *out, size_t capacity)
+	{
+		static_assert(Events::template contains<E>(), "The event type is not registered in the EventList of the codec");
+		const size_t length = WireLayout<E>::size(evt);
+		const size_t total = sizeof(internal::FrameHeader) + internal::padFrame(length);
+		if (total > capacity)
+		{
+			return 0;
+		}
+		internal::FrameHeader header = { uint32_t(length), uint16_t(Events::template indexOf<E>()), 0 };
+		std::memcpy(out, &header, sizeof(header));
+		WireLayout<E>::encode(evt, out + sizeof(header));
+		std::memset(out + sizeof(header) + length, 0, total - sizeof(header) - length);
+		return total;
+	}
+
+	/*!
+	 *  Send all the complete frames of a buffer to a target.
+	 *
+	 *      @param [in,out] data The frames, aligned to 8 bytes
+	 *      @param [in] size The number of bytes in the buffer
+	 *      @param [in,out] target A state machine, or any object with a sendEvent function
+	 *      @param [out] events Incremented for each event sent
+	 *
+	 *      @return The number of bytes consumed, or -1 on a malformed frame
+	 */
+	template<typename TARGET>
+	static ssize_t decode(uint8_t *data, size_t size, TARGET &target, size_t &events)
+	{
+		size_t offset = 0;
+		while (size - offset >= sizeof(internal::FrameHeader))
+		{
+			internal::FrameHeader header;
+			std::memcpy(&header, data + offset, sizeof(header));
+			const size_t total = sizeof(header) + internal::padFrame(header.length);
+			if (size - offset < total)
+			{
+				break; // Partial frame, wait for more bytes
+			}
+			// Unknown types are skipped so that writers can add event types first
+			const int sent = dispatchPayload(header.type, data + offset + sizeof(header), header.length, target);
+			if (sent < 0)
+			{
+				return -1;
+			}
+			events += size_t(sent);
+			offset += total;
+		}
+		return ssize_t(offset);
+	}
+
+	/*!
+	 *  Send the payload of a single frame to a target through a jump table on the type ID.
+	 *
+	 *      @param [in] type The type ID of the event
+	 *      @param [in,out] payload The payload, aligned to 8 bytes
+	 *      @param [in] length The length of the payload without padding
+	 *      @param [in,out] target A state machine, or any object with a sendEvent function
+	 *
+	 *      @return 1 if the event was sent, 0 if the type is unknown, -1 if the payload is malformed
+	 */
+	template<typename TARGET>
+	static int dispatchPayload(uint16_t type, uint8_t *payload, size_t length, TARGET &target)
+	{
+		using Decode = bool (*)(uint8_t *, size_t, TARGET &);
+		static constexpr Decode table[] = { &internal::FrameDecoder<Es, TARGET>::decode..., nullptr };
+		if (type >= Events::size)
+		{
+			return 0;
+		}
+		return table[type](payload, length, target) ? 1 : -1;
+	}
+};
+
+/*!
+ *  Reads frames off a file descriptor, such as a pipe or a socket, in large batches
+ *  and sends the events to a state machine. The read buffer is allocated once.
+ *
+ *      @tparam EVENTS The EventList of the stream
+ */
+template<class EVENTS>
+class StreamPump
+{
+public:
+	/*!
+	 *  Constructor. The pump does not take ownership of the file descriptor.
+	 *
+	 *      @param [in] fd The file descriptor to read from
+	 *      @param [in] bufferSize Size of the read buffer, which bounds the size of a frame
+	 */
+	explicit StreamPump(int fd, size_t bufferSize = 64 * 1024)
+		: _fd(fd)
+		, _capacity(internal::padFrame(bufferSize))
+		, _buffer(new uint64_t[_capacity / sizeof(uint64_t)])
+	{}
+
+	StreamPump(const StreamPump &) = delete;
+
+	/*!
+	 *  Read once from the file descriptor and send all the complete events to the target.
+	 *  On a non blocking descriptor, returns 0 when no data is available.
+	 *
+	 *      @param [in,out] target A state machine, or any object with a sendEvent function
+	 *
+	 *      @return The number of events sent, or -1 with errno set on error
+	 */
+	template<typename TARGET>
+	ssize_t pump(TARGET &target)
+	{
+		uint8_t *buffer = reinterpret_cast<uint8_t *>(_buffer.get());
+		if (_size == _capacity)
+		{
+			errno = EMSGSIZE; // A single frame does not fit in the buffer
+			return -1;
+		}
+
+		ssize_t received = ::read(_fd, buffer + _size, _capacity - _size);
+		if (received < 0)
+		{
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+		}
+		if (received == 0)
+		{
+			_eof = true;
+			return 0;
+		}
+		_size += size_t(received);
+
+		size_t events = 0;
+		ssize_t consumed = Codec<EVENTS>::decode(buffer, _size, target, events);
+		if (consumed < 0)
+		{
+			errno = EBADMSG;
+			return -1;
+		}
+		// Move the partial frame at the end to the front, keeping the payload aligned
+		_size -= size_t(consumed);
+		if (_size > 0 && consumed > 0)
+		{
+			std::memmove(buffer, buffer + consumed, _size);
+		}
+		return ssize_t(events);
+	}
+
+	/*!
+	 *  Pump until the end of the stream or an error.
+	 *
+	 *      @param [in,out] target A state machine, or any object with a sendEvent function
+	 *
+	 *      @return The total number of events sent, or -1 with errno set on error
+	 */
+	template<typename TARGET>
+	ssize_t run(TARGET &target)
+	{
+		ssize_t total = 0;
+		while (!_eof)
+		{
+			ssize_t events = pump(target);
+			if (events < 0)
+			{
+				return -1;
+			}
+			total += events;
+		}
+		return total;
+	}
+
+	/*!
+	 *  Whether the writing end closed the stream
+	 */
+	inline bool eof() const
+	{
+		return _eof;
+	}
+
+private:
+	int _fd;
+	size_t _capacity;
+	size_t _size = 0;
+	bool _eof = false;
+	std::unique_ptr<uint64_t[]> _buffer; // uint64_t keeps the frames aligned
+};
+
+} // End of namespace
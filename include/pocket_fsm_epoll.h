@@ -0,0 +1,401 @@
+/*!
+ *  @file pocket_fsm_epoll.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: Linux event loop for I/O driven state machines.
+ *  File descriptors, timers and cross thread wakeups are registered for a state machine,
+ *  and the loop turns their readiness into typed events sent to that machine. All the
+ *  events ready after one epoll_wait are dispatched as a batch.
+ *  Linux only.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <chrono>          // std::chrono::nanoseconds
+#include <cstdint>         // uint32_t, uint64_t
+#include <functional>      // std::function
+#include <memory>          // std::unique_ptr
+#include <unordered_map>   // std::unordered_map
+#include <vector>          // std::vector
+
+#if !defined(__linux__)
+#error "pocket_fsm_epoll.h requires Linux"
+#endif
+#include <sys/epoll.h>     // epoll_create1, epoll_ctl, epoll_wait
+#include <sys/eventfd.h>   // eventfd
+#include <sys/timerfd.h>   // timerfd_create, timerfd_settime
+#include <unistd.h>        // read, write, close
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. Declare REACT(Readable), REACT(Writable), REACT(Timeout) and REACT(Wakeup) in your
+	base state, for the sources you register.
+2. Create an EventLoop and register sources for your machines:
+	- watch(machine, fd) sends Readable{fd}, and Writable{fd} if asked, while the fd is
+		ready. The loop does not read or write the fd : the react does.
+	- addTimer(machine, id, delay, period) sends Timeout{id} when the timer expires.
+	- addWakeup(machine, id) returns a Waker : any thread calls wake() to send Wakeup{id}.
+3. Call run() on the thread owning the machines, and stop() from any thread, or call
+	runOnce(timeout) from your own loop.
+
+Sources are level triggered. Reacts may register and remove sources, including their
+own. The loop does not own the machines nor the watched file descriptors, which need
+to outlive their registration.
+
+************************************************************************************/
+
+/*!
+ *  Sent while a watched file descriptor is readable, or hung up
+ */
+struct Readable
+{
+	int fd = -1;
+};
+
+/*!
+ *  Sent while a watched file descriptor is writable, when asked for
+ */
+struct Writable
+{
+	int fd = -1;
+};
+
+/*!
+ *  Sent when a timer expires
+ */
+struct Timeout
+{
+	uint32_t id = 0;
+	uint64_t expirations = 0; // More than 1 if the loop was late for a periodic timer
+};
+
+/*!
+ *  Sent after a Waker was woken, once for any number of wake() since the last one
+ */
+struct Wakeup
+{
+	uint32_t id = 0;
+};
+
+/*!
+ *  Wakes a state machine of an event loop from any thread
+ */
+class Waker
+{
+public:
+	Waker() = default;
+
+	/*!
+	 *  Send a Wakeup to the machine on the thread of its loop. Thread safe.
+	 */
+	void wake() const
+	{
+		const uint64_t one = 1;
+		ssize_t written = ::write(_fd, &one, sizeof(one));
+		(void)written; // Only fails when the counter is saturated, in which case a wakeup is pending
+	}
+
+	inline int fd() const
+	{
+		return _fd;
+	}
+
+private:
+	friend class EventLoop;
+
+	explicit Waker(int fd)
+		: _fd(fd)
+	{}
+
+	int _fd = -1;
+};
+
+/*!
+ *  Delivers the readiness of file descriptors, timers and wakeups to state machines
+ */
+class EventLoop
+{
+public:
+	/*!
+	 *  Constructor
+	 *
+	 *      @param [in] batch The maximum number of ready sources dispatched per epoll_wait
+	 */
+	explicit EventLoop(size_t batch = 64)
+		: _epoll(::epoll_create1(EPOLL_CLOEXEC))
+		, _ready(batch)
+	{
+		internal::ASSERT(_epoll >= 0, L"epoll_create1 failed!");
+		internal::ASSERT(batch > 0, L"The event loop needs to dispatch at least one event per batch!");
+		_stop = addSource(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK), Kind::Stop, EPOLLIN, 0, nullptr);
+	}
+
+	EventLoop(const EventLoop &) = delete;
+
+	/*!
+	 *  Destructor. Closes the timers and wakers, but not the watched file descriptors.
+	 */
+	~EventLoop()
+	{
+		for (auto &source : _sources)
+		{
+			if (source.second->kind != Kind::Watch)
+			{
+				::close(source.first);
+			}
+		}
+		::close(_epoll);
+	}
+
+	/*!
+	 *  Send Readable, and optionally Writable, events to a machine while a file descriptor is ready
+	 *
+	 *      @param [in] machine The state machine receiving the events
+	 *      @param [in] fd The file descriptor to watch, usually non blocking
+	 *      @param [in] writable Whether to also send Writable events
+	 *
+	 *      @return false if the file descriptor cannot be watched
+	 */
+	template<class MACHINE>
+	bool watch(MACHINE &machine, int fd, bool writable = false)
+	{
+		const uint32_t events = EPOLLIN | EPOLLRDHUP | (writable ? EPOLLOUT : 0u);
+		return addSource(fd, Kind::Watch, events, 0, [&machine, fd](uint32_t ready, uint64_t)
+		{
+			if (ready & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+			{
+				Readable evt{ fd };
+				machine.sendEvent(evt);
+			}
+			if (ready & EPOLLOUT)
+			{
+				Writable evt{ fd };
+				machine.sendEvent(evt);
+			}
+		}) >= 0;
+	}
+
+	/*!
+	 *  Send a Timeout event to a machine after a delay, and then periodically if asked
+	 *
+	 *      @param [in] machine The state machine receiving the events
+	 *      @param [in] id The ID of the timer, sent in the Timeout events
+	 *      @param [in] delay The delay before the first expiration, greater than 0
+	 *      @param [in] period The period of the next expirations, or 0 for a one shot timer
+	 *
+	 *      @return The file descriptor of the timer, to remove it, or -1 on failure
+	 */
+	template<class MACHINE>
+	int addTimer(MACHINE &machine, uint32_t id, std::chrono::nanoseconds delay, std::chrono::nanoseconds period = std::chrono::nanoseconds(0))
+	{
+		internal::ASSERT(delay.count() > 0, L"A timer needs a delay greater than 0!");
+		const int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+		if (fd < 0)
+		{
+			return -1;
+		}
+		itimerspec spec = {};
+		spec.it_value = toTimespec(delay);
+		spec.it_interval = toTimespec(period);
+		if (::timerfd_settime(fd, 0, &spec, nullptr) != 0)
+		{
+			::close(fd);
+			return -1;
+		}
+		return addSource(fd, Kind::Timer, EPOLLIN, id, [&machine, id](uint32_t, uint64_t expirations)
+		{
+			Timeout evt{ id, expirations };
+			machine.sendEvent(evt);
+		});
+	}
+
+	/*!
+	 *  Create a Waker sending Wakeup events to a machine
+	 *
+	 *      @param [in] machine The state machine receiving the events
+	 *      @param [in] id The ID of the waker, sent in the Wakeup events
+	 *
+	 *      @return The waker, valid until removed, or a waker with a negative fd on failure
+	 */
+	template<class MACHINE>
+	Waker addWakeup(MACHINE &machine, uint32_t id)
+	{
+		const int fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (fd < 0)
+		{
+			return Waker(-1);
+		}
+		return Waker(addSource(fd, Kind::Wakeup, EPOLLIN, id, [&machine, id](uint32_t, uint64_t)
+		{
+			Wakeup evt{ id };
+			machine.sendEvent(evt);
+		}));
+	}
+
+	/*!
+	 *  Stop delivering the events of a watched file descriptor, timer or waker.
+	 *  Timers and wakers are closed. Can be called from a react.
+	 *
+	 *      @param [in] fd The watched file descriptor, or the fd of the timer or waker
+	 */
+	void remove(int fd)
+	{
+		auto found = _sources.find(fd);
+		if (found == _sources.end() || found->second->kind == Kind::Stop)
+		{
+			return;
+		}
+		::epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+		if (found->second->kind != Kind::Watch)
+		{
+			::close(fd);
+		}
+		// The source may still be in the batch being dispatched : keep it until the batch ends
+		found->second->active = false;
+		_removed.push_back(std::move(found->second));
+		_sources.erase(found);
+	}
+
+	/*!
+	 *  Wait for ready sources and dispatch their events to the machines
+	 *
+	 *      @param [in] timeoutMs The maximum time to wait in milliseconds, or -1 to wait forever
+	 *
+	 *      @return The number of events dispatched
+	 */
+	size_t runOnce(int timeoutMs = -1)
+	{
+		const int ready = ::epoll_wait(_epoll, _ready.data(), int(_ready.size()), timeoutMs);
+		size_t dispatched = 0;
+		for (int i = 0; i < ready; ++i)
+		{
+			Source *source = static_cast<Source *>(_ready[i].data.ptr);
+			if (source->active)
+			{
+				dispatched += dispatch(*source, _ready[i].events);
+			}
+		}
+		_removed.clear();
+		return dispatched;
+	}
+
+	/*!
+	 *  Dispatch events until stop() is called
+	 */
+	void run()
+	{
+		_running = true;
+		while (_running)
+		{
+			runOnce(-1);
+		}
+	}
+
+	/*!
+	 *  Make run() return after the current batch. Thread safe.
+	 */
+	void stop()
+	{
+		const uint64_t one = 1;
+		ssize_t written = ::write(_stop, &one, sizeof(one));
+		(void)written;
+	}
+
+private:
+	enum class Kind : uint8_t { Watch, Timer, Wakeup, Stop };
+
+	using Deliver = std::function<void(uint32_t ready, uint64_t count)>;
+
+	struct Source
+	{
+		int fd;
+		Kind kind;
+		uint32_t id;
+		Deliver deliver;
+		bool active = true;
+	};
+
+	static timespec toTimespec(std::chrono::nanoseconds duration)
+	{
+		timespec spec;
+		spec.tv_sec = time_t(duration.count() / 1000000000);
+		spec.tv_nsec = long(duration.count() % 1000000000);
+		return spec;
+	}
+
+	/*!
+	 *  Register a source with epoll
+	 *
+	 *      @return The file descriptor, or -1 on failure
+	 */
+	int addSource(int fd, Kind kind, uint32_t events, uint32_t id, Deliver deliver)
+	{
+		if (fd < 0 || _sources.count(fd) > 0)
+		{
+			return -1;
+		}
+		std::unique_ptr<Source> source(new Source{ fd, kind, id, std::move(deliver) });
+		epoll_event event = {};
+		event.events = events;
+		event.data.ptr = source.get();
+		if (::epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+		{
+			if (kind != Kind::Watch)
+			{
+				::close(fd);
+			}
+			return -1;
+		}
+		_sources.emplace(fd, std::move(source));
+		return fd;
+	}
+
+	size_t dispatch(Source &source, uint32_t ready)
+	{
+		if (source.kind == Kind::Watch)
+		{
+			// Readable and Writable are delivered apart, since the first react may remove the source
+			const uint32_t readable = ready & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR);
+			size_t delivered = 0;
+			if (readable)
+			{
+				source.deliver(readable, 0);
+				++delivered;
+			}
+			if ((ready & EPOLLOUT) && source.active)
+			{
+				source.deliver(EPOLLOUT, 0);
+				++delivered;
+			}
+			return delivered;
+		}
+		// Timers and eventfds are reset by reading their counter
+		uint64_t count = 0;
+		if (::read(source.fd, &count, sizeof(count)) != ssize_t(sizeof(count)) || count == 0)
+		{
+			return 0;
+		}
+		if (source.kind == Kind::Stop)
+		{
+			_running = false;
+			return 0;
+		}
+		source.deliver(ready, count);
+		return 1;
+	}
+
+	const int _epoll;
+	int _stop = -1;
+	bool _running = false;
+	std::vector<epoll_event> _ready;
+	std::unordered_map<int, std::unique_ptr<Source>> _sources;
+	std::vector<std::unique_ptr<Source>> _removed; // Removed during the current batch
+};
+
+} // End of namespace
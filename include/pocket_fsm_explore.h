@@ -0,0 +1,416 @@
+/*!
+ *  @file pocket_fsm_explore.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: state space explorer for property testing.
+ *  Event sequences over an EventList are generated exhaustively or at random and sent
+ *  to clones of a prototype machine on all cores. User invariants are checked after
+ *  each event, and the sequences breaking them are shrunk to a minimal counterexample.
+ *  Requires C++17.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <algorithm>  // std::max
+#include <atomic>     // std::atomic
+#include <mutex>      // std::mutex
+#include <thread>     // std::thread
+#include <vector>     // std::vector
+
+#if !defined(POCKET_FSM_CXX17)
+#error "pocket_fsm_explore.h requires C++17"
+#endif
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. Give your state machine a copy constructor calling cloneFrom(), so that branches
+	of the exploration get independent copies of the machine.
+2. Create a StateExplorer with an initialized prototype machine.
+3. Register the events to send with addEvent(). Register simpler events first : the
+	shrinker replaces events with earlier ones when it can.
+4. Register invariants with addInvariant(). They receive the machine after each event
+	and the sequence sent so far, and return false when violated.
+5. Call exhaustive(depth) to try every sequence up to a length, or random(count, length)
+	to try random sequences. The result holds the shrunk counterexample, if any.
+
+Each thread owns the machines it explores: they do not need to be thread safe. The
+prototype is only read while exploring and must not receive events meanwhile.
+
+************************************************************************************/
+
+/*!
+ *  The outcome of an exploration
+ *
+ *      @tparam EVENTS The EventList of the explored events
+ */
+template<class EVENTS>
+struct ExplorationResult
+{
+	bool passed = true;
+	uint64_t sequences = 0;        // Sequences fully explored
+	uint64_t events = 0;           // Events sent, shrinking excluded
+	const char *invariant = nullptr; // Name of the violated invariant
+	std::vector<typename EVENTS::Variant> counterexample; // Shrunk sequence violating it, from the prototype
+};
+
+namespace internal
+{
+/*!
+ *  Small and fast generator, seeded per sequence so that random explorations are reproducible
+ */
+inline uint64_t splitMix64(uint64_t &state)
+{
+	uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+}
+
+/*!
+ *  Explores the event sequences of a state machine in parallel and checks invariants.
+ *
+ *      @tparam MACHINE Your state machine type, whose copy constructor calls cloneFrom()
+ *      @tparam EVENTS The EventList of events that can be sent to the machine
+ */
+template<class MACHINE, class EVENTS>
+class StateExplorer
+{
+public:
+	using Variant = typename EVENTS::Variant;
+	using Sequence = std::vector<Variant>;
+	using Invariant = std::function<bool(MACHINE &machine, const Sequence &sequence)>;
+	using Result = ExplorationResult<EVENTS>;
+
+	static_assert(std::is_copy_constructible<MACHINE>::value, "The explored state machine needs a copy constructor calling cloneFrom()");
+
+	/*!
+	 *  Constructor
+	 *
+	 *      @param [in] prototype The initialized state machine every sequence starts from
+	 *      @param [in] threads Number of threads, defaults to the number of cores
+	 */
+	explicit StateExplorer(const MACHINE &prototype, size_t threads = 0)
+		: _prototype(prototype)
+		, _threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+	{}
+
+	StateExplorer(const StateExplorer &) = delete;
+
+	/*!
+	 *  Add an event to the alphabet of the exploration. Each one is sent as a copy.
+	 */
+	template<typename E>
+	void addEvent(const E &evt)
+	{
+		static_assert(EVENTS::template contains<E>(), "The event type is not registered in the EventList of the explorer");
+		_alphabet.emplace_back(std::in_place_type<E>, evt);
+	}
+
+	/*!
+	 *  Add a property that has to hold after every event
+	 *
+	 *      @param [in] name Reported when the invariant is violated
+	 *      @param [in] invariant Returns false when violated. Called concurrently from all threads.
+	 */
+	void addInvariant(const char *name, Invariant invariant)
+	{
+		_invariants.push_back({ name, std::move(invariant) });
+	}
+
+	/*!
+	 *  Send every sequence of the alphabet up to a length. Branches share their prefix:
+	 *  each node of the tree is a clone of its parent, so no sequence is replayed.
+	 *
+	 *      @param [in] depth The length of the sequences
+	 *
+	 *      @return The outcome, with the first counterexample found, shrunk
+	 */
+	Result exhaustive(size_t depth)
+	{
+		const size_t symbols = _alphabet.size();
+		// Split the tree at the smallest level with enough subtrees to balance the threads
+		size_t split = 0;
+		size_t tasks = 1;
+		while (split < depth && tasks < _threads * 16)
+		{
+			tasks *= symbols;
+			++split;
+		}
+
+		std::atomic<size_t> next = { 0 };
+		return run([this, &next, tasks, split, depth, symbols](Walker &walker)
+		{
+			for (size_t task = next++; task < tasks && !_stop.load(std::memory_order_relaxed); task = next++)
+			{
+				MACHINE machine(_prototype);
+				walker.clear();
+				bool valid = true;
+				for (size_t level = 0, digits = task; level < split && valid; ++level, digits /= symbols)
+				{
+					valid = step(machine, walker, uint32_t(digits % symbols));
+				}
+				if (valid)
+				{
+					dive(machine, walker, depth - split);
+				}
+			}
+		});
+	}
+
+	/*!
+	 *  Send random sequences of the alphabet. Sequence i is the same for a given seed,
+	 *  whatever the number of threads.
+	 *
+	 *      @param [in] count The number of sequences
+	 *      @param [in] length The length of each sequence
+	 *      @param [in] seed Selects the sequences
+	 *
+	 *      @return The outcome, with the first counterexample found, shrunk
+	 */
+	Result random(size_t count, size_t length, uint64_t seed = 1)
+	{
+		const size_t symbols = _alphabet.size();
+		std::atomic<size_t> next = { 0 };
+		return run([this, &next, count, length, seed, symbols](Walker &walker)
+		{
+			for (size_t sequence = next++; sequence < count && !_stop.load(std::memory_order_relaxed); sequence = next++)
+			{
+				uint64_t state = seed ^ (uint64_t(sequence) * 0xD1B54A32D192ED03ull);
+				MACHINE machine(_prototype);
+				walker.clear();
+				bool valid = true;
+				for (size_t i = 0; i < length && valid; ++i)
+				{
+					valid = step(machine, walker, uint32_t(internal::splitMix64(state) % symbols));
+				}
+				walker.sequences += valid;
+			}
+		});
+	}
+
+private:
+	struct NamedInvariant
+	{
+		const char *name;
+		Invariant check;
+	};
+
+	/*!
+	 *  The sequence being explored by a thread, as alphabet indices and as the events sent
+	 */
+	struct Walker
+	{
+		std::vector<uint32_t> path;
+		Sequence sequence;
+		uint64_t sequences = 0;
+		uint64_t events = 0;
+
+		void clear()
+		{
+			path.clear();
+			sequence.clear();
+		}
+
+		void pop()
+		{
+			path.pop_back();
+			sequence.pop_back();
+		}
+	};
+
+	template<typename WORK>
+	Result run(WORK work)
+	{
+		internal::ASSERT(!_alphabet.empty(), L"Add events to explore with addEvent()!");
+		_stop.store(false);
+		_failedInvariant = SIZE_MAX;
+		_failure.clear();
+
+		// The prototype itself has to satisfy the invariants
+		Walker root;
+		MACHINE initial(_prototype);
+		if (check(initial, root))
+		{
+			std::vector<Walker> walkers(_threads);
+			std::vector<std::thread> threads;
+			for (size_t t = 0; t < _threads; ++t)
+			{
+				threads.emplace_back([&work, &walkers, t]()
+				{
+					work(walkers[t]);
+				});
+			}
+			for (std::thread &thread : threads)
+			{
+				thread.join();
+			}
+			for (const Walker &walker : walkers)
+			{
+				root.sequences += walker.sequences;
+				root.events += walker.events;
+			}
+		}
+
+		Result result;
+		result.sequences = root.sequences;
+		result.events = root.events;
+		if (_failedInvariant != SIZE_MAX)
+		{
+			shrink(_failure, _failedInvariant);
+			result.passed = false;
+			result.invariant = _invariants[_failedInvariant].name;
+			for (uint32_t symbol : _failure)
+			{
+				result.counterexample.push_back(_alphabet[symbol]);
+			}
+		}
+		return result;
+	}
+
+	/*!
+	 *  Depth first exploration below a node. The last branch reuses the node instead of a clone.
+	 */
+	void dive(MACHINE &node, Walker &walker, size_t remaining)
+	{
+		if (remaining == 0)
+		{
+			++walker.sequences;
+			return;
+		}
+		const size_t symbols = _alphabet.size();
+		for (size_t symbol = 0; symbol < symbols && !_stop.load(std::memory_order_relaxed); ++symbol)
+		{
+			if (symbol + 1 < symbols)
+			{
+				MACHINE branch(node);
+				if (step(branch, walker, uint32_t(symbol)))
+				{
+					dive(branch, walker, remaining - 1);
+				}
+			}
+			else if (step(node, walker, uint32_t(symbol)))
+			{
+				dive(node, walker, remaining - 1);
+			}
+			walker.pop();
+		}
+	}
+
+	/*!
+	 *  Send an event of the alphabet and check the invariants
+	 *
+	 *      @return False if an invariant was violated
+	 */
+	bool step(MACHINE &machine, Walker &walker, uint32_t symbol)
+	{
+		walker.path.push_back(symbol);
+		walker.sequence.push_back(_alphabet[symbol]);
+		machine.sendEvent(walker.sequence.back());
+		++walker.events;
+		return check(machine, walker);
+	}
+
+	bool check(MACHINE &machine, const Walker &walker)
+	{
+		for (size_t i = 0; i < _invariants.size(); ++i)
+		{
+			if (!_invariants[i].check(machine, walker.sequence))
+			{
+				std::lock_guard<std::mutex> guard(_failureMutex);
+				if (_failedInvariant == SIZE_MAX)
+				{
+					_failedInvariant = i;
+					_failure = walker.path;
+				}
+				_stop.store(true, std::memory_order_relaxed);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/*!
+	 *  Replay a sequence from the prototype, truncating it where the invariant breaks
+	 *
+	 *      @return Whether the invariant broke
+	 */
+	bool replayFails(std::vector<uint32_t> &path, size_t invariant) const
+	{
+		MACHINE machine(_prototype);
+		Sequence sequence;
+		for (size_t i = 0; i < path.size(); ++i)
+		{
+			sequence.push_back(_alphabet[path[i]]);
+			machine.sendEvent(sequence.back());
+			if (!_invariants[invariant].check(machine, sequence))
+			{
+				path.resize(i + 1);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/*!
+	 *  Delta debugging : remove chunks of events of decreasing size, then replace events
+	 *  with earlier ones of the alphabet, until the sequence cannot be simplified further.
+	 */
+	void shrink(std::vector<uint32_t> &path, size_t invariant) const
+	{
+		bool progress = true;
+		while (progress)
+		{
+			progress = false;
+			for (size_t chunk = std::max<size_t>(path.size() / 2, 1); chunk > 0; chunk /= 2)
+			{
+				for (size_t start = 0; start + chunk <= path.size();)
+				{
+					std::vector<uint32_t> candidate(path.begin(), path.begin() + start);
+					candidate.insert(candidate.end(), path.begin() + start + chunk, path.end());
+					if (replayFails(candidate, invariant))
+					{
+						path.swap(candidate);
+						progress = true;
+					}
+					else
+					{
+						start += chunk;
+					}
+				}
+			}
+			for (size_t i = 0; i < path.size(); ++i)
+			{
+				for (uint32_t symbol = 0; symbol < path[i]; ++symbol)
+				{
+					std::vector<uint32_t> candidate(path);
+					candidate[i] = symbol;
+					if (replayFails(candidate, invariant))
+					{
+						path.swap(candidate);
+						progress = true;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	const MACHINE &_prototype;
+	const size_t _threads;
+	std::vector<Variant> _alphabet;
+	std::vector<NamedInvariant> _invariants;
+
+	std::atomic<bool> _stop = { false };
+	std::mutex _failureMutex;
+	size_t _failedInvariant = SIZE_MAX;
+	std::vector<uint32_t> _failure;
+};
+
+} // End of namespace
@@ -0,0 +1,204 @@
+/*!
+ *  @file pocket_fsm_footprint.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: compile time memory footprint and size budgets.
+ *  The size of each concrete state, the resident size of a state machine with its
+ *  state, pimpl and control block, and the bytes allocated per transition are computed
+ *  at compile time. A budget turns them into static assertions, so that a footprint
+ *  regression fails the build.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <cstdio>     // std::fprintf
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. List the concrete states of your state machine in a StateList, nested ones included.
+2. Declare Footprint<Machine, States, Depth>, where Depth is the number of levels of
+	nested state machines, 1 for a flat state machine. Its constants can be used in
+	static assertions, and report() prints them.
+3. Declare a budget next to your state machine:
+	static_assert(FootprintBudget<MyFootprint, ResidentBytes, TransitionBytes>::value, "");
+	The build fails on the first limit exceeded, naming the offending state if any.
+
+Sizes are those of the objects themselves. Allocator overhead, members allocated by
+the states or the pimpl, and transition functions too large for the small buffer of
+std::function are not accounted for. The size of the shared_ptr control block is
+estimated from the common standard library layouts.
+
+************************************************************************************/
+
+/*!
+ *  The size of a concrete state object
+ */
+struct StateFootprint
+{
+	StateId id;
+	size_t size;
+};
+
+namespace internal
+{
+/*!
+ *  The base state of a state machine type
+ */
+template<class BASE>
+BASE baseStateOf(const FiniteStateMachine<BASE> *);
+
+template<class MACHINE>
+using BaseStateOf = decltype(baseStateOf(static_cast<MACHINE *>(nullptr)));
+
+/*!
+ *  A shared_ptr created from a raw pointer allocates a control block with a vtable
+ *  pointer, the use and weak counts, and the pointer to delete
+ */
+constexpr size_t SHARED_CONTROL_BLOCK = 2 * sizeof(void *) + 2 * sizeof(int);
+
+template<class PIMPL>
+struct PimplFootprint
+{
+	static constexpr size_t size = sizeof(PIMPL) + SHARED_CONTROL_BLOCK;
+};
+
+template<>
+struct PimplFootprint<void>
+{
+	static constexpr size_t size = 0;
+};
+
+template<size_t... VALUES>
+constexpr size_t maxOf()
+{
+	const size_t values[] = { VALUES..., 0 };
+	size_t result = 0;
+	for (size_t value : values)
+	{
+		result = value > result ? value : result;
+	}
+	return result;
+}
+
+template<bool... VALUES>
+constexpr bool allOf()
+{
+	const bool values[] = { VALUES..., true };
+	for (bool value : values)
+	{
+		if (!value) return false;
+	}
+	return true;
+}
+
+/*!
+ *  Fails the build, with S in the instantiation trace, if S is larger than LIMIT
+ */
+template<class S, size_t LIMIT>
+struct StateWithinBudget
+{
+	static_assert(sizeof(S) + SHARED_CONTROL_BLOCK <= LIMIT, "A concrete state exceeds the transition budget of its state machine");
+	static constexpr bool value = true;
+};
+}
+
+template<class MACHINE, class STATES, size_t DEPTH = 1>
+struct Footprint;
+
+/*!
+ *  The memory footprint of a state machine, computed at compile time
+ *
+ *      @tparam MACHINE Your state machine type
+ *      @tparam Ss The concrete states of the StateList of the machine
+ *      @tparam DEPTH The number of levels of nested state machines, 1 for a flat machine
+ */
+template<class MACHINE, class... Ss, size_t DEPTH>
+struct Footprint<MACHINE, StateList<Ss...>, DEPTH>
+{
+	static_assert(sizeof...(Ss) > 0, "The StateList of a footprint needs at least one state");
+	static_assert(DEPTH > 0, "A state machine has at least one level of states");
+
+	using States = StateList<Ss...>;
+	using Base = internal::BaseStateOf<MACHINE>;
+	using Pimpl = internal::FrameworkAccess::PimplOf<Base>;
+
+	static constexpr size_t stateCount = sizeof...(Ss);
+
+	/*!
+	 *  The size of each concrete state, in the order of the StateList
+	 */
+	static constexpr StateFootprint states[] = { { Ss::stateId(), sizeof(Ss) }... };
+
+	/*!
+	 *  The state machine object itself, without its state
+	 */
+	static constexpr size_t machineSize = sizeof(MACHINE);
+
+	/*!
+	 *  The largest concrete state
+	 */
+	static constexpr size_t largestState = internal::maxOf<sizeof(Ss)...>();
+
+	/*!
+	 *  The pimpl and the control block of its shared pointer, or 0 without a pimpl
+	 */
+	static constexpr size_t pimplSize = internal::PimplFootprint<Pimpl>::size;
+
+	/*!
+	 *  The most a transition allocates : the next state and the control block of the
+	 *  shared pointer holding it, while the previous state is still alive
+	 */
+	static constexpr size_t perTransition = largestState + internal::SHARED_CONTROL_BLOCK;
+
+	/*!
+	 *  The most a state machine keeps allocated between events : itself, one state per
+	 *  level with its control block, and its pimpl
+	 */
+	static constexpr size_t resident = machineSize + DEPTH * perTransition + pimplSize;
+
+	/*!
+	 *  Print the footprint, for example from a unit test or a build step
+	 *
+	 *      @param [in] out The stream to print to
+	 */
+	static void report(FILE *out = stdout)
+	{
+		std::fprintf(out, "machine %zu bytes, pimpl %zu bytes, resident %zu bytes, per transition %zu bytes\n",
+			machineSize, pimplSize, resident, perTransition);
+		for (const StateFootprint &state : states)
+		{
+			std::fprintf(out, "  state %08X : %zu bytes\n", unsigned(state.id), state.size);
+		}
+	}
+};
+
+template<class MACHINE, class... Ss, size_t DEPTH>
+constexpr StateFootprint Footprint<MACHINE, StateList<Ss...>, DEPTH>::states[];
+
+/*!
+ *  Enforces size limits on a footprint at compile time. Instantiate it in a static assertion.
+ *
+ *      @tparam FOOTPRINT The Footprint of the state machine
+ *      @tparam RESIDENT The most bytes the state machine may keep allocated
+ *      @tparam TRANSITION The most bytes a transition may allocate, which bounds every state
+ */
+template<class FOOTPRINT, size_t RESIDENT, size_t TRANSITION = RESIDENT>
+struct FootprintBudget;
+
+template<class MACHINE, class... Ss, size_t DEPTH, size_t RESIDENT, size_t TRANSITION>
+struct FootprintBudget<Footprint<MACHINE, StateList<Ss...>, DEPTH>, RESIDENT, TRANSITION>
+{
+	using Measured = Footprint<MACHINE, StateList<Ss...>, DEPTH>;
+
+	static_assert(Measured::resident <= RESIDENT, "The resident size of the state machine exceeds its budget");
+
+	static constexpr bool value = internal::allOf<internal::StateWithinBudget<Ss, TRANSITION>::value...>();
+};
+
+} // End of namespace
@@ -0,0 +1,163 @@
+/*!
+ *  @file pocket_fsm_group.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: state bucketed broadcast to groups of machines.
+ *  Before an event is broadcast, the machines are partitioned by current state so that
+ *  the same react function is called for a whole bucket in a row, which keeps the
+ *  branch predictor and the instruction cache warm.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <vector>     // std::vector
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. Declare your concrete states with the CONCRETE_STATE macro : machines are bucketed
+	by state ID. States without an ID all share a bucket.
+2. add() your initialized machines to a MachineGroup. The group does not own them.
+3. Call broadcast(evt) instead of calling sendEvent(evt) on each machine.
+
+Each machine receives the event through its own sendEvent, with the same reaction,
+exit, entry and transition as usual. Only the order in which the machines receive the
+event changes : machines in the same state are served together. Machines need to
+receive events through the group only, or be in the state they were in when added.
+
+Serving the buckets gives up the order in which the machines were added, and a
+transition sorts the group again before the next broadcast. Populations larger than
+the cache or transitioning on most broadcasts are faster with a plain sendEvent loop :
+measure with example/GroupBenchmark.
+
+************************************************************************************/
+
+/*!
+ *  A group of state machines receiving broadcast events bucketed by current state
+ *
+ *      @tparam MACHINE Your state machine type
+ */
+template<class MACHINE>
+class MachineGroup
+{
+public:
+	/*!
+	 *  Add an initialized machine to the group. The group does not own it.
+	 */
+	void add(MACHINE &machine)
+	{
+		const StateIF *state = internal::FrameworkAccess::currentState(machine).get();
+		internal::ASSERT(state, L"Only initialized state machines can be added to a group!");
+		_entries.push_back({ &machine, bucketOf(state->getStateId()) });
+		_sorted = false;
+	}
+
+	void clear()
+	{
+		_entries.clear();
+	}
+
+	inline size_t size() const
+	{
+		return _entries.size();
+	}
+
+	/*!
+	 *  Access a machine, in bucket order
+	 */
+	inline MACHINE &operator[](size_t index)
+	{
+		return *_entries[index].machine;
+	}
+
+	/*!
+	 *  Send an event to every machine, one bucket of machines in the same state at a time
+	 *
+	 *      @tparam E The type of the event the machines need to react to.
+	 *
+	 *      @param [in,out] evt The user defined object every machine handles in turn
+	 *
+	 *      @return the input parameter reference
+	 */
+	template<typename E>
+	E &broadcast(E &evt)
+	{
+		if (!_sorted)
+		{
+			sort();
+		}
+		// The state object cannot tell a transition : a chain of transitions within one
+		// event may allocate the last state where the first one was. Compare state IDs.
+		for (Entry &entry : _entries)
+		{
+			entry.machine->sendEvent(evt);
+			const StateId id = internal::FrameworkAccess::currentState(*entry.machine)->getStateId();
+			if (id != _ids[entry.bucket])
+			{
+				entry.bucket = bucketOf(id);
+				_sorted = false;
+			}
+		}
+		return evt;
+	}
+
+private:
+	struct Entry
+	{
+		MACHINE *machine;
+		uint32_t bucket;      // The bucket of the state ID the machine was in when bucketed
+	};
+
+	/*!
+	 *  The bucket of a state ID. The states of a population are few, so they are looked up linearly.
+	 */
+	uint32_t bucketOf(StateId id)
+	{
+		size_t b = 0;
+		while (b < _ids.size() && _ids[b] != id)
+		{
+			++b;
+		}
+		if (b == _ids.size())
+		{
+			_ids.push_back(id);
+		}
+		return uint32_t(b);
+	}
+
+	/*!
+	 *  Stable counting sort of the entries by bucket, into a buffer kept between broadcasts
+	 */
+	void sort()
+	{
+		_starts.assign(_ids.size() + 1, 0);
+		for (const Entry &entry : _entries)
+		{
+			++_starts[entry.bucket + 1];
+		}
+		for (size_t b = 1; b < _starts.size(); ++b)
+		{
+			_starts[b] += _starts[b - 1];
+		}
+		_scratch.resize(_entries.size());
+		for (const Entry &entry : _entries)
+		{
+			_scratch[_starts[entry.bucket]++] = entry;
+		}
+		_entries.swap(_scratch);
+		_sorted = true;
+	}
+
+	std::vector<Entry> _entries;
+	std::vector<Entry> _scratch;
+	std::vector<StateId> _ids;
+	std::vector<size_t> _starts;
+	bool _sorted = true;
+};
+
+} // End of namespace
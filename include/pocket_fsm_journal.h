@@ -0,0 +1,649 @@
+/*!
+ *  @file pocket_fsm_journal.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: event journal and deterministic replay.
+ *  The events sent to selected state machines are recorded, along with the resulting
+ *  state ID, in a segmented append-only log. The log is replayed from memory mapped
+ *  segments, and the replayed states are checked against the recorded ones.
+ *  Requires a POSIX system.
+ */
+
+#pragma once
+
+#include "pocket_fsm_codec.h"
+#include <chrono>             // std::chrono::milliseconds
+#include <condition_variable> // std::condition_variable
+#include <cstddef>            // offsetof
+#include <cstdio>             // std::snprintf
+#include <fcntl.h>            // open
+#include <mutex>              // std::mutex
+#include <string>             // std::string
+#include <sys/mman.h>         // mmap
+#include <sys/stat.h>         // mkdir, fstat
+#include <thread>             // std::thread
+#include <vector>             // std::vector
+
+#if !defined(POCKET_FSM_CXX17)
+#error "pocket_fsm_journal.h requires C++17"
+#endif
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. List the events of your state machine in an EventList. Events are encoded with
+	their WireLayout, see pocket_fsm_codec.h.
+2. Derive your state machine from JournaledStateMachine<BaseState, Events> instead of
+	FiniteStateMachine<BaseState>.
+3. Open an EventJournal on a directory and attach it to the machines to record, each
+	with a unique machine ID. Every event they react to, sent alone or in a variant, is
+	then appended to the journal. Query events, which cannot change the state, are not.
+4. Call commit() on the journal to wait until the recorded events are on disk.
+	Events are written and synced in groups by a background thread in any case.
+5. Replay with JournalReplay<Events>, resolving each machine ID to a state machine
+	constructed in the same initial state as the recorded one.
+
+************************************************************************************/
+
+namespace internal
+{
+constexpr char JOURNAL_MAGIC[8] = { 'P', 'F', 'S', 'M', 'J', 'R', 'N', 'L' };
+constexpr uint32_t JOURNAL_VERSION = 1;
+
+/*!
+ *  Header at the start of each segment file
+ */
+struct JournalSegmentHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+/*!
+ *  Header preceding each event in a segment. The payload follows, padded to 8 bytes.
+ */
+struct JournalRecord
+{
+	FrameHeader frame;  // Payload length and event type ID
+	uint64_t machine;   // ID given to the machine when attaching the journal
+	StateId stateAfter; // State of the machine after handling the event
+	uint32_t reserved;
+};
+static_assert(sizeof(JournalRecord) == 24, "Journal records keep payloads aligned");
+
+inline std::string journalSegmentPath(const std::string &directory, unsigned index)
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "/segment-%08u.log", index);
+	return directory + name;
+}
+
+/*!
+ *  Encodes the events of an EventList given as a pointer and the ID of their type
+ */
+template<class EVENTS>
+struct JournalEncoder;
+
+template<typename... Es>
+struct JournalEncoder<EventList<Es...>>
+{
+	using Size = size_t (*)(const void *);
+	using Encode = void (*)(const void *, uint8_t *);
+
+	/*!
+	 *  Index of an event type in the list, or the size of the list if it is not registered
+	 */
+	static size_t indexOf(uint32_t eventType)
+	{
+		static constexpr uint32_t ids[] = { eventTypeId<Es>()..., 0 };
+		size_t i = 0;
+		while (i < sizeof...(Es) && ids[i] != eventType)
+		{
+			++i;
+		}
+		return i;
+	}
+
+	static size_t size(size_t index, const void *evt)
+	{
+		static constexpr Size sizes[] = { &sizeOf<Es>..., nullptr };
+		return sizes[index](evt);
+	}
+
+	static void encode(size_t index, const void *evt, uint8_t *out)
+	{
+		static constexpr Encode encoders[] = { &encodeAs<Es>..., nullptr };
+		encoders[index](evt, out);
+	}
+
+private:
+	template<typename E>
+	static size_t sizeOf(const void *evt)
+	{
+		return WireLayout<E>::size(*static_cast<const E *>(evt));
+	}
+
+	template<typename E>
+	static void encodeAs(const void *evt, uint8_t *out)
+	{
+		WireLayout<E>::encode(*static_cast<const E *>(evt), out);
+	}
+};
+}
+
+/*!
+ *  Receives the records of journaled state machines
+ */
+class RecordSink
+{
+public:
+	virtual ~RecordSink() = default;
+
+	/*!
+	 *  Append complete records. Called under the lock of the recording state machine.
+	 *
+	 *      @param [in] records One or more records, each a JournalRecord followed by its payload
+	 *      @param [in] size The number of bytes of the records
+	 *
+	 *      @return The sequence number of the records
+	 */
+	virtual uint64_t append(const uint8_t *records, size_t size) = 0;
+};
+
+/*!
+ *  A segmented append-only log of events. Appending only copies the record into memory;
+ *  a background thread writes the records and syncs them to disk in groups.
+ */
+class EventJournal : public RecordSink
+{
+public:
+	/*!
+	 *  Constructor. Creates the directory if needed and starts a new segment after the existing ones.
+	 *
+	 *      @param [in] directory The directory holding the segment files
+	 *      @param [in] segmentSize The size after which a new segment is started
+	 *      @param [in] commitInterval The longest time records wait before being written
+	 */
+	explicit EventJournal(const std::string &directory, size_t segmentSize = 64 * 1024 * 1024,
+		std::chrono::milliseconds commitInterval = std::chrono::milliseconds(2))
+		: _directory(directory)
+		, _segmentSize(segmentSize)
+		, _commitInterval(commitInterval)
+	{
+		::mkdir(directory.c_str(), 0755);
+		while (::access(internal::journalSegmentPath(_directory, _segmentIndex).c_str(), F_OK) == 0)
+		{
+			++_segmentIndex;
+		}
+		if (openSegment())
+		{
+			_flusher = std::thread(&EventJournal::flushLoop, this);
+		}
+		else
+		{
+			_failed = true; // No flusher : nothing would ever drain the appended records
+		}
+	}
+
+	EventJournal(const EventJournal &) = delete;
+
+	/*!
+	 *  Destructor. Writes and syncs all the appended records.
+	 */
+	~EventJournal()
+	{
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			_running = false;
+		}
+		_wakeFlusher.notify_one();
+		if (_flusher.joinable())
+		{
+			_flusher.join();
+		}
+		if (_fd >= 0)
+		{
+			::close(_fd);
+		}
+	}
+
+	/*!
+	 *  Whether the journal could open its first segment file and has not failed since
+	 */
+	inline bool isOpen() const
+	{
+		return !failed();
+	}
+
+	/*!
+	 *  Whether opening or writing a segment failed. Records appended afterwards are dropped.
+	 */
+	inline bool failed() const
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		return _failed;
+	}
+
+	/*!
+	 *  Append complete records to the journal.
+	 *
+	 *      @param [in] records One or more records, each a JournalRecord followed by its payload
+	 *      @param [in] size The number of bytes of the records
+	 *
+	 *      @return The sequence number of the records, to be passed to commit(), or 0 if the journal failed
+	 */
+	uint64_t append(const uint8_t *records, size_t size) override
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		if (_failed)
+		{
+			return 0; // Dropped, rather than piling up in memory with no flusher to write them
+		}
+		_pending.insert(_pending.end(), records, records + size);
+		_appended += size;
+		return _appended;
+	}
+
+	/*!
+	 *  Wait until the records up to a sequence number are synced to disk.
+	 *
+	 *      @param [in] sequence The value returned by append(), or all records by default
+	 *
+	 *      @return Whether the records were synced, false if writing failed
+	 */
+	bool commit(uint64_t sequence = UINT64_MAX)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (sequence > _appended)
+		{
+			sequence = _appended;
+		}
+		_wakeFlusher.notify_one();
+		_committed.wait(lock, [this, sequence]() { return _durable >= sequence || _failed; });
+		return _durable >= sequence && !_failed;
+	}
+
+private:
+	bool openSegment()
+	{
+		const std::string path = internal::journalSegmentPath(_directory, _segmentIndex);
+		_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (_fd < 0)
+		{
+			return false;
+		}
+		internal::JournalSegmentHeader header = {};
+		std::memcpy(header.magic, internal::JOURNAL_MAGIC, sizeof(header.magic));
+		header.version = internal::JOURNAL_VERSION;
+		_segmentBytes = sizeof(header);
+		return writeAll(reinterpret_cast<const uint8_t *>(&header), sizeof(header));
+	}
+
+	bool writeAll(const uint8_t *data, size_t size)
+	{
+		while (size > 0)
+		{
+			ssize_t written = ::write(_fd, data, size);
+			if (written < 0)
+			{
+				if (errno == EINTR) continue;
+				return false;
+			}
+			data += written;
+			size -= size_t(written);
+		}
+		return true;
+	}
+
+	/*!
+	 *  Write a batch of records, starting new segments at record boundaries, then sync.
+	 */
+	bool writeBatch(const std::vector<uint8_t> &batch)
+	{
+		size_t offset = 0;
+		while (offset < batch.size())
+		{
+			// Gather as many records as the current segment can take
+			size_t end = offset;
+			while (end < batch.size())
+			{
+				internal::JournalRecord record;
+				std::memcpy(&record, batch.data() + end, sizeof(record));
+				const size_t recordSize = sizeof(record) + internal::padFrame(record.frame.length);
+				if (_segmentBytes + (end - offset) + recordSize > _segmentSize && (end > offset || _segmentBytes > sizeof(internal::JournalSegmentHeader)))
+				{
+					break;
+				}
+				end += recordSize;
+			}
+
+			if (end > offset)
+			{
+				if (!writeAll(batch.data() + offset, end - offset))
+				{
+					return false;
+				}
+				_segmentBytes += end - offset;
+				offset = end;
+			}
+			else
+			{
+				if (::fdatasync(_fd) != 0)
+				{
+					return false;
+				}
+				::close(_fd);
+				++_segmentIndex;
+				if (!openSegment())
+				{
+					return false;
+				}
+			}
+		}
+		return ::fdatasync(_fd) == 0;
+	}
+
+	void flushLoop()
+	{
+		std::vector<uint8_t> batch;
+		std::unique_lock<std::mutex> lock(_mutex);
+		while (_running || !_pending.empty())
+		{
+			_wakeFlusher.wait_for(lock, _commitInterval, [this]() { return !_running || !_pending.empty(); });
+			if (_pending.empty())
+			{
+				continue;
+			}
+
+			// Write the whole group outside of the lock so that appending never waits on the disk
+			batch.swap(_pending);
+			const uint64_t sequence = _appended;
+			lock.unlock();
+			const bool written = !_failed && writeBatch(batch);
+			batch.clear();
+			lock.lock();
+
+			if (written)
+			{
+				_durable = sequence;
+			}
+			else
+			{
+				_failed = true;
+			}
+			_committed.notify_all();
+		}
+	}
+
+	const std::string _directory;
+	const size_t _segmentSize;
+	const std::chrono::milliseconds _commitInterval;
+	int _fd = -1;
+	unsigned _segmentIndex = 0;
+	size_t _segmentBytes = 0; // Written by the flusher thread only
+
+	mutable std::mutex _mutex;
+	std::condition_variable _wakeFlusher;
+	std::condition_variable _committed;
+	std::vector<uint8_t> _pending;
+	uint64_t _appended = 0;
+	uint64_t _durable = 0;
+	bool _running = true;
+	bool _failed = false;
+	std::thread _flusher;
+};
+
+/*!
+ *  A FiniteStateMachine recording the events it handles in an EventJournal, once attached.
+ *
+ *      @tparam BASE The name of your base state
+ *      @tparam EVENTS The EventList of the events that can be recorded
+ */
+template<class BASE, class EVENTS>
+class JournaledStateMachine : public FiniteStateMachine<BASE>
+{
+protected:
+	using FSM = FiniteStateMachine<BASE>;
+	using OnEntry = internal::OnEntry;
+	using OnExit = internal::OnExit;
+
+public:
+	/*!
+	 *  Start or stop recording the events handled by this state machine.
+	 *
+	 *      @param [in] journal The journal, or any other sink, to record to, or nullptr to stop recording
+	 *      @param [in] machineId The ID identifying this state machine in the journal
+	 */
+	void attachJournal(RecordSink *journal, uint64_t machineId = 0)
+	{
+		this->lock();
+		_journal = journal;
+		_machineId = machineId;
+		FSM::setEventHooks(journal != nullptr);
+		this->unlock();
+	}
+
+protected:
+	/*!
+	 *  Encode the event before the state machine reacts to it, so that the journal holds
+	 *  the input values of inout fields. Events of types missing from EVENTS are not recorded.
+	 */
+	void beforeEvent(const void *evt, uint32_t eventType) override
+	{
+		using Encoder = internal::JournalEncoder<EVENTS>;
+		const size_t index = Encoder::indexOf(eventType);
+		_recording = index < EVENTS::size;
+		internal::ASSERT(_recording, L"The event type is not registered in the EventList of the journal!");
+		if (!_recording)
+		{
+			return;
+		}
+
+		// The scratch buffer is reused, so recording does not allocate once warmed up
+		const size_t length = Encoder::size(index, evt);
+		_scratch.resize(sizeof(internal::JournalRecord) + internal::padFrame(length));
+		internal::JournalRecord record = {};
+		record.frame.length = uint32_t(length);
+		record.frame.type = uint16_t(index);
+		record.machine = _machineId;
+		std::memcpy(_scratch.data(), &record, sizeof(record));
+		Encoder::encode(index, evt, _scratch.data() + sizeof(record));
+		std::memset(_scratch.data() + sizeof(record) + length, 0, _scratch.size() - sizeof(record) - length);
+	}
+
+	/*!
+	 *  Append the record of the event with the state it led to
+	 */
+	void afterEvent() override
+	{
+		if (!_recording)
+		{
+			return;
+		}
+		_recording = false;
+		const StateId stateAfter = FSM::_currentState->getStateId();
+		std::memcpy(_scratch.data() + offsetof(internal::JournalRecord, stateAfter), &stateAfter, sizeof(stateAfter));
+		_journal->append(_scratch.data(), _scratch.size());
+	}
+
+private:
+	RecordSink *_journal = nullptr;
+	uint64_t _machineId = 0;
+	std::vector<uint8_t> _scratch;
+	bool _recording = false; // Whether _scratch holds the event being handled
+};
+
+/*!
+ *  The outcome of a replay
+ */
+struct ReplayResult
+{
+	uint64_t events = 0;     // Events replayed
+	uint64_t skipped = 0;    // Events of unknown types or machines
+	uint64_t mismatches = 0; // Events after which the state differs from the recorded one
+	bool corrupted = false;  // A segment could not be read to its end
+
+	// First mismatch, valid if mismatches > 0
+	uint64_t mismatchMachine = 0;
+	unsigned mismatchSegment = 0;
+	size_t mismatchOffset = 0;
+	StateId expectedState = 0;
+	StateId actualState = 0;
+};
+
+/*!
+ *  Replays a journal from its memory mapped segments. The events are decoded straight from
+ *  private copy-on-write mappings, so the files are never modified.
+ *
+ *      @tparam EVENTS The EventList the journal was recorded with
+ */
+template<class EVENTS>
+class JournalReplay
+{
+public:
+	/*!
+	 *  Constructor. Maps all the segments of the journal in order.
+	 *
+	 *      @param [in] directory The directory holding the segment files
+	 */
+	explicit JournalReplay(const std::string &directory)
+	{
+		for (unsigned index = 0; ; ++index)
+		{
+			const int fd = ::open(internal::journalSegmentPath(directory, index).c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0)
+			{
+				break;
+			}
+			struct stat info;
+			Segment segment = { nullptr, 0 };
+			if (::fstat(fd, &info) == 0 && info.st_size > 0)
+			{
+				segment.size = size_t(info.st_size);
+				void *data = ::mmap(nullptr, segment.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+				segment.data = data == MAP_FAILED ? nullptr : static_cast<uint8_t *>(data);
+				if (segment.data)
+				{
+					::madvise(data, segment.size, MADV_SEQUENTIAL);
+				}
+			}
+			::close(fd);
+			_segments.push_back(segment);
+		}
+	}
+
+	JournalReplay(const JournalReplay &) = delete;
+
+	~JournalReplay()
+	{
+		for (Segment &segment : _segments)
+		{
+			if (segment.data)
+			{
+				::munmap(segment.data, segment.size);
+			}
+		}
+	}
+
+	/*!
+	 *  Number of segments found
+	 */
+	inline size_t segmentCount() const
+	{
+		return _segments.size();
+	}
+
+	/*!
+	 *  Send all the recorded events to their state machines as fast as possible,
+	 *  checking after each event that the machine is in the recorded state.
+	 *
+	 *      @param [in] resolve A function returning the state machine of a machine ID, or nullptr to skip its events
+	 *
+	 *      @return The outcome of the replay
+	 */
+	template<typename RESOLVER>
+	ReplayResult run(RESOLVER &&resolve)
+	{
+		ReplayResult result;
+		for (unsigned index = 0; index < _segments.size(); ++index)
+		{
+			const Segment &segment = _segments[index];
+			internal::JournalSegmentHeader header;
+			if (!segment.data || segment.size < sizeof(header))
+			{
+				result.corrupted = true;
+				break;
+			}
+			std::memcpy(&header, segment.data, sizeof(header));
+			if (std::memcmp(header.magic, internal::JOURNAL_MAGIC, sizeof(header.magic)) != 0 || header.version != internal::JOURNAL_VERSION)
+			{
+				result.corrupted = true;
+				break;
+			}
+
+			size_t offset = sizeof(header);
+			while (segment.size - offset >= sizeof(internal::JournalRecord))
+			{
+				internal::JournalRecord record;
+				std::memcpy(&record, segment.data + offset, sizeof(record));
+				const size_t recordSize = sizeof(record) + internal::padFrame(record.frame.length);
+				if (segment.size - offset < recordSize)
+				{
+					break; // Torn write at the end of the segment
+				}
+
+				auto machine = resolve(record.machine);
+				int sent = 0;
+				if (machine)
+				{
+					sent = Codec<EVENTS>::dispatchPayload(record.frame.type, segment.data + offset + sizeof(record), record.frame.length, *machine);
+				}
+				if (sent < 0)
+				{
+					result.corrupted = true;
+					return result;
+				}
+				else if (sent == 0)
+				{
+					++result.skipped;
+				}
+				else
+				{
+					++result.events;
+					const StateId actual = machine->getCurrentStateId();
+					if (actual != record.stateAfter && result.mismatches++ == 0)
+					{
+						result.mismatchMachine = record.machine;
+						result.mismatchSegment = index;
+						result.mismatchOffset = offset;
+						result.expectedState = record.stateAfter;
+						result.actualState = actual;
+					}
+				}
+				offset += recordSize;
+			}
+			if (offset != segment.size)
+			{
+				result.corrupted = true;
+				break;
+			}
+		}
+		return result;
+	}
+
+private:
+	struct Segment
+	{
+		uint8_t *data;
+		size_t size;
+	};
+
+	std::vector<Segment> _segments;
+};
+
+} // End of namespace
@@ -0,0 +1,225 @@
+/*!
+ *  @file pocket_fsm_lockstep.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: lockstep stepping of many identical table machines.
+ *  Each machine is a single byte holding the index of its state in a StateList, and the
+ *  same symbol is applied to all of them through the column of a TransitionTable, with
+ *  byte shuffles when AVX2 or SSSE3 is enabled. A callback runs only for the machines
+ *  whose state changed.
+ */
+
+#pragma once
+
+#include "pocket_fsm_table.h"
+#include <vector>     // std::vector
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h> // _mm256_shuffle_epi8, _mm_shuffle_epi8
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>    // _BitScanForward
+#endif
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. Build a TransitionTable<States, Symbols> describing the machines, as for a
+	TableStateMachine.
+2. Create LockstepMachines<States, Symbols> with the table, the number of machines and
+	the ID of their initial state. Keep the per machine data in your own arrays, indexed
+	like the machines.
+3. Call step(symbol, onChange) to apply a symbol to every machine. onChange(machine,
+	from, to) is called for each machine whose state changed, with state indexes in the
+	StateList, and returns the state to keep : usually to. For reacting cells, to is
+	TransitionTable::REACT and onChange decides the state itself.
+
+Compile with AVX2 or SSSE3 enabled to use the vector path for up to 32 or 16 states.
+Other configurations use the scalar path, with the same results.
+
+************************************************************************************/
+
+namespace internal
+{
+inline unsigned countTrailingZeros(uint32_t mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return unsigned(index);
+#else
+	return unsigned(__builtin_ctz(mask));
+#endif
+}
+}
+
+/*!
+ *  A population of table machines stepped together
+ *
+ *      @tparam STATES The StateList of the concrete states
+ *      @tparam SYMBOLS The number of token classes
+ */
+template<class STATES, size_t SYMBOLS>
+class LockstepMachines
+{
+public:
+	using Table = TransitionTable<STATES, SYMBOLS>;
+
+	/*!
+	 *  Constructor
+	 *
+	 *      @param [in] table The transition table, which needs to outlive the machines
+	 *      @param [in] count The number of machines
+	 *      @param [in] initial The ID of the state every machine starts in
+	 */
+	LockstepMachines(const Table &table, size_t count, StateId initial)
+		: _table(table)
+		, _states(count, uint8_t(STATES::indexOf(initial)))
+	{
+		internal::ASSERT(STATES::indexOf(initial) < STATES::size, L"The initial state is missing from the StateList!");
+	}
+
+	/*!
+	 *  Index of a state in the StateList, as passed to the onChange callback
+	 */
+	template<class S>
+	static constexpr uint8_t indexOf()
+	{
+		return uint8_t(STATES::template indexOf<S>());
+	}
+
+	/*!
+	 *  Apply a symbol to every machine
+	 *
+	 *      @param [in] symbol The class of the token received by every machine
+	 *      @param [in] onChange uint8_t(size_t machine, uint8_t from, uint8_t to), returning the state to keep
+	 *
+	 *      @return The number of machines whose state changed or reacted
+	 */
+	template<typename ON_CHANGE>
+	size_t step(size_t symbol, ON_CHANGE &&onChange)
+	{
+		internal::ASSERT(symbol < SYMBOLS, L"Symbol out of range of the transition table!");
+		alignas(32) uint8_t column[256] = {};
+		for (size_t s = 0; s < STATES::size; ++s)
+		{
+			column[s] = _table.next(s, symbol);
+		}
+
+		uint8_t *states = _states.data();
+		const size_t count = _states.size();
+		size_t changed = 0;
+		size_t i = 0;
+#if defined(__AVX2__)
+		if (STATES::size <= 32)
+		{
+			// vpshufb looks up within each 128 bits lane : both lanes hold the same 16 entries
+			const __m256i low = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(column)));
+			const __m256i high = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(column + 16)));
+			const __m256i bit4 = _mm256_set1_epi8(0x10);
+			for (; i + 32 <= count; i += 32)
+			{
+				const __m256i from = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(states + i));
+				const __m256i useHigh = _mm256_cmpeq_epi8(_mm256_and_si256(from, bit4), bit4);
+				const __m256i to = _mm256_blendv_epi8(_mm256_shuffle_epi8(low, from), _mm256_shuffle_epi8(high, from), useHigh);
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(states + i), to);
+				const uint32_t mask = ~uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(from, to)));
+				if (mask)
+				{
+					alignas(32) uint8_t previous[32];
+					_mm256_store_si256(reinterpret_cast<__m256i *>(previous), from);
+					changed += notify(i, mask, previous, onChange);
+				}
+			}
+		}
+#elif defined(__SSSE3__)
+		if (STATES::size <= 16)
+		{
+			const __m128i lookup = _mm_load_si128(reinterpret_cast<const __m128i *>(column));
+			for (; i + 16 <= count; i += 16)
+			{
+				const __m128i from = _mm_loadu_si128(reinterpret_cast<const __m128i *>(states + i));
+				const __m128i to = _mm_shuffle_epi8(lookup, from);
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(states + i), to);
+				const uint32_t mask = ~uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(from, to))) & 0xFFFFu;
+				if (mask)
+				{
+					alignas(16) uint8_t previous[16];
+					_mm_store_si128(reinterpret_cast<__m128i *>(previous), from);
+					changed += notify(i, mask, previous, onChange);
+				}
+			}
+		}
+#endif
+		// Scalar path for the remaining machines, or all of them
+		for (; i < count; ++i)
+		{
+			const uint8_t from = states[i];
+			const uint8_t to = column[from];
+			if (to != from)
+			{
+				states[i] = onChange(i, from, to);
+				internal::ASSERT(states[i] < STATES::size, L"onChange returned a state missing from the StateList!");
+				++changed;
+			}
+		}
+		return changed;
+	}
+
+	/*!
+	 *  The ID of the current state of a machine
+	 */
+	inline StateId stateOf(size_t machine) const
+	{
+		return STATES::idAt(_states[machine]);
+	}
+
+	/*!
+	 *  Put a machine in a state, without any callback
+	 */
+	void setState(size_t machine, StateId state)
+	{
+		internal::ASSERT(STATES::indexOf(state) < STATES::size, L"The state is missing from the StateList!");
+		_states[machine] = uint8_t(STATES::indexOf(state));
+	}
+
+	/*!
+	 *  The state indexes of all the machines, contiguous
+	 */
+	inline const uint8_t *states() const
+	{
+		return _states.data();
+	}
+
+	inline size_t size() const
+	{
+		return _states.size();
+	}
+
+private:
+	/*!
+	 *  Call onChange for the machines of a vector whose bit is set in the mask
+	 */
+	template<typename ON_CHANGE>
+	size_t notify(size_t first, uint32_t mask, const uint8_t *previous, ON_CHANGE &onChange)
+	{
+		size_t changed = 0;
+		for (; mask; mask &= mask - 1)
+		{
+			const unsigned lane = internal::countTrailingZeros(mask);
+			const size_t machine = first + lane;
+			_states[machine] = onChange(machine, previous[lane], _states[machine]);
+			internal::ASSERT(_states[machine] < STATES::size, L"onChange returned a state missing from the StateList!");
+			++changed;
+		}
+		return changed;
+	}
+
+	const Table &_table;
+	std::vector<uint8_t> _states;
+};
+
+} // End of namespace
@@ -0,0 +1,332 @@
+/*!
+ *  @file pocket_fsm_mapped.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: state machines persisted in a memory mapped file.
+ *  Each machine is a fixed size record holding its state ID and the trivially copyable
+ *  data of its pimpl. Restarting a process maps the file and resumes where it stopped.
+ *  Requires a POSIX system.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <cstring>    // std::memcpy
+#include <fcntl.h>    // open
+#include <string>     // std::string
+#include <sys/mman.h> // mmap, msync
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // ftruncate
+#include <vector>     // std::vector
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. Put all the data of your pimpl in a trivially copyable structure, and derive your
+	pimpl from MappedPimpl<Data>. Its functions access the data with data(). Other
+	members of the pimpl are not persisted.
+2. List your concrete states in a StateList and derive your state machine from
+	MappedStateMachine<BaseState, States>. Its constructor takes a MappedRecord<Data>
+	and calls attach<InitialState>(record) instead of initialize().
+3. Open a MappedMachines<Machine, Data> on a file with the number of machines and the
+	version of your data layout. Opening only maps the file: machines are constructed
+	from their record on first access.
+4. Call checkpoint() while no event is being sent to flush the file to disk.
+
+Only the top level state is persisted: nested state machines are not supported.
+
+************************************************************************************/
+
+/*!
+ *  The persisted part of a state machine
+ *
+ *      @tparam DATA The trivially copyable data of the pimpl
+ */
+template<class DATA>
+struct MappedRecord
+{
+	static_assert(std::is_trivially_copyable<DATA>::value, "The data of a mapped state machine needs to be trivially copyable");
+
+	StateId state;   // 0 until the state machine is initialized
+	uint32_t reserved;
+	DATA data;
+};
+
+/*!
+ *  A pimpl whose data lives in a MappedRecord
+ *
+ *      @tparam DATA The trivially copyable data of the pimpl
+ */
+template<class DATA>
+class MappedPimpl : public PimplBase
+{
+public:
+	using Data = DATA;
+
+	inline DATA &data()
+	{
+		return *_data;
+	}
+
+private:
+	template<class, class> friend class MappedStateMachine;
+
+	DATA *_data = nullptr;
+};
+
+/*!
+ *  A FiniteStateMachine mirroring its state ID and pimpl data in a MappedRecord.
+ *
+ *      @tparam BASE The name of your base state, deriving from StatePimplIF<Pimpl>
+ *      @tparam STATES The StateList of all the concrete states of the machine
+ */
+template<class BASE, class STATES>
+class MappedStateMachine : public FiniteStateMachine<BASE>
+{
+protected:
+	using FSM = FiniteStateMachine<BASE>;
+	using OnEntry = internal::OnEntry;
+	using OnExit = internal::OnExit;
+	using Pimpl = internal::FrameworkAccess::PimplOf<BASE>;
+	using Data = typename Pimpl::Data;
+
+	static_assert(std::is_base_of<MappedPimpl<Data>, Pimpl>::value, "The pimpl of a mapped state machine needs to derive from MappedPimpl");
+
+	/*!
+	 *  Descendants call this in their constructor instead of initialize(). If the record
+	 *  holds a state, the state machine resumes in it without calling entry. Otherwise,
+	 *  it is initialized in the initial state.
+	 *
+	 *      @tparam INITIAL The initial state, used if the record is new
+	 *
+	 *      @param [in,out] record The record of this state machine in the mapped file
+	 */
+	template<class INITIAL>
+	void attach(MappedRecord<Data> &record)
+	{
+		static_assert(std::is_base_of<BASE, INITIAL>::value, "The initial state needs to be a descendant of the base state");
+		std::shared_ptr<Pimpl> pimpl = std::make_shared<Pimpl>();
+		static_cast<MappedPimpl<Data> &>(*pimpl)._data = &record.data;
+		_record = &record;
+		FSM::setEventHooks(true);
+
+		BASE *state = record.state ? STATES::template create<BASE>(record.state) : nullptr;
+		internal::ASSERT(state || !record.state, L"The mapped record holds a state missing from the StateList!");
+		if (state)
+		{
+			internal::FrameworkAccess::pimpl(*state) = pimpl;
+			this->lock();
+			FSM::replaceState(std::shared_ptr<BASE>(state));
+			this->unlock();
+		}
+		else
+		{
+			INITIAL *initial = new INITIAL();
+			internal::FrameworkAccess::pimpl(*initial) = pimpl;
+			FSM::initialize(initial);
+			_record->state = FSM::_currentState->getStateId();
+		}
+	}
+
+	/*!
+	 *  Save the state reached after each event in the record
+	 */
+	void afterEvent() override
+	{
+		_record->state = FSM::_currentState->getStateId();
+	}
+
+private:
+	MappedRecord<Data> *_record = nullptr;
+};
+
+namespace internal
+{
+constexpr char MAPPED_MAGIC[8] = { 'P', 'F', 'S', 'M', 'M', 'A', 'P', 'D' };
+constexpr uint32_t MAPPED_FORMAT_VERSION = 1;
+
+/*!
+ *  Header at the start of a mapped file, padded so that records are cache line aligned
+ */
+struct alignas(64) MappedHeader
+{
+	char magic[8];
+	uint32_t formatVersion; // Version of this header
+	uint32_t layoutVersion; // Version of the user data layout
+	uint32_t recordSize;
+	uint32_t recordAlign;
+	uint64_t count;
+};
+}
+
+/*!
+ *  State machines whose records are stored in a memory mapped file.
+ *  Machines are constructed on first access. Not thread safe.
+ *
+ *      @tparam MACHINE Your state machine, constructible from a MappedRecord<DATA>&
+ *      @tparam DATA The trivially copyable data of the pimpl
+ */
+template<class MACHINE, class DATA>
+class MappedMachines
+{
+public:
+	using Record = MappedRecord<DATA>;
+
+	MappedMachines() = default;
+	MappedMachines(const MappedMachines &) = delete;
+
+	~MappedMachines()
+	{
+		close();
+	}
+
+	/*!
+	 *  Map a file, creating it if it does not exist. An existing file is rejected if its
+	 *  layout version, record size or number of machines differ.
+	 *
+	 *      @param [in] path The file holding the machines
+	 *      @param [in] count The number of machines
+	 *      @param [in] layoutVersion The version of DATA, to change whenever its layout changes
+	 *
+	 *      @return Whether the file could be mapped
+	 */
+	bool open(const std::string &path, size_t count, uint32_t layoutVersion)
+	{
+		close();
+		const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0)
+		{
+			return false;
+		}
+
+		internal::MappedHeader expected;
+		std::memset(&expected, 0, sizeof(expected)); // Padding is compared as well
+		std::memcpy(expected.magic, internal::MAPPED_MAGIC, sizeof(expected.magic));
+		expected.formatVersion = internal::MAPPED_FORMAT_VERSION;
+		expected.layoutVersion = layoutVersion;
+		expected.recordSize = uint32_t(sizeof(Record));
+		expected.recordAlign = uint32_t(alignof(Record));
+		expected.count = count;
+		const size_t size = sizeof(internal::MappedHeader) + count * sizeof(Record);
+
+		struct stat info;
+		bool valid = ::fstat(fd, &info) == 0;
+		const bool created = valid && info.st_size == 0;
+		if (created)
+		{
+			// The file is sparse : records read as zero, which is an uninitialized machine
+			valid = ::ftruncate(fd, off_t(size)) == 0 && ::pwrite(fd, &expected, sizeof(expected), 0) == ssize_t(sizeof(expected));
+		}
+		else if (valid)
+		{
+			internal::MappedHeader header;
+			valid = size_t(info.st_size) == size && ::pread(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header)) &&
+				std::memcmp(&header, &expected, sizeof(header)) == 0;
+		}
+
+		void *data = valid ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+		::close(fd);
+		if (data == MAP_FAILED)
+		{
+			return false;
+		}
+
+		_data = static_cast<uint8_t *>(data);
+		_size = size;
+		_count = count;
+		_chunks.resize((count + CHUNK - 1) / CHUNK);
+		return true;
+	}
+
+	/*!
+	 *  Destroy the machines, without calling exit, and unmap the file.
+	 */
+	void close()
+	{
+		if (!_data)
+		{
+			return;
+		}
+		// Exit is not called : the machines are only suspended and resume at the next open()
+		for (std::unique_ptr<std::unique_ptr<MACHINE>[]> &chunk : _chunks)
+		{
+			for (size_t i = 0; chunk && i < CHUNK; ++i)
+			{
+				if (chunk[i])
+				{
+					internal::FrameworkAccess::replaceState(*chunk[i], nullptr);
+				}
+			}
+		}
+		_chunks.clear();
+		::munmap(_data, _size);
+		_data = nullptr;
+		_size = 0;
+		_count = 0;
+	}
+
+	inline bool isOpen() const
+	{
+		return _data != nullptr;
+	}
+
+	inline size_t size() const
+	{
+		return _count;
+	}
+
+	/*!
+	 *  Access a machine, constructing it from its record on first access
+	 */
+	MACHINE &operator[](size_t index)
+	{
+		internal::ASSERT(index < _count, L"Mapped machine index out of range!");
+		std::unique_ptr<std::unique_ptr<MACHINE>[]> &chunk = _chunks[index / CHUNK];
+		if (!chunk)
+		{
+			chunk.reset(new std::unique_ptr<MACHINE>[CHUNK]);
+		}
+		std::unique_ptr<MACHINE> &machine = chunk[index % CHUNK];
+		if (!machine)
+		{
+			machine.reset(new MACHINE(record(index)));
+		}
+		return *machine;
+	}
+
+	/*!
+	 *  Access the record of a machine directly
+	 */
+	inline Record &record(size_t index)
+	{
+		return reinterpret_cast<Record *>(_data + sizeof(internal::MappedHeader))[index];
+	}
+
+	/*!
+	 *  Flush the records to disk. Call it while no event is being sent.
+	 *
+	 *      @param [in] wait Whether to wait for the data to be written
+	 *
+	 *      @return Whether the flush succeeded or was scheduled
+	 */
+	bool checkpoint(bool wait = true)
+	{
+		return _data && ::msync(_data, _size, wait ? MS_SYNC : MS_ASYNC) == 0;
+	}
+
+private:
+	uint8_t *_data = nullptr;
+	size_t _size = 0;
+	size_t _count = 0;
+
+	// Machines are reached through chunks allocated on first access, so that opening
+	// a file of millions of records costs one pointer per chunk
+	static constexpr size_t CHUNK = 1024;
+	std::vector<std::unique_ptr<std::unique_ptr<MACHINE>[]>> _chunks;
+};
+
+} // End of namespace
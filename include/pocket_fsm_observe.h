@@ -0,0 +1,274 @@
+/*!
+ *  @file pocket_fsm_observe.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: lock free observation of the current state.
+ *  After each event, the state machine publishes the ID and name of its current state,
+ *  and optionally a summary of its pimpl, behind a sequence lock. Any number of threads
+ *  can read the latest publication without taking the lock of the state machine.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <atomic>     // std::atomic, std::atomic_thread_fence
+#include <cstring>    // std::memcpy
+#include <thread>     // std::this_thread::yield
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. Derive your state machine from ObservableStateMachine<BaseState> instead of
+	FiniteStateMachine<BaseState>. The concrete states need the CONCRETE_STATE macro for
+	their ID to be published.
+2. Optionally, specialize PimplSummary<Pimpl> in your source file to publish a few
+	trivially copyable fields of the pimpl along with the state.
+3. Any thread calls observe() to get the latest publication, without locking.
+
+Publications happen after each event reacted to, sent alone or in a variant, and in
+initialize(). Call publish() after replacing the state by other means, such as
+restoring a snapshot.
+
+************************************************************************************/
+
+/*!
+ *  Summarizes a pimpl for observers. Specialize this for your pimpl type with:
+ *      using Summary = MySummary; // Trivially copyable and default constructible
+ *      static Summary summarize(const Pimpl &pimpl);
+ *  By default, nothing is summarized.
+ *
+ *      @tparam Pimpl The implementation class of the state machine
+ */
+template<class Pimpl>
+struct PimplSummary
+{
+	struct Summary {};
+
+	static Summary summarize(const Pimpl &)
+	{
+		return Summary();
+	}
+};
+
+/*!
+ *  The state of a state machine as last published
+ *
+ *      @tparam SUMMARY The summary of the pimpl
+ */
+template<class SUMMARY>
+struct StateObservation
+{
+	StateId id = 0;
+	const char *name = "";  // Points to the stringified name of the state, which is never freed
+	uint64_t version = 0;   // Number of publications, 0 before initialize
+	SUMMARY summary = SUMMARY();
+};
+
+namespace internal
+{
+/*!
+ *  A value published by a single writer and read by any number of readers without locks.
+ *  The value is copied through relaxed atomic words, so concurrent reads are well defined.
+ *
+ *      @tparam T A trivially copyable and default constructible type
+ */
+template<class T>
+class SeqLocked
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Values behind a sequence lock need to be trivially copyable");
+	static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+public:
+	SeqLocked()
+	{
+		for (std::atomic<uint64_t> &word : _words)
+		{
+			word.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	/*!
+	 *  Publish a value. Only one thread may store at a time.
+	 *
+	 *      @return The number of stores so far
+	 */
+	uint64_t store(const T &value)
+	{
+		uint64_t words[WORDS] = {};
+		std::memcpy(words, &value, sizeof(T));
+		const uint64_t sequence = _sequence.load(std::memory_order_relaxed);
+		_sequence.store(sequence + 1, std::memory_order_relaxed); // Odd : write in progress
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < WORDS; ++i)
+		{
+			_words[i].store(words[i], std::memory_order_relaxed);
+		}
+		_sequence.store(sequence + 2, std::memory_order_release);
+		return sequence / 2 + 1;
+	}
+
+	/*!
+	 *  Read the latest value, retrying while a store is in progress
+	 *
+	 *      @param [out] version The number of stores before this value was read
+	 */
+	T load(uint64_t &version) const
+	{
+		uint64_t words[WORDS];
+		uint64_t sequence;
+		for (unsigned attempt = 0;; ++attempt)
+		{
+			sequence = _sequence.load(std::memory_order_acquire);
+			if (sequence & 1)
+			{
+				if (attempt > 64)
+				{
+					std::this_thread::yield(); // The writer may have been preempted
+				}
+				continue;
+			}
+			for (size_t i = 0; i < WORDS; ++i)
+			{
+				words[i] = _words[i].load(std::memory_order_relaxed);
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (_sequence.load(std::memory_order_relaxed) == sequence)
+			{
+				break;
+			}
+		}
+		T value;
+		std::memcpy(&value, words, sizeof(T));
+		version = sequence / 2;
+		return value;
+	}
+
+private:
+	alignas(64) std::atomic<uint64_t> _sequence = { 0 };
+	std::atomic<uint64_t> _words[WORDS];
+};
+
+/*!
+ *  Summarizes the pimpl of a state, if its base state has one
+ */
+template<class BASE, class PIMPL = FrameworkAccess::PimplOf<BASE>>
+struct Summarizer
+{
+	using Summary = typename PimplSummary<PIMPL>::Summary;
+
+	static Summary summarize(BASE &state)
+	{
+		return PimplSummary<PIMPL>::summarize(*static_cast<PIMPL *>(FrameworkAccess::pimpl(state).get()));
+	}
+};
+
+template<class BASE>
+struct Summarizer<BASE, void>
+{
+	struct Summary {};
+
+	static Summary summarize(BASE &)
+	{
+		return Summary();
+	}
+};
+}
+
+/*!
+ *  A FiniteStateMachine publishing its current state for lock free observers.
+ *
+ *      @tparam BASE The name of your base state
+ */
+template<class BASE>
+class ObservableStateMachine : public FiniteStateMachine<BASE>
+{
+protected:
+	using FSM = FiniteStateMachine<BASE>;
+	using OnEntry = internal::OnEntry;
+	using OnExit = internal::OnExit;
+	using Summarizer = internal::Summarizer<BASE>;
+
+public:
+	using Summary = typename Summarizer::Summary;
+	using Observation = StateObservation<Summary>;
+
+	/*!
+	 *  Constructor
+	 */
+	ObservableStateMachine()
+	{
+		FSM::setEventHooks(true);
+	}
+
+	/*!
+	 *  Publish the current state, after replacing it without sendEvent().
+	 */
+	void publish()
+	{
+		this->lock();
+		publishLocked();
+		this->unlock();
+	}
+
+	/*!
+	 *  The latest published state. Lock free, callable from any thread.
+	 */
+	Observation observe() const
+	{
+		uint64_t version = 0;
+		Published published = _published.load(version);
+		Observation observation;
+		observation.id = published.id;
+		observation.name = published.name;
+		observation.version = version;
+		observation.summary = published.summary;
+		return observation;
+	}
+
+protected:
+	/*!
+	 *  Same as FiniteStateMachine::initialize(), then publish the initial state.
+	 */
+	void initialize(BASE *newInitialState)
+	{
+		FSM::initialize(newInitialState);
+		publish();
+	}
+
+	/*!
+	 *  Publish the state reached after each event, whether sent alone or in a variant
+	 */
+	void afterEvent() override
+	{
+		publishLocked();
+	}
+
+private:
+	void publishLocked()
+	{
+		BASE *state = FSM::_currentState.get();
+		_current.id = state ? state->getStateId() : 0;
+		_current.name = FSM::getCurrentStateName();
+		if (state && !std::is_empty<Summary>::value)
+		{
+			_current.summary = Summarizer::summarize(*state);
+		}
+		_published.store(_current);
+	}
+
+	struct Published
+	{
+		StateId id = 0;
+		const char *name = "";
+		Summary summary = Summary();
+	};
+
+	internal::SeqLocked<Published> _published;
+	Published _current; // Writer side copy
+};
+
+} // End of namespace
@@ -0,0 +1,262 @@
+/*!
+ *  @file pocket_fsm_queue.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: prioritized event queue with load shedding.
+ *  Events are posted from any thread into one queue per priority class and delivered
+ *  to the state machine by a single thread. Between two run to completion steps, the
+ *  most urgent queued event is delivered first. When the queue is full, a policy decides
+ *  which event is shed, and counters report it.
+ *  Requires C++17.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <cstdint>    // uint8_t, uint64_t
+#include <deque>      // std::deque
+#include <mutex>      // std::mutex, std::lock_guard
+#include <optional>   // std::optional
+
+#if !defined(POCKET_FSM_CXX17)
+#error "pocket_fsm_queue.h requires C++17"
+#endif
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. List the events queued for your state machine in an EventList.
+2. Create an EventQueue<Machine, Events> for your machine, with its capacity and its
+	shedding policy.
+3. Give urgent event types a higher priority class with setPriority<Event>(priority),
+	before posting. Every event type is in class 0 by default.
+4. Any thread calls post(evt). A single thread calls run() to deliver the queued events
+	to the machine, most urgent class first, in order within a class.
+5. Poll stats() to monitor the depth of the queue and the shed events.
+
+An urgent event does not interrupt the event being processed : it is delivered at the
+next run to completion boundary. Events are never shed to make room for less urgent
+ones.
+
+************************************************************************************/
+
+/*!
+ *  What to do when an event is posted to a full queue
+ */
+enum class ShedPolicy : uint8_t
+{
+	DropOldest,   // Drop the oldest event of the least urgent class, up to the class of the new event
+	RejectNewest, // Reject the new event
+	Coalesce,     // Overwrite the latest queued event of the same type, or reject the new event
+};
+
+/*!
+ *  Metrics of an event queue, read while it is running
+ */
+struct QueueStats
+{
+	size_t depth = 0;       // Events waiting to be delivered
+	uint64_t posted = 0;    // Events accepted by post() since the start, coalesced ones included
+	uint64_t delivered = 0; // Events sent to the state machine
+	uint64_t dropped = 0;   // Queued events dropped to make room
+	uint64_t rejected = 0;  // Posted events refused
+	uint64_t coalesced = 0; // Posted events merged into a queued one
+};
+
+/*!
+ *  A bounded queue of events for a state machine, with priority classes
+ *
+ *      @tparam MACHINE Your state machine type
+ *      @tparam EVENTS The EventList of events that can be posted
+ *      @tparam PRIORITIES The number of priority classes, the highest being the most urgent
+ */
+template<class MACHINE, class EVENTS, size_t PRIORITIES = 2>
+class EventQueue
+{
+	static_assert(PRIORITIES > 0 && PRIORITIES <= 256, "An event queue needs between 1 and 256 priority classes");
+
+public:
+	using Variant = typename EVENTS::Variant;
+
+	/*!
+	 *  Constructor
+	 *
+	 *      @param [in] machine The state machine receiving the events, which needs to outlive the queue
+	 *      @param [in] capacity The maximum number of queued events, across all classes
+	 *      @param [in] policy What to do when an event is posted to a full queue
+	 */
+	explicit EventQueue(MACHINE &machine, size_t capacity = 1024, ShedPolicy policy = ShedPolicy::DropOldest)
+		: _machine(machine)
+		, _capacity(capacity)
+		, _policy(policy)
+	{
+		internal::ASSERT(capacity > 0, L"An event queue needs room for at least one event!");
+	}
+
+	EventQueue(const EventQueue &) = delete;
+
+	/*!
+	 *  Set the priority class of an event type. Call before posting.
+	 */
+	template<typename E>
+	void setPriority(size_t priority)
+	{
+		static_assert(EVENTS::template contains<E>(), "The event type is not registered in the EventList of the queue");
+		internal::ASSERT(priority < PRIORITIES, L"Priority out of range of the event queue!");
+		_priorities[EVENTS::template indexOf<E>()] = uint8_t(priority);
+	}
+
+	/*!
+	 *  Queue an event. Can be called from any thread, including from a react.
+	 *
+	 *      @param [in] evt The event to deliver later to the state machine
+	 *
+	 *      @return false if the event was rejected
+	 */
+	template<typename E>
+	bool post(const E &evt)
+	{
+		static_assert(EVENTS::template contains<E>(), "The event type is not registered in the EventList of the queue");
+		constexpr size_t type = EVENTS::template indexOf<E>();
+		const size_t priority = _priorities[type];
+		std::lock_guard<std::mutex> guard(_mutex);
+		if (_depth == _capacity)
+		{
+			if (_policy == ShedPolicy::Coalesce && coalesce(priority, evt))
+			{
+				return true;
+			}
+			if (_policy != ShedPolicy::DropOldest || !dropOldest(priority))
+			{
+				++_stats.rejected;
+				return false;
+			}
+		}
+		_classes[priority].emplace_back(std::in_place_index<type>, evt);
+		++_queuedOfType[type];
+		++_depth;
+		++_stats.posted;
+		return true;
+	}
+
+	/*!
+	 *  Deliver the queued events to the state machine, most urgent first. Only one thread
+	 *  may run the queue. Events posted meanwhile are delivered in the same call.
+	 *
+	 *      @param [in] max The maximum number of events to deliver
+	 *
+	 *      @return The number of events delivered
+	 */
+	size_t run(size_t max = SIZE_MAX)
+	{
+		size_t delivered = 0;
+		while (delivered < max)
+		{
+			// Popped into an optional : the events need no default constructor
+			std::optional<Variant> evt = pop();
+			if (!evt)
+			{
+				break;
+			}
+			_machine.sendEvent(*evt);
+			++delivered;
+		}
+		return delivered;
+	}
+
+	/*!
+	 *  Metrics of the queue. Can be called from any thread.
+	 */
+	QueueStats stats() const
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		QueueStats stats = _stats;
+		stats.depth = _depth;
+		return stats;
+	}
+
+private:
+	std::optional<Variant> pop()
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		for (size_t p = PRIORITIES; p-- > 0;)
+		{
+			std::deque<Variant> &queue = _classes[p];
+			if (!queue.empty())
+			{
+				std::optional<Variant> evt(std::move(queue.front()));
+				queue.pop_front();
+				--_queuedOfType[evt->index()];
+				--_depth;
+				++_stats.delivered;
+				return evt;
+			}
+		}
+		return std::nullopt;
+	}
+
+	/*!
+	 *  Drop the oldest event of the least urgent class, up to a priority. Called under the mutex.
+	 *
+	 *      @return false if every queued event is more urgent
+	 */
+	bool dropOldest(size_t priority)
+	{
+		for (size_t p = 0; p <= priority; ++p)
+		{
+			std::deque<Variant> &queue = _classes[p];
+			if (!queue.empty())
+			{
+				--_queuedOfType[queue.front().index()];
+				queue.pop_front();
+				--_depth;
+				++_stats.dropped;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/*!
+	 *  Overwrite the latest queued event of the same type with a newer value. Called under the mutex.
+	 *
+	 *      @return false if no event of this type is queued
+	 */
+	template<typename E>
+	bool coalesce(size_t priority, const E &evt)
+	{
+		constexpr size_t type = EVENTS::template indexOf<E>();
+		if (_queuedOfType[type] == 0)
+		{
+			return false;
+		}
+		std::deque<Variant> &queue = _classes[priority];
+		for (auto it = queue.rbegin(); it != queue.rend(); ++it)
+		{
+			if (it->index() == type)
+			{
+				it->template emplace<type>(evt);
+				++_stats.posted;
+				++_stats.coalesced;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	MACHINE &_machine;
+	const size_t _capacity;
+	const ShedPolicy _policy;
+	mutable std::mutex _mutex;
+	std::deque<Variant> _classes[PRIORITIES];
+	size_t _queuedOfType[EVENTS::size] = {};
+	uint8_t _priorities[EVENTS::size] = {};
+	size_t _depth = 0;
+	QueueStats _stats;
+};
+
+} // End of namespace
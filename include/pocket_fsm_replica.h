@@ -0,0 +1,463 @@
+/*!
+ *  @file pocket_fsm_replica.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: hot standby replication of state machines.
+ *  The records of journaled state machines, and snapshots of whole machines, are
+ *  streamed in batches over a socket to a standby process, which applies them to its
+ *  own machines and acknowledges them. On failover, the standby machines are already
+ *  up to date and can take over right away.
+ *  Requires a POSIX system.
+ */
+
+#pragma once
+
+#include "pocket_fsm_journal.h"
+#include "pocket_fsm_snapshot.h"
+#include <sys/socket.h> // shutdown
+
+#if !defined(POCKET_FSM_CXX17)
+#error "pocket_fsm_replica.h requires C++17"
+#endif
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. Derive your state machines from JournaledStateMachine<BaseState, Events>, and
+	list all their concrete states in a StateList as for snapshots.
+2. On the primary, create a ReplicationPrimary on a connected socket. Send the
+	snapshot of each machine with sendSnapshot(machine, machineId), then attach the
+	primary to the machine with attachJournal(&primary, machineId). Every event the
+	machine handles is then streamed to the standby.
+3. On the standby, create a ReplicaApplier<Events, States> on the other end of the
+	socket and call run(resolve), where resolve returns the standby machine of a
+	machine ID. It returns when the primary goes away : promote the standby then.
+4. On the primary, waitAck() blocks until the standby applied the records appended so
+	far, for synchronous replication.
+
+A snapshot is appended under the lock of its machine. Once the machine is attached,
+its snapshot can be sent again at any time, such as when a new standby connects.
+Before it is attached, events sent between the snapshot and attachJournal() are missed.
+
+************************************************************************************/
+
+namespace internal
+{
+/*!
+ *  Type of the records holding the snapshot of a whole machine instead of an event
+ */
+constexpr uint16_t REPLICA_SNAPSHOT_TYPE = UINT16_MAX;
+}
+
+/*!
+ *  Streams records to a standby process over a socket. Appending only copies the records
+ *  into memory; a background thread sends them in batches.
+ */
+class ReplicationPrimary : public RecordSink
+{
+public:
+	/*!
+	 *  Constructor. Sends the stream header and starts the sending thread.
+	 *
+	 *      @param [in] fd A connected stream socket, which the primary does not close
+	 */
+	explicit ReplicationPrimary(int fd)
+		: _fd(fd)
+	{
+		internal::JournalSegmentHeader header = {};
+		std::memcpy(header.magic, internal::JOURNAL_MAGIC, sizeof(header.magic));
+		header.version = internal::JOURNAL_VERSION;
+		_pending.insert(_pending.end(), reinterpret_cast<const uint8_t *>(&header), reinterpret_cast<const uint8_t *>(&header + 1));
+		_sender = std::thread(&ReplicationPrimary::sendLoop, this);
+		_receiver = std::thread(&ReplicationPrimary::receiveLoop, this);
+	}
+
+	ReplicationPrimary(const ReplicationPrimary &) = delete;
+
+	/*!
+	 *  Destructor. Sends the appended records, then shuts the socket down.
+	 */
+	~ReplicationPrimary()
+	{
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			_running = false;
+		}
+		_wakeSender.notify_one();
+		_sender.join();
+		::shutdown(_fd, SHUT_RDWR); // The standby reads the rest of the stream, then its end
+		_receiver.join();
+	}
+
+	/*!
+	 *  Append complete records to the stream. Called by the journaled state machines.
+	 *
+	 *      @return The sequence number of the records, to be passed to waitAck()
+	 */
+	uint64_t append(const uint8_t *records, size_t size) override
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		if (!_failed)
+		{
+			_pending.insert(_pending.end(), records, records + size);
+		}
+		_appended += size;
+		_wakeSender.notify_one();
+		return _appended;
+	}
+
+	/*!
+	 *  Stream the snapshot of a machine, replacing the state of its replica. The snapshot is
+	 *  taken and appended under the lock of the machine, so it is ordered with its records.
+	 *
+	 *      @param [in] machine The state machine to replicate, which needs to be initialized
+	 *      @param [in] machineId The ID identifying this state machine on the standby
+	 *
+	 *      @return The sequence number of the record, to be passed to waitAck()
+	 */
+	template<class BASE>
+	uint64_t sendSnapshot(FiniteStateMachine<BASE> &machine, uint64_t machineId)
+	{
+		using Access = internal::FrameworkAccess;
+		std::vector<uint8_t> buffer(sizeof(internal::JournalRecord), 0);
+		SnapshotWriter writer(buffer);
+		Access::lock(machine);
+		internal::saveSnapshotLocked(machine, writer);
+		internal::JournalRecord record = {};
+		record.frame.length = uint32_t(buffer.size() - sizeof(record));
+		record.frame.type = internal::REPLICA_SNAPSHOT_TYPE;
+		record.machine = machineId;
+		record.stateAfter = Access::currentState(machine)->getStateId();
+		std::memcpy(buffer.data(), &record, sizeof(record));
+		buffer.resize(sizeof(record) + internal::padFrame(record.frame.length), 0);
+		const uint64_t sequence = append(buffer.data(), buffer.size());
+		Access::unlock(machine);
+		return sequence;
+	}
+
+	/*!
+	 *  Wait until the standby applied the records up to a sequence number.
+	 *
+	 *      @param [in] sequence The value returned by append(), or all records by default
+	 *
+	 *      @return Whether the records were applied, false if the standby went away
+	 */
+	bool waitAck(uint64_t sequence = UINT64_MAX)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (sequence > _appended)
+		{
+			sequence = _appended;
+		}
+		_acknowledged.wait(lock, [this, sequence]() { return _acked >= sequence || _failed; });
+		return _acked >= sequence;
+	}
+
+	/*!
+	 *  Whether the standby went away. Records appended afterwards are dropped.
+	 */
+	inline bool failed() const
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		return _failed;
+	}
+
+private:
+	bool writeAll(const uint8_t *data, size_t size)
+	{
+		while (size > 0)
+		{
+			ssize_t written = ::send(_fd, data, size, MSG_NOSIGNAL);
+			if (written < 0)
+			{
+				if (errno == EINTR) continue;
+				return false;
+			}
+			data += written;
+			size -= size_t(written);
+		}
+		return true;
+	}
+
+	void sendLoop()
+	{
+		std::vector<uint8_t> batch;
+		std::unique_lock<std::mutex> lock(_mutex);
+		while (_running || !_pending.empty())
+		{
+			_wakeSender.wait(lock, [this]() { return !_running || !_pending.empty(); });
+			if (_pending.empty() || _failed)
+			{
+				_pending.clear();
+				continue;
+			}
+
+			// Send the whole batch outside of the lock so that appending never waits on the socket
+			batch.swap(_pending);
+			lock.unlock();
+			const bool sent = writeAll(batch.data(), batch.size());
+			batch.clear();
+			lock.lock();
+			if (!sent)
+			{
+				fail();
+			}
+		}
+	}
+
+	/*!
+	 *  Read the acknowledgements : the number of record bytes applied by the standby so far
+	 */
+	void receiveLoop()
+	{
+		uint64_t ack = 0;
+		size_t received = 0;
+		for (;;)
+		{
+			ssize_t n = ::recv(_fd, reinterpret_cast<uint8_t *>(&ack) + received, sizeof(ack) - received, 0);
+			if (n < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (n <= 0)
+			{
+				break;
+			}
+			received += size_t(n);
+			if (received == sizeof(ack))
+			{
+				std::lock_guard<std::mutex> guard(_mutex);
+				_acked = ack;
+				_acknowledged.notify_all();
+				received = 0;
+			}
+		}
+		std::lock_guard<std::mutex> guard(_mutex);
+		fail();
+	}
+
+	void fail()
+	{
+		_failed = true;
+		_acknowledged.notify_all();
+	}
+
+	const int _fd;
+
+	mutable std::mutex _mutex;
+	std::condition_variable _wakeSender;
+	std::condition_variable _acknowledged;
+	std::vector<uint8_t> _pending;
+	uint64_t _appended = 0;
+	uint64_t _acked = 0;
+	bool _running = true;
+	bool _failed = false;
+	std::thread _sender;
+	std::thread _receiver;
+};
+
+/*!
+ *  The outcome of applying a replication stream
+ */
+struct ReplicaStats
+{
+	uint64_t events = 0;     // Events applied
+	uint64_t snapshots = 0;  // Machines restored from a snapshot
+	uint64_t skipped = 0;    // Records of unknown types or machines
+	uint64_t mismatches = 0; // Records after which the state differs from the primary
+	bool corrupted = false;  // The stream could not be decoded
+};
+
+/*!
+ *  Applies the records streamed by a ReplicationPrimary to the standby machines
+ *
+ *      @tparam EVENTS The EventList the primary machines record
+ *      @tparam STATES The StateList of all the concrete states of the machines, to restore snapshots
+ */
+template<class EVENTS, class STATES>
+class ReplicaApplier
+{
+public:
+	/*!
+	 *  Constructor. The applier does not take ownership of the socket.
+	 *
+	 *      @param [in] fd The connected stream socket of the standby
+	 *      @param [in] bufferSize Size of the read buffer, which bounds the size of a record
+	 */
+	explicit ReplicaApplier(int fd, size_t bufferSize = 256 * 1024)
+		: _fd(fd)
+		, _capacity(internal::padFrame(bufferSize))
+		, _buffer(new uint64_t[_capacity / sizeof(uint64_t)])
+	{}
+
+	ReplicaApplier(const ReplicaApplier &) = delete;
+
+	/*!
+	 *  Read once from the socket, apply all the complete records, then acknowledge them
+	 *
+	 *      @param [in] resolve A function returning the standby machine of a machine ID, or nullptr to skip its records
+	 *
+	 *      @return Whether the stream can go on : false at its end or on an error
+	 */
+	template<typename RESOLVER>
+	bool pump(RESOLVER &&resolve)
+	{
+		uint8_t *buffer = reinterpret_cast<uint8_t *>(_buffer.get());
+		if (_size == _capacity)
+		{
+			_stats.corrupted = true; // A single record does not fit in the buffer
+			return false;
+		}
+		ssize_t received = ::recv(_fd, buffer + _size, _capacity - _size, 0);
+		if (received < 0)
+		{
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+		}
+		if (received == 0)
+		{
+			return false;
+		}
+		_size += size_t(received);
+
+		size_t offset = 0;
+		if (!_started)
+		{
+			internal::JournalSegmentHeader header;
+			if (_size < sizeof(header))
+			{
+				return true;
+			}
+			std::memcpy(&header, buffer, sizeof(header));
+			if (std::memcmp(header.magic, internal::JOURNAL_MAGIC, sizeof(header.magic)) != 0 || header.version != internal::JOURNAL_VERSION)
+			{
+				_stats.corrupted = true;
+				return false;
+			}
+			offset = sizeof(header);
+			_started = true;
+		}
+
+		const size_t applied = offset;
+		while (_size - offset >= sizeof(internal::JournalRecord))
+		{
+			internal::JournalRecord record;
+			std::memcpy(&record, buffer + offset, sizeof(record));
+			const size_t recordSize = sizeof(record) + internal::padFrame(record.frame.length);
+			if (_size - offset < recordSize)
+			{
+				break; // Partial record, wait for more bytes
+			}
+			if (!apply(record, buffer + offset + sizeof(record), resolve))
+			{
+				_stats.corrupted = true;
+				return false;
+			}
+			offset += recordSize;
+		}
+
+		if (offset > applied)
+		{
+			_acked += offset - applied;
+			acknowledge();
+		}
+		// Move the partial record at the end to the front, keeping the payload aligned
+		_size -= offset;
+		if (_size > 0 && offset > 0)
+		{
+			std::memmove(buffer, buffer + offset, _size);
+		}
+		return true;
+	}
+
+	/*!
+	 *  Apply records until the primary goes away or the stream is corrupted
+	 *
+	 *      @param [in] resolve A function returning the standby machine of a machine ID, or nullptr to skip its records
+	 *
+	 *      @return The outcome of the replication
+	 */
+	template<typename RESOLVER>
+	ReplicaStats run(RESOLVER &&resolve)
+	{
+		while (pump(resolve))
+		{
+		}
+		return _stats;
+	}
+
+	inline const ReplicaStats &stats() const
+	{
+		return _stats;
+	}
+
+private:
+	template<typename RESOLVER>
+	bool apply(const internal::JournalRecord &record, uint8_t *payload, RESOLVER &resolve)
+	{
+		auto machine = resolve(record.machine);
+		if (!machine)
+		{
+			++_stats.skipped;
+			return true;
+		}
+		if (record.frame.type == internal::REPLICA_SNAPSHOT_TYPE)
+		{
+			SnapshotReader reader(payload, record.frame.length);
+			if (!restoreSnapshot<STATES>(*machine, reader))
+			{
+				return false;
+			}
+			++_stats.snapshots;
+		}
+		else
+		{
+			const int sent = Codec<EVENTS>::dispatchPayload(record.frame.type, payload, record.frame.length, *machine);
+			if (sent < 0)
+			{
+				return false;
+			}
+			if (sent == 0)
+			{
+				++_stats.skipped;
+				return true;
+			}
+			++_stats.events;
+		}
+		if (machine->getCurrentStateId() != record.stateAfter)
+		{
+			++_stats.mismatches;
+		}
+		return true;
+	}
+
+	void acknowledge()
+	{
+		const uint8_t *ack = reinterpret_cast<const uint8_t *>(&_acked);
+		size_t size = sizeof(_acked);
+		while (size > 0)
+		{
+			ssize_t written = ::send(_fd, ack, size, MSG_NOSIGNAL);
+			if (written < 0)
+			{
+				if (errno == EINTR) continue;
+				return; // The primary went away : the next read sees the end of the stream
+			}
+			ack += written;
+			size -= size_t(written);
+		}
+	}
+
+	int _fd;
+	size_t _capacity;
+	size_t _size = 0;
+	bool _started = false;
+	uint64_t _acked = 0; // Record bytes applied, as counted by the primary
+	ReplicaStats _stats;
+	std::unique_ptr<uint64_t[]> _buffer; // uint64_t keeps the payloads aligned
+};
+
+} // End of namespace
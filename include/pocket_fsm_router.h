@@ -0,0 +1,483 @@
+/*!
+ *  @file pocket_fsm_router.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: sharded event router.
+ *  State machines are partitioned by key into shards, each owned by a single worker
+ *  thread. Since only that thread ever touches them, sending events takes no lock.
+ *  Requires C++17.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <algorithm>          // std::max
+#include <atomic>             // std::atomic
+#include <condition_variable> // std::condition_variable
+#include <cstdint>            // uint64_t
+#include <mutex>              // std::mutex
+#include <optional>           // std::optional
+#include <thread>             // std::thread
+#include <unordered_map>      // std::unordered_map
+#include <vector>             // std::vector
+#if defined(__linux__)
+#include <pthread.h>          // pthread_setaffinity_np
+#include <sched.h>            // cpu_set_t
+#endif
+
+#if !defined(POCKET_FSM_CXX17)
+#error "pocket_fsm_router.h requires C++17"
+#endif
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. List the events routed to your state machines in an EventList. Your state machines
+	do not need to override lock() and unlock() : the router guarantees that a
+	machine is only ever used by the worker thread of its shard.
+2. Create a ShardedRouter with a factory building a state machine for a key.
+3. Each thread sending events calls makeProducer() once and uses its own Producer
+	to create, send events to, visit and retire machines by key. makeProducer()
+	returns no Producer once maxProducers were made.
+4. Poll stats() to monitor the queue depth of each shard and spot hot keys.
+
+Commands from one producer to one key are processed in order. Events sent to a key
+with no machine are dropped and counted. A worker without commands spins briefly,
+then parks until a producer pushes to its shard.
+
+************************************************************************************/
+
+/*!
+ *  Metrics of a shard, read while the router is running
+ */
+struct ShardStats
+{
+	size_t queueDepth = 0; // Commands waiting to be processed, across all producers
+	uint64_t processed = 0; // Commands processed since the start
+	uint64_t dropped = 0;   // Events sent to a key without a machine
+	size_t machines = 0;    // Machines owned by the shard
+};
+
+/*!
+ *  Routes events to state machines partitioned by key across pinned worker threads.
+ *
+ *      @tparam MACHINE Your state machine type
+ *      @tparam EVENTS The EventList of events that can be sent to the machines
+ *      @tparam KEY The key identifying a machine, hashable by std::hash
+ */
+template<class MACHINE, class EVENTS, typename KEY = uint64_t>
+class ShardedRouter
+{
+public:
+	using Factory = std::function<std::unique_ptr<MACHINE>(const KEY &)>;
+	using Visitor = std::function<void(MACHINE *)>;
+	using Variant = typename EVENTS::Variant;
+
+private:
+	/*!
+	 *  An order for a worker thread
+	 */
+	struct Command
+	{
+		enum class Kind : uint8_t { Event, Create, Retire, Visit };
+
+		Kind kind = Kind::Event;
+		KEY key = KEY();
+		Variant event;
+		Visitor visitor = nullptr;
+	};
+
+	/*!
+	 *  Bounded single producer single consumer ring of commands
+	 */
+	class CommandQueue
+	{
+	public:
+		explicit CommandQueue(size_t capacity)
+			: _mask(capacity - 1)
+			, _slots(new Command[capacity])
+		{
+			internal::ASSERT(capacity > 0 && (capacity & _mask) == 0, L"The queue capacity needs to be a power of 2");
+		}
+
+		bool push(Command &&command)
+		{
+			const size_t tail = _tail.load(std::memory_order_relaxed);
+			if (tail - _head.load(std::memory_order_acquire) > _mask)
+			{
+				return false; // Full
+			}
+			_slots[tail & _mask] = std::move(command);
+			_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		template<typename CONSUMER>
+		size_t drain(CONSUMER &&consume)
+		{
+			const size_t head = _head.load(std::memory_order_relaxed);
+			const size_t tail = _tail.load(std::memory_order_acquire);
+			for (size_t i = head; i != tail; ++i)
+			{
+				consume(_slots[i & _mask]);
+				_slots[i & _mask].visitor = nullptr; // Release captures right away
+			}
+			_head.store(tail, std::memory_order_release);
+			return tail - head;
+		}
+
+		inline size_t size() const
+		{
+			return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+		}
+
+	private:
+		const size_t _mask;
+		std::unique_ptr<Command[]> _slots;
+		alignas(64) std::atomic<size_t> _head = { 0 }; // Written by the consumer only
+		alignas(64) std::atomic<size_t> _tail = { 0 }; // Written by the producer only
+	};
+
+	/*!
+	 *  A worker thread, its queues and its machines
+	 */
+	struct alignas(64) Shard
+	{
+		std::vector<std::unique_ptr<CommandQueue>> queues; // One per producer, allocated up front
+		std::unordered_map<KEY, std::unique_ptr<MACHINE>> machines;
+		std::atomic<uint64_t> processed = { 0 };
+		std::atomic<uint64_t> dropped = { 0 };
+		std::atomic<size_t> machineCount = { 0 };
+		std::thread worker;
+
+		// Parking of the idle worker. Producers only take the mutex while it is parked.
+		std::atomic<bool> parked = { false };
+		std::mutex parking;
+		std::condition_variable wake;
+	};
+
+public:
+	/*!
+	 *  A handle to send commands to the router from a single thread.
+	 *  The send functions block while the queue of the shard is full;
+	 *  the try variants return false instead.
+	 */
+	class Producer
+	{
+	public:
+		template<typename E>
+		bool trySend(const KEY &key, const E &evt)
+		{
+			static_assert(EVENTS::template contains<E>(), "The event type is not registered in the EventList of the router");
+			Command command;
+			command.key = key;
+			command.event.template emplace<E>(evt);
+			return _router->push(_index, std::move(command));
+		}
+
+		template<typename E>
+		void send(const KEY &key, const E &evt)
+		{
+			while (!trySend(key, evt))
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		/*!
+		 *  Create the machine of a key with the factory of the router, if it does not exist yet
+		 */
+		void create(const KEY &key)
+		{
+			pushBlocking(Command::Kind::Create, key, nullptr);
+		}
+
+		/*!
+		 *  Destroy the machine of a key
+		 */
+		void retire(const KEY &key)
+		{
+			pushBlocking(Command::Kind::Retire, key, nullptr);
+		}
+
+		/*!
+		 *  Look up the machine of a key and call a function with it, or with nullptr
+		 *  if there is none. The function is called on the worker thread of the shard.
+		 */
+		void visit(const KEY &key, Visitor visitor)
+		{
+			pushBlocking(Command::Kind::Visit, key, std::move(visitor));
+		}
+
+	private:
+		friend class ShardedRouter;
+
+		Producer(ShardedRouter *router, size_t index)
+			: _router(router)
+			, _index(index)
+		{}
+
+		void pushBlocking(typename Command::Kind kind, const KEY &key, Visitor visitor)
+		{
+			Command command;
+			command.kind = kind;
+			command.key = key;
+			command.visitor = std::move(visitor);
+			while (!_router->push(_index, std::move(command)))
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		ShardedRouter *_router;
+		size_t _index;
+	};
+
+	/*!
+	 *  Constructor. Starts one worker thread per shard.
+	 *
+	 *      @param [in] factory Builds the state machine of a key on its worker thread
+	 *      @param [in] shards Number of shards, defaults to the number of cores
+	 *      @param [in] maxProducers Maximum number of calls to makeProducer()
+	 *      @param [in] queueCapacity Capacity of each producer queue, a power of 2
+	 *      @param [in] pinThreads Pin the worker of shard i to core i modulo the number of cores (Linux only)
+	 */
+	explicit ShardedRouter(Factory factory, size_t shards = 0, size_t maxProducers = 16, size_t queueCapacity = 4096, bool pinThreads = true)
+		: _factory(std::move(factory))
+		, _shards(shards ? shards : std::max(1u, std::thread::hardware_concurrency()))
+		, _maxProducers(maxProducers)
+	{
+		for (size_t s = 0; s < _shards.size(); ++s)
+		{
+			for (size_t p = 0; p < _maxProducers; ++p)
+			{
+				_shards[s].queues.emplace_back(new CommandQueue(queueCapacity));
+			}
+		}
+		for (size_t s = 0; s < _shards.size(); ++s)
+		{
+			_shards[s].worker = std::thread(&ShardedRouter::work, this, s);
+			if (pinThreads)
+			{
+				pin(_shards[s].worker, s);
+			}
+		}
+	}
+
+	ShardedRouter(const ShardedRouter &) = delete;
+
+	/*!
+	 *  Destructor. Processes the pending commands, stops the workers and destroys the machines.
+	 */
+	~ShardedRouter()
+	{
+		_running.store(false, std::memory_order_release);
+		for (Shard &shard : _shards)
+		{
+			{
+				std::lock_guard<std::mutex> guard(shard.parking);
+			}
+			shard.wake.notify_one();
+			shard.worker.join();
+		}
+	}
+
+	/*!
+	 *  Get a handle to send commands from the calling thread. Use each handle from a single thread.
+	 *
+	 *      @return The handle, or none if maxProducers handles were already made
+	 */
+	std::optional<Producer> makeProducer()
+	{
+		size_t index = _producers.load(std::memory_order_relaxed);
+		do
+		{
+			if (index >= _maxProducers)
+			{
+				return std::nullopt;
+			}
+		} while (!_producers.compare_exchange_weak(index, index + 1, std::memory_order_acq_rel));
+		return Producer(this, index);
+	}
+
+	/*!
+	 *  The shard owning the machine of a key
+	 */
+	inline size_t shardOf(const KEY &key) const
+	{
+		// Mix the hash so that sequential keys spread across shards
+		const uint64_t hash = uint64_t(std::hash<KEY>()(key)) * 0x9E3779B97F4A7C15ull;
+		return size_t((hash >> 32) % _shards.size());
+	}
+
+	inline size_t shardCount() const
+	{
+		return _shards.size();
+	}
+
+	/*!
+	 *  Metrics of a shard. Can be called from any thread.
+	 */
+	ShardStats stats(size_t shard) const
+	{
+		const Shard &s = _shards[shard];
+		ShardStats stats;
+		for (const auto &queue : s.queues)
+		{
+			stats.queueDepth += queue->size();
+		}
+		stats.processed = s.processed.load(std::memory_order_relaxed);
+		stats.dropped = s.dropped.load(std::memory_order_relaxed);
+		stats.machines = s.machineCount.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+private:
+	bool push(size_t producer, Command &&command)
+	{
+		Shard &shard = _shards[shardOf(command.key)];
+		if (!shard.queues[producer]->push(std::move(command)))
+		{
+			return false;
+		}
+		// Pairs with the fence in park() : either the worker sees the command, or this sees it parked
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (shard.parked.load(std::memory_order_relaxed))
+		{
+			{
+				std::lock_guard<std::mutex> guard(shard.parking);
+			}
+			shard.wake.notify_one();
+		}
+		return true;
+	}
+
+	bool hasCommands(const Shard &shard) const
+	{
+		const size_t producers = _producers.load(std::memory_order_acquire);
+		for (size_t p = 0; p < producers; ++p)
+		{
+			if (shard.queues[p]->size() > 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/*!
+	 *  Block the worker of a shard until a command is pushed to it or the router stops
+	 */
+	void park(Shard &shard)
+	{
+		std::unique_lock<std::mutex> lock(shard.parking);
+		shard.parked.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		shard.wake.wait(lock, [this, &shard]()
+		{
+			return !_running.load(std::memory_order_acquire) || hasCommands(shard);
+		});
+		shard.parked.store(false, std::memory_order_relaxed);
+	}
+
+	static void pin(std::thread &thread, size_t index)
+	{
+#if defined(__linux__)
+		const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(index % cores, &set);
+		pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+		(void)thread;
+		(void)index;
+#endif
+	}
+
+	void execute(Shard &shard, Command &command)
+	{
+		auto found = shard.machines.find(command.key);
+		switch (command.kind)
+		{
+		case Command::Kind::Event:
+			if (found != shard.machines.end())
+			{
+				found->second->sendEvent(command.event);
+			}
+			else
+			{
+				shard.dropped.fetch_add(1, std::memory_order_relaxed);
+			}
+			break;
+		case Command::Kind::Create:
+			if (found == shard.machines.end())
+			{
+				shard.machines.emplace(command.key, _factory(command.key));
+			}
+			break;
+		case Command::Kind::Retire:
+			if (found != shard.machines.end())
+			{
+				shard.machines.erase(found);
+			}
+			break;
+		case Command::Kind::Visit:
+			command.visitor(found != shard.machines.end() ? found->second.get() : nullptr);
+			break;
+		}
+	}
+
+	void work(size_t index)
+	{
+		Shard &shard = _shards[index];
+		unsigned idle = 0;
+		bool running = true;
+		while (running)
+		{
+			// Read the flag before draining so that commands pushed before stopping are processed
+			running = _running.load(std::memory_order_acquire);
+			const size_t producers = _producers.load(std::memory_order_acquire);
+			size_t processed = 0;
+			for (size_t p = 0; p < producers; ++p)
+			{
+				processed += shard.queues[p]->drain([this, &shard](Command &command)
+				{
+					execute(shard, command);
+				});
+			}
+
+			if (processed > 0)
+			{
+				shard.processed.fetch_add(processed, std::memory_order_relaxed);
+				shard.machineCount.store(shard.machines.size(), std::memory_order_relaxed);
+				idle = 0;
+			}
+			else if (++idle > SPINS + YIELDS)
+			{
+				park(shard);
+				idle = 0;
+			}
+			else if (idle > SPINS)
+			{
+				std::this_thread::yield();
+			}
+		}
+		shard.machines.clear();
+	}
+
+	// An idle worker polls its queues SPINS times, then yields YIELDS times, then parks
+	static constexpr unsigned SPINS = 64;
+	static constexpr unsigned YIELDS = 1024;
+
+	Factory _factory;
+	std::vector<Shard> _shards;
+	const size_t _maxProducers;
+	std::atomic<size_t> _producers = { 0 };
+	std::atomic<bool> _running = { true };
+};
+
+} // End of namespace
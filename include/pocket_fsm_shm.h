@@ -0,0 +1,485 @@
+/*!
+ *  @file pocket_fsm_shm.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: state table in POSIX shared memory.
+ *  The process owning the state machines publishes the state ID and a fixed layout
+ *  status block of each machine behind a sequence lock, so that other processes read
+ *  them without any system call. Other processes can also submit events through a
+ *  lock free ring in the same segment, which the owner pumps into its machines.
+ *  Requires a POSIX system.
+ */
+
+#pragma once
+
+#include "pocket_fsm_codec.h"
+#include "pocket_fsm_observe.h"
+#include <atomic>     // std::atomic
+#include <cerrno>     // errno
+#include <csignal>    // kill
+#include <cstring>    // std::memcpy, std::memcmp
+#include <fcntl.h>    // O_CREAT, O_EXCL, O_RDWR
+#include <new>        // placement new
+#include <string>     // std::string
+#include <sys/mman.h> // shm_open, mmap
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // ftruncate
+
+#if !defined(POCKET_FSM_CXX17)
+#error "pocket_fsm_shm.h requires C++17"
+#endif
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. Define the status block of your machines as a trivially copyable structure, and
+	list the events other processes may submit in an EventList, encoded as with
+	pocket_fsm_codec.h.
+2. The owner process calls create(name, machines, ringCapacity, layoutVersion) on a
+	SharedStateTable<Events, Status>, then publish(index, machine, status) after
+	sending events to a machine, and pump(machineAt) periodically to deliver the
+	submitted events.
+3. Observer and driver processes call open(name, layoutVersion) on the same type,
+	then read(index) to see a machine and submit(index, evt) to send it an event.
+
+Each machine has a single publisher, the owner. Reads are lock free and retry while a
+publication is in progress. A process that dies in the middle of a submission blocks
+the ring until the owner creates the segment again.
+
+Creating a segment never truncates one that other processes may have mapped. It fails
+while the owner of an existing segment with the same name is running. A segment left
+by an owner that died is unlinked and replaced by a new one : processes still mapping
+it keep the old memory until they open the name again.
+
+************************************************************************************/
+
+/*!
+ *  A machine as last published in the shared table
+ *
+ *      @tparam STATUS The status block of the machines
+ */
+template<class STATUS>
+struct SharedEntry
+{
+	StateId state = 0;    // 0 until the first publication
+	uint64_t version = 0; // Number of publications
+	STATUS status = STATUS();
+};
+
+namespace internal
+{
+constexpr char SHARED_MAGIC[8] = { 'P', 'F', 'S', 'M', 'S', 'H', 'M', 'T' };
+constexpr uint32_t SHARED_FORMAT_VERSION = 2;
+
+/*!
+ *  Header at the start of a shared segment
+ */
+struct alignas(64) SharedHeader
+{
+	char magic[8];          // Written last by the owner, once the segment is initialized
+	uint32_t formatVersion; // Version of this header
+	uint32_t layoutVersion; // Version of the user status and events
+	uint32_t slotSize;
+	uint32_t frameSize;
+	uint64_t count;
+	uint64_t ringCapacity;
+	int32_t owner;          // Process ID of the owner, written first
+	uint32_t reserved;
+};
+
+/*!
+ *  Indexes of the submission ring, each on its own cache line
+ */
+struct SharedRingControl
+{
+	alignas(64) std::atomic<uint64_t> tail;     // Submitting processes
+	alignas(64) std::atomic<uint64_t> head;     // Owner
+	std::atomic<uint64_t> malformed;            // Frames the owner could not decode
+	alignas(64) std::atomic<uint64_t> rejected; // Submissions to a full ring
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory needs lock free 64 bits atomics");
+}
+
+/*!
+ *  The states of a set of machines, shared with other processes
+ *
+ *      @tparam EVENTS The EventList of the events other processes can submit
+ *      @tparam STATUS The trivially copyable status block published with each state
+ *      @tparam FRAME The maximum size of an encoded event, header included, a multiple of 8
+ */
+template<class EVENTS, class STATUS, size_t FRAME = 64>
+class SharedStateTable
+{
+	static_assert(std::is_trivially_copyable<STATUS>::value, "The status block of a shared table needs to be trivially copyable");
+	static_assert(FRAME % 8 == 0 && FRAME > sizeof(internal::FrameHeader), "The frame size needs to be a multiple of 8 larger than the frame header");
+
+public:
+	using Entry = SharedEntry<STATUS>;
+
+	SharedStateTable() = default;
+	SharedStateTable(const SharedStateTable &) = delete;
+
+	~SharedStateTable()
+	{
+		close();
+	}
+
+	/*!
+	 *  Create the segment as its owner. A segment with the same name is replaced only if
+	 *  its owner is no longer running.
+	 *
+	 *      @param [in] name The name of the segment, starting with a slash
+	 *      @param [in] count The number of machines
+	 *      @param [in] ringCapacity The number of events the ring holds, a power of 2
+	 *      @param [in] layoutVersion The version of STATUS and EVENTS, to change whenever they change
+	 *
+	 *      @return Whether the segment could be created, false with errno EEXIST if its owner is running
+	 */
+	bool create(const std::string &name, size_t count, size_t ringCapacity, uint32_t layoutVersion)
+	{
+		internal::ASSERT(ringCapacity > 0 && (ringCapacity & (ringCapacity - 1)) == 0, L"The ring capacity needs to be a power of 2");
+		close();
+		int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0660);
+		if (fd < 0 && errno == EEXIST)
+		{
+			if (ownerRunning(name))
+			{
+				errno = EEXIST;
+				return false;
+			}
+			// Unlinked rather than truncated : processes mapping the stale segment are not affected
+			::shm_unlink(name.c_str());
+			fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0660);
+		}
+		if (fd < 0)
+		{
+			return false;
+		}
+		const size_t size = sizeFor(count, ringCapacity);
+		if (::ftruncate(fd, off_t(size)) != 0 || !map(fd, size))
+		{
+			::close(fd);
+			::shm_unlink(name.c_str());
+			return false;
+		}
+		::close(fd);
+
+		internal::SharedHeader *header = new (_data) internal::SharedHeader();
+		header->owner = int32_t(::getpid());
+		header->formatVersion = internal::SHARED_FORMAT_VERSION;
+		header->layoutVersion = layoutVersion;
+		header->slotSize = uint32_t(sizeof(Slot));
+		header->frameSize = uint32_t(FRAME);
+		header->count = count;
+		header->ringCapacity = ringCapacity;
+		layout(count, ringCapacity);
+		new (_ring) internal::SharedRingControl();
+		for (size_t i = 0; i < count; ++i)
+		{
+			new (&_slots[i]) Slot();
+		}
+		for (size_t i = 0; i < ringCapacity; ++i)
+		{
+			new (&_cells[i]) Cell();
+			_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(header->magic, internal::SHARED_MAGIC, sizeof(header->magic));
+		return true;
+	}
+
+	/*!
+	 *  Open the segment created by the owner, to read and submit
+	 *
+	 *      @param [in] name The name of the segment, starting with a slash
+	 *      @param [in] layoutVersion The version of STATUS and EVENTS, which needs to match the owner
+	 *
+	 *      @return Whether the segment exists and matches this table
+	 */
+	bool open(const std::string &name, uint32_t layoutVersion)
+	{
+		close();
+		const int fd = ::shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+		if (fd < 0)
+		{
+			return false;
+		}
+		struct stat info;
+		internal::SharedHeader header;
+		bool valid = ::fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(header) &&
+			::pread(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header));
+		valid = valid && std::memcmp(header.magic, internal::SHARED_MAGIC, sizeof(header.magic)) == 0 &&
+			header.formatVersion == internal::SHARED_FORMAT_VERSION && header.layoutVersion == layoutVersion &&
+			header.slotSize == sizeof(Slot) && header.frameSize == FRAME &&
+			size_t(info.st_size) == sizeFor(size_t(header.count), size_t(header.ringCapacity));
+		if (!valid || !map(fd, size_t(info.st_size)))
+		{
+			::close(fd);
+			return false;
+		}
+		::close(fd);
+		layout(size_t(header.count), size_t(header.ringCapacity));
+		return true;
+	}
+
+	/*!
+	 *  Unmap the segment. It stays available to the other processes.
+	 */
+	void close()
+	{
+		if (_data)
+		{
+			::munmap(_data, _size);
+		}
+		_data = nullptr;
+		_size = 0;
+		_count = 0;
+		_slots = nullptr;
+		_ring = nullptr;
+		_cells = nullptr;
+		_mask = 0;
+	}
+
+	/*!
+	 *  Remove the name of a segment. Processes that mapped it keep it until they close it.
+	 */
+	static bool unlink(const std::string &name)
+	{
+		return ::shm_unlink(name.c_str()) == 0;
+	}
+
+	inline bool isOpen() const
+	{
+		return _data != nullptr;
+	}
+
+	inline size_t size() const
+	{
+		return _count;
+	}
+
+	/*!
+	 *  Publish the state of a machine. Only the owner publishes a given machine.
+	 *
+	 *      @param [in] index The index of the machine in the table
+	 *      @param [in] state The ID of its current state
+	 *      @param [in] status Its status block
+	 */
+	void publish(size_t index, StateId state, const STATUS &status)
+	{
+		internal::ASSERT(index < _count, L"Shared machine index out of range!");
+		Published published;
+		published.state = state;
+		published.status = status;
+		_slots[index].store(published);
+	}
+
+	/*!
+	 *  Publish the current state of a machine with its status block
+	 */
+	template<class BASE>
+	void publish(size_t index, const FiniteStateMachine<BASE> &machine, const STATUS &status)
+	{
+		publish(index, machine.getCurrentStateId(), status);
+	}
+
+	/*!
+	 *  The latest publication of a machine. Lock free, callable from any process.
+	 */
+	Entry read(size_t index) const
+	{
+		internal::ASSERT(index < _count, L"Shared machine index out of range!");
+		Entry entry;
+		const Published published = _slots[index].load(entry.version);
+		entry.state = published.state;
+		entry.status = published.status;
+		return entry;
+	}
+
+	/*!
+	 *  Submit an event to a machine of the owner. Lock free, callable from any process.
+	 *
+	 *      @param [in] index The index of the machine in the table
+	 *      @param [in] evt The event, encoded as in pocket_fsm_codec.h
+	 *
+	 *      @return false if the ring is full or the event does not fit in a frame
+	 */
+	template<typename E>
+	bool submit(size_t index, const E &evt)
+	{
+		internal::ASSERT(index < _count, L"Shared machine index out of range!");
+		if (Codec<EVENTS>::frameSize(evt) > FRAME)
+		{
+			return false;
+		}
+		uint64_t tail = _ring->tail.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell &cell = _cells[tail & _mask];
+			const uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+			if (sequence == tail)
+			{
+				if (_ring->tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+				{
+					cell.machine = uint64_t(index);
+					Codec<EVENTS>::encode(evt, cell.frame, FRAME);
+					cell.sequence.store(tail + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (sequence < tail)
+			{
+				_ring->rejected.fetch_add(1, std::memory_order_relaxed);
+				return false; // The owner has not pumped this cell yet
+			}
+			else
+			{
+				tail = _ring->tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/*!
+	 *  Deliver the submitted events to the machines, in order. Only the owner pumps.
+	 *
+	 *      @param [in] machineAt MACHINE *(size_t index), returning the machine of an index or nullptr to skip the event
+	 *      @param [in] max The maximum number of events to deliver
+	 *
+	 *      @return The number of events taken off the ring
+	 */
+	template<typename MACHINE_AT>
+	size_t pump(MACHINE_AT &&machineAt, size_t max = SIZE_MAX)
+	{
+		size_t pumped = 0;
+		uint64_t head = _ring->head.load(std::memory_order_relaxed);
+		while (pumped < max)
+		{
+			Cell &cell = _cells[head & _mask];
+			if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+			{
+				break;
+			}
+			auto *machine = cell.machine < _count ? machineAt(size_t(cell.machine)) : nullptr;
+			if (machine)
+			{
+				internal::FrameHeader header;
+				std::memcpy(&header, cell.frame, sizeof(header));
+				// Any process can write the cells : the length is checked before decoding
+				if (header.length > FRAME - sizeof(header) ||
+					Codec<EVENTS>::dispatchPayload(header.type, cell.frame + sizeof(header), header.length, *machine) < 0)
+				{
+					_ring->malformed.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+			cell.sequence.store(head + _mask + 1, std::memory_order_release);
+			++head;
+			++pumped;
+		}
+		_ring->head.store(head, std::memory_order_relaxed);
+		return pumped;
+	}
+
+	/*!
+	 *  The number of submissions rejected because the ring was full, across all processes
+	 */
+	inline uint64_t rejected() const
+	{
+		return _ring->rejected.load(std::memory_order_relaxed);
+	}
+
+	/*!
+	 *  The number of submitted frames the owner dropped because they could not be decoded
+	 */
+	inline uint64_t malformed() const
+	{
+		return _ring->malformed.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Published
+	{
+		StateId state = 0;
+		uint32_t reserved = 0;
+		STATUS status = STATUS();
+	};
+
+	using Slot = internal::SeqLocked<Published>;
+
+	struct alignas(64) Cell
+	{
+		std::atomic<uint64_t> sequence = { 0 };
+		uint64_t machine = 0;
+		alignas(8) uint8_t frame[FRAME];
+	};
+
+	/*!
+	 *  Whether the process that created the segment with this name is still running.
+	 *  A segment not sized yet, or without an owner yet, is being created and counts as running.
+	 */
+	static bool ownerRunning(const std::string &name)
+	{
+		const int fd = ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+		if (fd < 0)
+		{
+			return errno != ENOENT; // Unlinked in between : not running
+		}
+		internal::SharedHeader header;
+		const bool read = ::pread(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header));
+		::close(fd);
+		if (!read || header.owner == 0)
+		{
+			return true;
+		}
+		return ::kill(pid_t(header.owner), 0) == 0 || errno == EPERM;
+	}
+
+	static constexpr size_t align(size_t offset)
+	{
+		return (offset + 63) & ~size_t(63);
+	}
+
+	static size_t sizeFor(size_t count, size_t ringCapacity)
+	{
+		return align(sizeof(internal::SharedHeader)) + align(count * sizeof(Slot)) +
+			align(sizeof(internal::SharedRingControl)) + ringCapacity * sizeof(Cell);
+	}
+
+	bool map(int fd, size_t size)
+	{
+		void *data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			return false;
+		}
+		_data = static_cast<uint8_t *>(data);
+		_size = size;
+		return true;
+	}
+
+	void layout(size_t count, size_t ringCapacity)
+	{
+		uint8_t *at = _data + align(sizeof(internal::SharedHeader));
+		_slots = reinterpret_cast<Slot *>(at);
+		at += align(count * sizeof(Slot));
+		_ring = reinterpret_cast<internal::SharedRingControl *>(at);
+		at += align(sizeof(internal::SharedRingControl));
+		_cells = reinterpret_cast<Cell *>(at);
+		_count = count;
+		_mask = ringCapacity - 1;
+	}
+
+	uint8_t *_data = nullptr;
+	size_t _size = 0;
+	size_t _count = 0;
+	Slot *_slots = nullptr;
+	internal::SharedRingControl *_ring = nullptr;
+	Cell *_cells = nullptr;
+	uint64_t _mask = 0;
+};
+
+} // End of namespace
@@ -0,0 +1,311 @@
+/*!
+ *  @file pocket_fsm_snapshot.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: snapshot and restore of state machines.
+ *  A snapshot holds the ID of the current state, of the current nested states if any,
+ *  and the pimpl in a compact binary format. Restoring rebuilds the machine directly in
+ *  that state, without calling any entry action or replaying events.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <cstring>    // std::memcpy
+#include <vector>     // std::vector
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. If your base state has a pimpl, specialize PimplSerializer<Pimpl> in your source file.
+2. List all your concrete states, nested ones included, in a StateList in your source
+	file, where they are declared.
+3. Call saveSnapshot(machine, writer) to append the machine to a buffer. Many machines
+	can be appended to the same buffer.
+4. Construct the machine without calling initialize(), then call
+	restoreSnapshot<States>(machine, reader) to read the machines back in order.
+
+Restoring replaces the current state without calling exit on it or on its nested
+states, nor entry on the restored states. It is meant for freshly constructed state machines.
+
+************************************************************************************/
+
+/*!
+ *  Appends binary data to a buffer
+ */
+class SnapshotWriter
+{
+public:
+	explicit SnapshotWriter(std::vector<uint8_t> &buffer)
+		: _buffer(buffer)
+	{}
+
+	void writeBytes(const void *data, size_t size)
+	{
+		const size_t offset = _buffer.size();
+		_buffer.resize(offset + size);
+		std::memcpy(_buffer.data() + offset, data, size);
+	}
+
+	template<typename T>
+	void write(const T &value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written as bytes");
+		writeBytes(&value, sizeof(T));
+	}
+
+	/*!
+	 *  Overwrite a value written earlier, such as a size only known afterwards
+	 */
+	template<typename T>
+	void patch(size_t offset, const T &value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written as bytes");
+		std::memcpy(_buffer.data() + offset, &value, sizeof(T));
+	}
+
+	inline size_t size() const
+	{
+		return _buffer.size();
+	}
+
+private:
+	std::vector<uint8_t> &_buffer;
+};
+
+/*!
+ *  Reads binary data from a buffer. Reading past the end fails and keeps failing.
+ */
+class SnapshotReader
+{
+public:
+	SnapshotReader(const uint8_t *data, size_t size)
+		: _data(data)
+		, _size(size)
+	{}
+
+	explicit SnapshotReader(const std::vector<uint8_t> &buffer)
+		: SnapshotReader(buffer.data(), buffer.size())
+	{}
+
+	bool readBytes(void *data, size_t size)
+	{
+		if (_failed || _size - _offset < size)
+		{
+			_failed = true;
+			return false;
+		}
+		std::memcpy(data, _data + _offset, size);
+		_offset += size;
+		return true;
+	}
+
+	template<typename T>
+	bool read(T &value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be read as bytes");
+		return readBytes(&value, sizeof(T));
+	}
+
+	/*!
+	 *  Skip bytes, typically the remainder of a record
+	 */
+	bool skip(size_t size)
+	{
+		if (_failed || _size - _offset < size)
+		{
+			_failed = true;
+			return false;
+		}
+		_offset += size;
+		return true;
+	}
+
+	inline bool failed() const
+	{
+		return _failed;
+	}
+
+	inline bool atEnd() const
+	{
+		return _offset == _size;
+	}
+
+	inline size_t offset() const
+	{
+		return _offset;
+	}
+
+private:
+	const uint8_t *_data;
+	size_t _size;
+	size_t _offset = 0;
+	bool _failed = false;
+};
+
+/*!
+ *  Saves and loads a pimpl. Specialize this for your pimpl type with:
+ *      static void save(const Pimpl &pimpl, SnapshotWriter &out);
+ *      static Pimpl *load(SnapshotReader &in); // A new pimpl, or nullptr if malformed
+ *
+ *      @tparam Pimpl The implementation class of the state machine
+ */
+template<class Pimpl>
+struct PimplSerializer;
+
+namespace internal
+{
+constexpr uint8_t SNAPSHOT_VERSION = 1;
+constexpr uint8_t SNAPSHOT_MAX_DEPTH = 16;
+
+/*!
+ *  Saves, loads and attaches the pimpl of a state, if its base state has one
+ */
+template<class BASE, class PIMPL = FrameworkAccess::PimplOf<BASE>>
+struct SnapshotPimpl
+{
+	static void save(BASE &state, SnapshotWriter &out)
+	{
+		const size_t sizeOffset = out.size();
+		out.write(uint32_t(0)); // Patched once the pimpl is written, so that the size is known
+		PimplSerializer<PIMPL>::save(*static_cast<PIMPL *>(FrameworkAccess::pimpl(state).get()), out);
+		out.patch(sizeOffset, uint32_t(out.size() - sizeOffset - sizeof(uint32_t)));
+	}
+
+	static bool load(SnapshotReader &in, std::shared_ptr<PimplBase> &pimpl)
+	{
+		uint32_t size = 0;
+		if (!in.read(size))
+		{
+			return false;
+		}
+		const size_t end = in.offset() + size;
+		PIMPL *loaded = PimplSerializer<PIMPL>::load(in);
+		pimpl.reset(static_cast<PimplBase *>(loaded));
+		return loaded && !in.failed() && in.offset() == end;
+	}
+
+	static void attach(BASE &state, const std::shared_ptr<PimplBase> &pimpl)
+	{
+		FrameworkAccess::pimpl(state) = pimpl;
+	}
+};
+
+template<class BASE>
+struct SnapshotPimpl<BASE, void>
+{
+	static void save(BASE &, SnapshotWriter &) {}
+
+	static bool load(SnapshotReader &, std::shared_ptr<PimplBase> &)
+	{
+		return true;
+	}
+
+	static void attach(BASE &, const std::shared_ptr<PimplBase> &) {}
+};
+
+/*!
+ *  Same as saveSnapshot(), for callers already holding the lock of the state machine
+ */
+template<class BASE>
+void saveSnapshotLocked(FiniteStateMachine<BASE> &machine, SnapshotWriter &out)
+{
+	BASE *state = FrameworkAccess::currentState(machine).get();
+	ASSERT(state, L"Cannot snapshot a state machine that is not initialized!");
+
+	StateId path[SNAPSHOT_MAX_DEPTH];
+	uint8_t depth = 0;
+	for (const StateIF *s = state; s; s = s->getNestedState())
+	{
+		ASSERT(depth < SNAPSHOT_MAX_DEPTH, L"Too many levels of nested state machines to snapshot!");
+		path[depth++] = s->getStateId();
+	}
+
+	out.write(SNAPSHOT_VERSION);
+	out.write(depth);
+	out.writeBytes(path, depth * sizeof(StateId));
+	SnapshotPimpl<BASE>::save(*state, out);
+}
+}
+
+/*!
+ *  Append the snapshot of a state machine to a buffer:
+ *  the version, the depth and the state IDs from the top level down, then the pimpl.
+ *
+ *      @param [in] machine The state machine to save, which needs to be initialized
+ *      @param [in,out] out The buffer receiving the snapshot
+ */
+template<class BASE>
+void saveSnapshot(FiniteStateMachine<BASE> &machine, SnapshotWriter &out)
+{
+	internal::FrameworkAccess::lock(machine);
+	internal::saveSnapshotLocked(machine, out);
+	internal::FrameworkAccess::unlock(machine);
+}
+
+/*!
+ *  Read a snapshot and rebuild the state machine in the saved states without calling
+ *  any exit or entry reaction. The previous state, if any, is discarded.
+ *
+ *      @tparam STATES The StateList of all the concrete states of the machine, nested ones included
+ *
+ *      @param [in,out] machine The state machine to restore, typically freshly constructed without initialize()
+ *      @param [in,out] in The buffer holding the snapshot, advanced past it
+ *
+ *      @return Whether the snapshot was valid. The machine is left untouched otherwise.
+ */
+template<class STATES, class BASE>
+bool restoreSnapshot(FiniteStateMachine<BASE> &machine, SnapshotReader &in)
+{
+	using Access = internal::FrameworkAccess;
+	uint8_t version = 0;
+	uint8_t depth = 0;
+	StateId path[internal::SNAPSHOT_MAX_DEPTH];
+	if (!in.read(version) || version != internal::SNAPSHOT_VERSION || !in.read(depth) ||
+		depth == 0 || depth > internal::SNAPSHOT_MAX_DEPTH || !in.readBytes(path, depth * sizeof(StateId)))
+	{
+		return false;
+	}
+
+	std::shared_ptr<PimplBase> pimpl;
+	if (!internal::SnapshotPimpl<BASE>::load(in, pimpl))
+	{
+		return false;
+	}
+
+	std::unique_ptr<BASE> state(STATES::template create<BASE>(path[0]));
+	if (!state)
+	{
+		return false;
+	}
+	internal::SnapshotPimpl<BASE>::attach(*state, pimpl);
+
+	// Nested states share the pimpl and are adopted by the state holding their state machine
+	BASE *parent = state.get();
+	for (uint8_t i = 1; i < depth; ++i)
+	{
+		std::unique_ptr<BASE> nested(STATES::template create<BASE>(path[i]));
+		if (nested)
+		{
+			internal::SnapshotPimpl<BASE>::attach(*nested, pimpl);
+		}
+		if (!nested || !Access::restoreNestedState(*parent, nested.get()))
+		{
+			// The states adopted so far never entered : drop them without exit
+			Access::discardNestedState(*state);
+			return false;
+		}
+		parent = nested.release();
+	}
+
+	Access::lock(machine);
+	Access::replaceState(machine, std::shared_ptr<BASE>(state.release()));
+	Access::unlock(machine);
+	return true;
+}
+
+} // End of namespace
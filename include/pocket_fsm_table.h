@@ -0,0 +1,216 @@
+/*!
+ *  @file pocket_fsm_table.h
+ *  @author Electronicks
+ *  @date 2026-10-18
+ *
+ *  Optional extension of pocket_fsm: table driven fast path for streams of small tokens.
+ *  Tokens are classified into a small alphabet of symbols and stepped through a dense
+ *  transition table without virtual dispatch. Only the cells marked as reacting go
+ *  through the regular react, exit and entry functions of the states.
+ */
+
+#pragma once
+
+#include "pocket_fsm.h"
+#include <cstdint>    // uint8_t
+
+namespace pocket_fsm
+{
+
+/************************************************************************************
+								  U S A G E
+-------------------------------------------------------------------------------------
+1. List the concrete states of your flat state machine in a StateList.
+2. Choose a classification of your tokens into a small number of symbols, for example
+	a digit is a symbol and any other token is another one.
+3. Build a TransitionTable<States, Symbols>. Every cell reacts by default, which is
+	always correct. Mark the cells where the react has no side effect:
+	- ignore<State>(symbol) when the react does nothing,
+	- jump<From, To>(symbol) when the react only changes the state, and neither the exit
+		of From nor the entry of To has any side effect.
+4. Derive your state machine from TableStateMachine<BaseState, States, Symbols>, passing
+	the table to its constructor, which may be shared by many machines.
+5. Call runStream(tokens, count, classify) where classify returns the symbol of a token.
+
+Jumps only recreate the state object when a reacting cell or the end of the stream is
+reached, without calling exit or entry. The observer, if any, is then notified of the
+state reached by the jumps. State machines with event hooks, which need to see every
+event, send every token to the react function. Nested state machines are not supported.
+
+************************************************************************************/
+
+/*!
+ *  Dense transition table indexed by state and symbol. Can be built at compile time.
+ *
+ *      @tparam STATES The StateList of the concrete states
+ *      @tparam SYMBOLS The number of token classes
+ */
+template<class STATES, size_t SYMBOLS>
+class TransitionTable
+{
+public:
+	static constexpr uint8_t REACT = 0xFF; // Cell sending the token to the react function
+
+	static_assert(STATES::size < REACT, "Too many states for a transition table");
+	static_assert(SYMBOLS > 0, "A transition table needs at least one symbol");
+
+	constexpr TransitionTable()
+		: _cells()
+	{
+		for (size_t i = 0; i < STATES::size * SYMBOLS; ++i)
+		{
+			_cells[i] = REACT;
+		}
+	}
+
+	/*!
+	 *  The react of FROM to the symbol does nothing
+	 */
+	template<class FROM>
+	constexpr TransitionTable &ignore(size_t symbol)
+	{
+		return set(index<FROM>(), symbol, uint8_t(index<FROM>()));
+	}
+
+	/*!
+	 *  The react of FROM to the symbol only changes the state to TO, and neither the exit
+	 *  of FROM nor the entry of TO has any side effect
+	 */
+	template<class FROM, class TO>
+	constexpr TransitionTable &jump(size_t symbol)
+	{
+		return set(index<FROM>(), symbol, uint8_t(index<TO>()));
+	}
+
+	/*!
+	 *  The react of FROM to the symbol is called, which is the default
+	 */
+	template<class FROM>
+	constexpr TransitionTable &react(size_t symbol)
+	{
+		return set(index<FROM>(), symbol, REACT);
+	}
+
+	/*!
+	 *  The index of the next state, or REACT
+	 */
+	constexpr uint8_t next(size_t state, size_t symbol) const
+	{
+		return _cells[state * SYMBOLS + symbol];
+	}
+
+private:
+	template<class S>
+	static constexpr size_t index()
+	{
+		static_assert(STATES::template indexOf<S>() < STATES::size, "The state is missing from the StateList of the table");
+		return STATES::template indexOf<S>();
+	}
+
+	constexpr TransitionTable &set(size_t state, size_t symbol, uint8_t next)
+	{
+		internal::ASSERT(symbol < SYMBOLS, L"Symbol out of range of the transition table!");
+		_cells[state * SYMBOLS + symbol] = next;
+		return *this;
+	}
+
+	uint8_t _cells[STATES::size * SYMBOLS];
+};
+
+/*!
+ *  A FiniteStateMachine that can step through streams of tokens with a transition table.
+ *
+ *      @tparam BASE The name of your base state
+ *      @tparam STATES The StateList of all the concrete states of the machine
+ *      @tparam SYMBOLS The number of token classes
+ */
+template<class BASE, class STATES, size_t SYMBOLS>
+class TableStateMachine : public FiniteStateMachine<BASE>
+{
+protected:
+	using FSM = FiniteStateMachine<BASE>;
+
+public:
+	using Table = TransitionTable<STATES, SYMBOLS>;
+
+	/*!
+	 *  Constructor
+	 *
+	 *      @param [in] table The transition table, which needs to outlive the state machine
+	 */
+	explicit TableStateMachine(const Table &table)
+		: _table(table)
+	{}
+
+	/*!
+	 *  Send a stream of tokens to the state machine. Tokens on reacting cells are copied
+	 *  and sent to the current state as with sendEvent(), as are all tokens if event hooks
+	 *  are set. The lock is held for the whole stream.
+	 *
+	 *      @tparam T The type of the tokens, an event of the state machine
+	 *
+	 *      @param [in] tokens The tokens to send, in order
+	 *      @param [in] count The number of tokens
+	 *      @param [in] classify Returns the symbol of a token, lower than SYMBOLS
+	 *
+	 *      @return The number of tokens sent to a react function
+	 */
+	template<typename T, typename CLASSIFY>
+	size_t runStream(const T *tokens, size_t count, CLASSIFY classify)
+	{
+		static_assert(!std::is_same<T, internal::OnEntry>::value && !std::is_same<T, internal::OnExit>::value, "Cannot send an internal event");
+		this->lock();
+		internal::ASSERT(FSM::_currentState.get(), L"You did not call \"initialize(new MyInitialState(new MyPimpl()));\" in your constructor!");
+		const bool hooked = FSM::_eventHooks;
+		size_t current = STATES::indexOf(FSM::_currentState->getStateId());
+		internal::ASSERT(current < STATES::size, L"The current state is missing from the StateList of the table!");
+		size_t materialized = current; // The state the state object really is in
+		size_t reacts = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const size_t symbol = classify(tokens[i]);
+			internal::ASSERT(symbol < SYMBOLS, L"Symbol out of range of the transition table!");
+			const uint8_t next = hooked ? Table::REACT : _table.next(current, symbol);
+			if (next != Table::REACT)
+			{
+				current = next;
+				continue;
+			}
+
+			materialize(current, materialized);
+			T evt = tokens[i];
+			FSM::processEvent(evt);
+			current = materialized = STATES::indexOf(FSM::_currentState->getStateId());
+			internal::ASSERT(current < STATES::size, L"The current state is missing from the StateList of the table!");
+			++reacts;
+		}
+		materialize(current, materialized);
+		this->unlock();
+		return reacts;
+	}
+
+private:
+	/*!
+	 *  Replace the state object by the state reached through jumps, without exit or entry,
+	 *  and notify the observer of the jumps
+	 */
+	void materialize(size_t current, size_t &materialized)
+	{
+		if (current == materialized)
+		{
+			return;
+		}
+		BASE *state = STATES::template create<BASE>(STATES::idAt(current));
+		internal::FrameworkAccess::sharePimpl(*state, *FSM::_currentState);
+		FSM::replaceState(std::shared_ptr<BASE>(state));
+		if (FSM::_observer)
+		{
+			FSM::_observer->onTransition(*this, STATES::idAt(materialized), STATES::idAt(current));
+		}
+		materialized = current;
+	}
+
+	const Table &_table;
+};
+
+} // End of namespace